@@ -11,7 +11,7 @@
 
 #include "timers.h"
 #include "servo.h"
-#include "flash.h"
+#include "params.h"
 
 // =============================================================================
 // Private type definitions
@@ -52,72 +52,35 @@ static q16_16_t bd = 0;
 
 static bool servo_enabled = false;
 
+// Terms of the last output
+static control_terms_t last_terms = {0};
+
+// Generation of the parameters the coefficients were calculated from
+static uint16_t params_generation = 0;
+
 static volatile bool initialized = false;
 
 // =============================================================================
 // Private function declarations
 // =============================================================================
 
+/**
+ * @brief Copies the PID constants from the parameter cache and calculates the
+ * coefficients used by control_update_pid().
+ */
+static void update_coefficients(void);
+
 // =============================================================================
 // Public function definitions
 // =============================================================================
 
 
-void control_set_k(q16_16_t kp)
-{
-    K = kp;
-}
-
-void control_set_ti(q16_16_t ti)
-{
-    t_i = ti;
-
-    integral_factor = q16_16_multiply(K, SAMPING_INTEVAL_SEC);
-    integral_factor = q16_16_divide(integral_factor, t_i);
-}
-
-void control_set_td(q16_16_t td)
-{
-    t_d = td;
-
-    ad = q16_16_divide(t_d, q16_16_multiply(t_d, SAMPING_INTEVAL_SEC));
-    bd = q16_16_multiply(q16_16_multiply(K, ad), d_max_gain);
-}
-
-void control_set_ttr(q16_16_t ttr)
-{
-    t_tr = ttr;
-
-    t_tr = ttr;
-    tracking_factor = q16_16_divide(SAMPING_INTEVAL_SEC, t_tr);
-}
-
-q16_16_t control_get_k(void)
-{
-    return K;
-}
-
-q16_16_t control_get_ti(void)
-{
-    return t_i;
-}
-
-q16_16_t control_get_td(void)
-{
-    return t_d;
-}
-
 void control_init(void)
 {
     integral = 0;
     derivative = 0;
-    
-    d_max_gain = (q16_16_t)flash_read_dword(FLASH_INDEX_D_MAX_GAIN);
 
-    control_set_k((q16_16_t)flash_read_dword(FLASH_INDEX_K));
-    control_set_ti((q16_16_t)flash_read_dword(FLASH_INDEX_TI));
-    control_set_td((q16_16_t)flash_read_dword(FLASH_INDEX_TD));
-    control_set_ttr((q16_16_t)flash_read_dword(FLASH_INDEX_TTR));
+    update_coefficients();
 
     initialized = true;
 }
@@ -130,6 +93,11 @@ void control_update_pid(q16_16_t current_reading)
         q16_16_t pid_result;
         q16_16_t pid_restricted_result;
 
+        if (params_get_generation() != params_generation)
+        {
+            update_coefficients();
+        }
+
         error = reference_val - current_reading;
 
         //
@@ -142,17 +110,11 @@ void control_update_pid(q16_16_t current_reading)
         //
         // Calculate PID output
         //
-        pid_result = q16_16_multiply(K, error);
-        
-        if ((0 != t_i) && (0 != t_tr))
-        {
-            pid_result += integral;
-        }
-        
-        if (0 != t_d)
-        {
-            pid_result += derivative;
-        }
+        last_terms.p = q16_16_multiply(K, error);
+        last_terms.i = ((0 != t_i) && (0 != t_tr)) ? integral : 0;
+        last_terms.d = (0 != t_d) ? derivative : 0;
+
+        pid_result = last_terms.p + last_terms.i + last_terms.d;
 
         //
         // Calculate restricted output value
@@ -225,6 +187,11 @@ void control_set_target_value(q16_16_t target_value)
     reference_val = target_value;
 }
 
+void control_get_terms(control_terms_t * terms)
+{
+    *terms = last_terms;
+}
+
 void control_enable_servo(bool enable)
 {
     servo_enabled = enable;
@@ -235,5 +202,23 @@ void control_enable_servo(bool enable)
 // Private function definitions
 // =============================================================================
 
+static void update_coefficients(void)
+{
+    const params_t * params = params_get();
+
+    params_generation = params_get_generation();
+
+    K = params->k;
+    t_i = params->ti;
+    t_d = params->td;
+    t_tr = params->ttr;
+    d_max_gain = params->d_max_gain;
+
+    integral_factor = q16_16_multiply(K, SAMPING_INTEVAL_SEC);
+    integral_factor = q16_16_divide_fast(integral_factor, t_i);
 
+    ad = q16_16_divide_fast(t_d, q16_16_multiply(t_d, SAMPING_INTEVAL_SEC));
+    bd = q16_16_multiply(q16_16_multiply(K, ad), d_max_gain);
 
+    tracking_factor = q16_16_divide_fast(SAMPING_INTEVAL_SEC, t_tr);
+}
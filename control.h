@@ -22,6 +22,13 @@ extern "C" {
 // Public type definitions
 // =============================================================================
 
+typedef struct control_terms_t
+{
+    q16_16_t p;     // Proportional part
+    q16_16_t i;     // Integral part, 0 when not used
+    q16_16_t d;     // Derivative part, 0 when not used
+} control_terms_t;
+
 // =============================================================================
 // Global variable declarations
 // =============================================================================
@@ -34,60 +41,18 @@ extern "C" {
 // Public function declarations
 // =============================================================================
 
-/**
- * @brief Sets the proportional part of the PID regulator.
- * @param kp - proportional part to set.
- */
-void control_set_k(q16_16_t k);
-
-/**
- * @brief Sets the integral time constant of the PID regulator.
- * @param ki - integral time constant to set.
- */
-void control_set_ti(q16_16_t ti);
-
-/**
- * @brief Sets the derivate time constant of the PID regulator.
- * @param kd - derivate time constant to set.
- */
-void control_set_td(q16_16_t td);
-
-/**
- * @brief Sets the integral tracking time constant of the PID regulator.
- * @param kd - time constant to set.
- */
-void control_set_ttr(q16_16_t ttr);
-
-/**
- * @brief Gets the P part of the PID regulator.
- * @return P contant in the PID regulator.
- */
-q16_16_t control_get_k(void);
-
-
-/**
- * @brief Gets the I part of the PID regulator.
- * @return I contant in the PID regulator.
- */
-q16_16_t control_get_ti(void);
-
-
-/**
- * @brief Gets the D part of the PID regulator.
- * @return D contant in the PID regulator.
- */
-q16_16_t control_get_td(void);
-
-
 /**
  * @brief Inititalizes the temperature regulator.
- * @details Kp, Ki and Kd values should be set before calling this function.
+ * @details The PID constants are taken from the parameter cache, and are
+ * updated whenever its generation changes. See params.h.
  */
 void control_init(void);
 
 
 /**
  * @brief Updates the temperature PID controller.
+ * @details Recalculates the PID coefficients first if the parameters have
+ * changed.
  * @param current_temperature - The current temperature in the oven.
  * @return Calculated heater power to use.
  */
@@ -100,6 +65,12 @@ void control_update_pid(q16_16_t current_reading);
  */
 void control_set_target_value(q16_16_t target_value);
 
+/**
+ * @brief Gets the terms of the last control_update_pid() output.
+ * @param terms - Where to store the terms.
+ */
+void control_get_terms(control_terms_t * terms);
+
 /**
  * @breif Enables or disables the controler to use the servo for cooling.
  * @param enable - true = enabled, false = disabled.
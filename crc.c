@@ -0,0 +1,61 @@
+// =============================================================================
+// Include statements
+// =============================================================================
+
+#include "crc.h"
+
+#include <stdint.h>
+
+// =============================================================================
+// Private type definitions
+// =============================================================================
+
+// =============================================================================
+// Global variables
+// =============================================================================
+
+// =============================================================================
+// Private constants
+// =============================================================================
+
+// CRC of each nibble value in the 4 MSB
+static const uint16_t crc_table[16] =
+{
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+// =============================================================================
+// Private variables
+// =============================================================================
+
+// =============================================================================
+// Private function declarations
+// =============================================================================
+
+// =============================================================================
+// Public function definitions
+// =============================================================================
+
+uint16_t crc16_update(uint16_t crc, uint8_t data)
+{
+    crc = (crc << 4) ^ crc_table[(crc >> 12) ^ (data >> 4)];
+    crc = (crc << 4) ^ crc_table[(crc >> 12) ^ (data & 0x0F)];
+
+    return crc;
+}
+
+uint16_t crc16_block(uint16_t crc, const uint8_t * data, uint16_t len)
+{
+    while (len--)
+    {
+        crc = crc16_update(crc, *data++);
+    }
+
+    return crc;
+}
+
+// =============================================================================
+// Private function definitions
+// =============================================================================
+
@@ -0,0 +1,62 @@
+/*
+ * This file calculates CRC-16/CCITT-FALSE checksums, polynomial 0x1021,
+ * initial value 0xFFFF, no reflection and no final XOR. The check value of
+ * "123456789" is 0x29B1.
+ *
+ * A 16 entry table is used, which processes one nibble per step.
+ */
+
+#ifndef CRC_H
+#define	CRC_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+// =============================================================================
+// Include statements
+// =============================================================================
+
+#include <stdint.h>
+
+// =============================================================================
+// Public type definitions
+// =============================================================================
+
+// =============================================================================
+// Global variable declarations
+// =============================================================================
+
+// =============================================================================
+// Global constatants
+// =============================================================================
+
+#define CRC16_INIT      0xFFFF
+
+// =============================================================================
+// Public function declarations
+// =============================================================================
+
+/**
+ * @brief Adds one byte to a checksum.
+ * @param crc - The checksum so far, CRC16_INIT for the first byte.
+ * @param data - The byte.
+ * @return The updated checksum.
+ */
+uint16_t crc16_update(uint16_t crc, uint8_t data);
+
+/**
+ * @brief Adds a block of bytes to a checksum.
+ * @param crc - The checksum so far, CRC16_INIT for the first block.
+ * @param data - The bytes.
+ * @param len - Number of bytes.
+ * @return The updated checksum.
+ */
+uint16_t crc16_block(uint16_t crc, const uint8_t * data, uint16_t len);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* CRC_H */
+
@@ -5,6 +5,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 // =============================================================================
 // Private type definitions
@@ -18,6 +19,198 @@
 // Private constants
 // =============================================================================
 
+//
+// Seed values for q16_16_reciprocal().
+// Entry i is 1/x in Q2.30 for the geometric mean x of the interval
+// [0.5 + i/256, 0.5 + (i+1)/256), which keeps the relative error of the seed
+// below 2^-8 over the whole interval.
+//
+#define RECIP_SEED_BITS     7
+#define RECIP_SEED_SHIFT    (31 - RECIP_SEED_BITS)
+#define RECIP_SEED_MASK     ((1UL << RECIP_SEED_BITS) - 1)
+
+static const uint32_t recip_seed[1 << RECIP_SEED_BITS] =
+{
+    0x7F80BEC2, 0x7E84B075, 0x7D8C7F17, 0x7C981417,
+    0x7BA75994, 0x7ABA3A54, 0x79D0A1C0, 0x78EA7BDB,
+    0x7807B53E, 0x77283B14, 0x764BFB12, 0x7572E373,
+    0x749CE2F5, 0x73C9E8D1, 0x72F9E4BA, 0x722CC6D8,
+    0x71627FC0, 0x709B0078, 0x6FD63A6A, 0x6F141F69,
+    0x6E54A1A9, 0x6D97B3BA, 0x6CDD488B, 0x6C255361,
+    0x6B6FC7D7, 0x6ABC99DA, 0x6A0BBDAA, 0x695D27D0,
+    0x68B0CD23, 0x6806A2C3, 0x675E9E13, 0x66B8B4BD,
+    0x6614DCAD, 0x65730C0D, 0x64D33946, 0x64355AFD,
+    0x63996813, 0x62FF579D, 0x626720EC, 0x61D0BB83,
+    0x613C1F18, 0x60A94396, 0x60182116, 0x5F88AFE1,
+    0x5EFAE86F, 0x5E6EC362, 0x5DE43989, 0x5D5B43DD,
+    0x5CD3DB7E, 0x5C4DF9B7, 0x5BC997F5, 0x5B46AFCF,
+    0x5AC53AFD, 0x5A45335D, 0x59C692ED, 0x594953CE,
+    0x58CD7041, 0x5852E2A8, 0x57D9A581, 0x5761B36C,
+    0x56EB0723, 0x56759B7E, 0x56016B6F, 0x558E7207,
+    0x551CAA6C, 0x54AC0FE1, 0x543C9DC2, 0x53CE4F82,
+    0x536120AC, 0x52F50CE3, 0x528A0FDF, 0x5220256F,
+    0x51B74978, 0x514F77F3, 0x50E8ACED, 0x5082E487,
+    0x501E1AF6, 0x4FBA4C82, 0x4F577585, 0x4EF5926A,
+    0x4E949FB1, 0x4E3499E6, 0x4DD57DAB, 0x4D7747AE,
+    0x4D19F4B0, 0x4CBD8180, 0x4C61EAFD, 0x4C072E14,
+    0x4BAD47C2, 0x4B543510, 0x4AFBF317, 0x4AA47EFD,
+    0x4A4DD5F4, 0x49F7F53C, 0x49A2DA23, 0x494E8200,
+    0x48FAEA39, 0x48A8103F, 0x4855F18E, 0x48048BAE,
+    0x47B3DC32, 0x4763E0B7, 0x471496E6, 0x46C5FC71,
+    0x46780F15, 0x462ACC99, 0x45DE32CD, 0x45923F8B,
+    0x4546F0B5, 0x44FC443A, 0x44B2380C, 0x4468CA2C,
+    0x441FF89E, 0x43D7C172, 0x439022BF, 0x43491AA5,
+    0x4302A749, 0x42BCC6DB, 0x42777791, 0x4232B7A8,
+    0x41EE8566, 0x41AADF16, 0x4167C30C, 0x41252FA0,
+    0x40E32334, 0x40A19C2F, 0x406098FE, 0x40201814
+};
+
+#define Q2_30_ONE           (0x40000000L)
+
+// 10^decimals, used by q16_16_to_str()
+static const uint16_t decimal_scale[Q16_16_STR_DECIMALS + 1] =
+{
+    1, 10, 100, 1000, 10000
+};
+
+// Fractional digits beyond this do not affect the result of str_to_q16_16()
+#define STR_MAX_FRACTION_DIGITS (8)
+
+//
+// Tables for q16_16_log2_fast() and q16_16_exp2_fast().
+// log2_table[i] = log2(1 + i/N) and exp2_table[i] = 2^(i/N) in q16_16_t,
+// where N = LOG2_TABLE_SIZE. Both functions interpolate linearly between the
+// table entries.
+//
+// A chord lies below the concave log2 and above the convex exp2, by up to
+// f''(t) / (8 N^2) in the middle of an interval. Each entry is therefore
+// moved by -f''(t) / (16 N^2), so the interpolation error is centered around
+// zero. This halves the max error, but log2(1.0) gives 1 LSB instead of 0
+// with the default table size.
+//
+#define LOG2_TABLE_SIZE     (1 << FIXED_POINT_LOG2_TABLE_BITS)
+#define LOG2_TABLE_MASK     (LOG2_TABLE_SIZE - 1)
+
+#if (FIXED_POINT_LOG2_TABLE_BITS == 4)
+static const uint32_t log2_table[LOG2_TABLE_SIZE + 1] =
+{
+    0x00017, 0x01678, 0x02B92, 0x03F89, 0x05279, 0x0647C,
+    0x075AA, 0x08613, 0x095CA, 0x0A4DD, 0x0B359, 0x0C148,
+    0x0CEB6, 0x0DBAC, 0x0E831, 0x0F44C, 0x10006
+};
+
+static const uint32_t exp2_table[LOG2_TABLE_SIZE + 1] =
+{
+    0x0FFF8, 0x10B4D, 0x11723, 0x1237F, 0x13067, 0x13DE1,
+    0x14BF4, 0x15AA6, 0x169FF, 0x17A06, 0x18AC2, 0x19C3D,
+    0x1AE7D, 0x1C18C, 0x1D573, 0x1EA3C, 0x1FFF1
+};
+#elif (FIXED_POINT_LOG2_TABLE_BITS == 5)
+static const uint32_t log2_table[LOG2_TABLE_SIZE + 1] =
+{
+    0x00006, 0x00B63, 0x01669, 0x0211E, 0x02B85, 0x035A3,
+    0x03F7C, 0x04914, 0x0526E, 0x05B8C, 0x06472, 0x06D23,
+    0x075A0, 0x07DED, 0x0860B, 0x08DFC, 0x095C3, 0x09D60,
+    0x0A4D6, 0x0AC26, 0x0B352, 0x0BA5B, 0x0C142, 0x0C809,
+    0x0CEB1, 0x0D53A, 0x0DBA6, 0x0E1F7, 0x0E82C, 0x0EE46,
+    0x0F448, 0x0FA31, 0x10001
+};
+
+static const uint32_t exp2_table[LOG2_TABLE_SIZE + 1] =
+{
+    0x0FFFE, 0x10599, 0x10B54, 0x1112E, 0x11729, 0x11D46,
+    0x12385, 0x129E8, 0x1306E, 0x13718, 0x13DE8, 0x144DE,
+    0x14BFB, 0x15340, 0x15AAE, 0x16245, 0x16A07, 0x171F5,
+    0x17A0E, 0x18256, 0x18ACB, 0x19370, 0x19C46, 0x1A54D,
+    0x1AE87, 0x1B7F4, 0x1C196, 0x1CB6F, 0x1D57E, 0x1DFC6,
+    0x1EA47, 0x1F504, 0x1FFFC
+};
+#elif (FIXED_POINT_LOG2_TABLE_BITS == 6)
+static const uint32_t log2_table[LOG2_TABLE_SIZE + 1] =
+{
+    0x00001, 0x005BB, 0x00B5F, 0x010ED, 0x01665, 0x01BC9,
+    0x0211A, 0x02657, 0x02B81, 0x03099, 0x035A0, 0x03A95,
+    0x03F79, 0x0444D, 0x04911, 0x04DC6, 0x0526B, 0x05701,
+    0x05B89, 0x06003, 0x06470, 0x068CF, 0x06D20, 0x07166,
+    0x0759E, 0x079CA, 0x07DEB, 0x08200, 0x08609, 0x08A07,
+    0x08DFA, 0x091E3, 0x095C1, 0x09995, 0x09D5E, 0x0A11E,
+    0x0A4D4, 0x0A881, 0x0AC25, 0x0AFBF, 0x0B351, 0x0B6D9,
+    0x0BA5A, 0x0BDD1, 0x0C141, 0x0C4A8, 0x0C808, 0x0CB5F,
+    0x0CEAF, 0x0D1F8, 0x0D539, 0x0D872, 0x0DBA5, 0x0DED1,
+    0x0E1F5, 0x0E513, 0x0E82A, 0x0EB3B, 0x0EE45, 0x0F149,
+    0x0F447, 0x0F73E, 0x0FA2F, 0x0FD1B, 0x10000
+};
+
+static const uint32_t exp2_table[LOG2_TABLE_SIZE + 1] =
+{
+    0x10000, 0x102C9, 0x1059B, 0x10874, 0x10B55, 0x10E3E,
+    0x11130, 0x11429, 0x1172B, 0x11A35, 0x11D48, 0x12063,
+    0x12387, 0x126B4, 0x129E9, 0x12D28, 0x1306F, 0x133C0,
+    0x1371A, 0x13A7D, 0x13DEA, 0x14160, 0x144E0, 0x1486A,
+    0x14BFD, 0x14F9B, 0x15342, 0x156F4, 0x15AB0, 0x15E76,
+    0x16247, 0x16623, 0x16A09, 0x16DFA, 0x171F7, 0x175FE,
+    0x17A11, 0x17E2E, 0x18258, 0x1868D, 0x18ACE, 0x18F1A,
+    0x19373, 0x197D7, 0x19C48, 0x1A0C6, 0x1A54F, 0x1A9E6,
+    0x1AE89, 0x1B339, 0x1B7F7, 0x1BCC1, 0x1C199, 0x1C67E,
+    0x1CB71, 0x1D072, 0x1D581, 0x1DA9D, 0x1DFC9, 0x1E502,
+    0x1EA4A, 0x1EFA1, 0x1F506, 0x1FA7B, 0x1FFFF
+};
+#elif (FIXED_POINT_LOG2_TABLE_BITS == 7)
+static const uint32_t log2_table[LOG2_TABLE_SIZE + 1] =
+{
+    0x00000, 0x002E0, 0x005BA, 0x0088F, 0x00B5E, 0x00E27,
+    0x010EC, 0x013AB, 0x01664, 0x01919, 0x01BC9, 0x01E73,
+    0x02119, 0x023BA, 0x02656, 0x028EE, 0x02B80, 0x02E0F,
+    0x03099, 0x0331E, 0x0359F, 0x0381C, 0x03A94, 0x03D08,
+    0x03F78, 0x041E4, 0x0444C, 0x046B0, 0x04910, 0x04B6D,
+    0x04DC5, 0x05019, 0x0526A, 0x054B7, 0x05701, 0x05946,
+    0x05B89, 0x05DC8, 0x06003, 0x0623B, 0x0646F, 0x066A0,
+    0x068CE, 0x06AF9, 0x06D20, 0x06F44, 0x07165, 0x07383,
+    0x0759E, 0x077B5, 0x079CA, 0x07BDC, 0x07DEA, 0x07FF6,
+    0x081FF, 0x08405, 0x08608, 0x08809, 0x08A06, 0x08C01,
+    0x08DFA, 0x08FEF, 0x091E2, 0x093D3, 0x095C0, 0x097AB,
+    0x09994, 0x09B7A, 0x09D5E, 0x09F3F, 0x0A11E, 0x0A2FA,
+    0x0A4D4, 0x0A6AB, 0x0A881, 0x0AA54, 0x0AC24, 0x0ADF3,
+    0x0AFBF, 0x0B188, 0x0B350, 0x0B516, 0x0B6D9, 0x0B89A,
+    0x0BA59, 0x0BC16, 0x0BDD1, 0x0BF8A, 0x0C140, 0x0C2F5,
+    0x0C4A8, 0x0C659, 0x0C807, 0x0C9B4, 0x0CB5F, 0x0CD08,
+    0x0CEAF, 0x0D054, 0x0D1F7, 0x0D399, 0x0D538, 0x0D6D6,
+    0x0D872, 0x0DA0C, 0x0DBA5, 0x0DD3B, 0x0DED0, 0x0E064,
+    0x0E1F5, 0x0E385, 0x0E513, 0x0E69F, 0x0E82A, 0x0E9B3,
+    0x0EB3B, 0x0ECC1, 0x0EE45, 0x0EFC8, 0x0F149, 0x0F2C8,
+    0x0F446, 0x0F5C3, 0x0F73E, 0x0F8B7, 0x0FA2F, 0x0FBA6,
+    0x0FD1B, 0x0FE8E, 0x10000
+};
+
+static const uint32_t exp2_table[LOG2_TABLE_SIZE + 1] =
+{
+    0x10000, 0x10164, 0x102CA, 0x10431, 0x1059B, 0x10707,
+    0x10874, 0x109E4, 0x10B55, 0x10CC9, 0x10E3F, 0x10FB6,
+    0x11130, 0x112AC, 0x1142A, 0x115A9, 0x1172B, 0x118AF,
+    0x11A36, 0x11BBE, 0x11D48, 0x11ED5, 0x12064, 0x121F4,
+    0x12388, 0x1251D, 0x126B4, 0x1284E, 0x129EA, 0x12B88,
+    0x12D28, 0x12ECB, 0x13070, 0x13217, 0x133C0, 0x1356C,
+    0x1371A, 0x138CB, 0x13A7E, 0x13C33, 0x13DEA, 0x13FA4,
+    0x14160, 0x1431F, 0x144E0, 0x146A4, 0x1486A, 0x14A33,
+    0x14BFE, 0x14DCB, 0x14F9B, 0x1516E, 0x15343, 0x1551A,
+    0x156F4, 0x158D1, 0x15AB0, 0x15C92, 0x15E77, 0x1605E,
+    0x16248, 0x16434, 0x16623, 0x16815, 0x16A0A, 0x16C01,
+    0x16DFB, 0x16FF8, 0x171F7, 0x173F9, 0x175FF, 0x17806,
+    0x17A11, 0x17C1F, 0x17E2F, 0x18042, 0x18258, 0x18471,
+    0x1868D, 0x188AC, 0x18ACE, 0x18CF3, 0x18F1B, 0x19146,
+    0x19373, 0x195A4, 0x197D8, 0x19A0F, 0x19C49, 0x19E86,
+    0x1A0C6, 0x1A30A, 0x1A550, 0x1A79A, 0x1A9E7, 0x1AC37,
+    0x1AE8A, 0x1B0E0, 0x1B33A, 0x1B597, 0x1B7F7, 0x1BA5B,
+    0x1BCC2, 0x1BF2C, 0x1C19A, 0x1C40A, 0x1C67F, 0x1C8F7,
+    0x1CB72, 0x1CDF0, 0x1D073, 0x1D2F8, 0x1D581, 0x1D80E,
+    0x1DA9E, 0x1DD32, 0x1DFC9, 0x1E264, 0x1E503, 0x1E7A5,
+    0x1EA4B, 0x1ECF4, 0x1EFA2, 0x1F252, 0x1F507, 0x1F7C0,
+    0x1FA7C, 0x1FD3C, 0x20000
+};
+#else
+#error "FIXED_POINT_LOG2_TABLE_BITS must be in [4, 7]"
+#endif
+
 // =============================================================================
 // Private variables
 // =============================================================================
@@ -71,7 +264,7 @@ q16_16_t q16_16_log(q16_16_t x)
     {
         z = z * z >> 16;
 
-        if (z >= Q16_16_T_ONE << 2)
+        if (z >= Q16_16_T_ONE << 1)
         {
             z >>= 1;
             y += b;
@@ -83,6 +276,393 @@ q16_16_t q16_16_log(q16_16_t x)
     return y;
 }
 
+//
+// The reciprocal is calculated as follows:
+//
+//  1. Normalize d so that d = x * 2^(16 - n) where x is in [0.5, 1) and
+//     is stored as a Q0.32 value X = |d| << n.
+//  2. Look up a seed y0 ~ 1/x in Q2.30 using the 7 bits following the
+//     leading one of X.
+//  3. Refine the seed with two Newton-Raphson iterations,
+//     y = y + y * (1 - x * y), each one doubling the number of correct bits
+//     (2^-8 -> 2^-16 -> 2^-32, limited by the Q2.30 format).
+//
+// Then a / d = a * y * 2^(n - 16), which in q16_16_t becomes
+// (a * Y) >> (46 - n), rounded to nearest, see q16_16_multiply_reciprocal().
+//
+// Accuracy compared to the exact quotient, measured on host over 10^9 random
+// nominators and denominators of every magnitude (results that overflow
+// q16_16_t excluded). The relative error of the Q2.30 reciprocal is at most
+// 2^-30, which adds up to 2 LSB for the largest quotients on top of the
+// rounding, so the max error of q16_16_divide_fast() is bounded by 2.5 LSB:
+//
+//  Function                    | Max error [LSB] | Mean abs error [LSB]
+//  ----------------------------+-----------------+---------------------
+//  q16_16_divide()             |  1.00           |  0.40
+//  q16_16_divide_fast()        |  2.46           |  0.22
+//
+// Dividing by an integer valued denominator such as 1.0, 2.0 or 10.0 was
+// measured to be within 0.67 LSB, and division by 1.0 is exact.
+//
+// Estimated cost on the PIC24 (16x16 hardware multiplier, no hardware 64 bit
+// division). The 64 bit division is done by the compiler's __divdi3 shift and
+// subtract loop, while every 32x32->64 multiplication is four MUL instructions
+// plus carry handling:
+//
+//  Function                    | Estimated cycles
+//  ----------------------------+-----------------
+//  q16_16_divide()             |  ~600 - 900
+//  q16_16_reciprocal()         |  ~150
+//  q16_16_multiply_reciprocal()|  ~40
+//  q16_16_divide_fast()        |  ~190
+//
+q16_16_recip_t q16_16_reciprocal(q16_16_t d)
+{
+    q16_16_recip_t r;
+    uint32_t x;
+    uint32_t y;
+    int32_t e;
+    uint8_t n = 0;
+    uint8_t i;
+
+    r.negative = (d < 0);
+    x = r.negative ? (0 - (uint32_t)d) : (uint32_t)d;
+
+    if (0 == x)
+    {
+        r.mantissa = 0;
+        r.shift = 0;
+
+        return r;
+    }
+
+    //
+    // Normalize x to [0.5, 1)
+    //
+    if (0 == (x & 0xFFFF0000UL))
+    {
+        x <<= 16;
+        n += 16;
+    }
+
+    if (0 == (x & 0xFF000000UL))
+    {
+        x <<= 8;
+        n += 8;
+    }
+
+    if (0 == (x & 0xF0000000UL))
+    {
+        x <<= 4;
+        n += 4;
+    }
+
+    if (0 == (x & 0xC0000000UL))
+    {
+        x <<= 2;
+        n += 2;
+    }
+
+    if (0 == (x & 0x80000000UL))
+    {
+        x <<= 1;
+        n += 1;
+    }
+
+    y = recip_seed[(x >> RECIP_SEED_SHIFT) & RECIP_SEED_MASK];
+
+    for (i = 0; i != 2; ++i)
+    {
+        e = Q2_30_ONE - (int32_t)(((uint64_t)x * y) >> 32);
+        y += (int32_t)(((int64_t)(int32_t)y * e) >> 30);
+    }
+
+    r.mantissa = y;
+    r.shift = 46 - n;
+
+    return r;
+}
+
+//
+// Both functions reduce the argument to one period of a table and do a linear
+// interpolation between two table entries. The interpolation weight is 16
+// bits and the difference between two neighbouring entries fits in 16 bits,
+// so the interpolation is a single 16x16->32 multiplication.
+//
+// Max error measured on host over positive q16_16_t arguments (log2) and
+// every argument below 15.0 (exp2), compared to libm log2() and exp2(). The
+// default size is checked by host/fixed_point_test.c:
+//
+//  FIXED_POINT_LOG2_TABLE_BITS | log2        | exp2, x >= 0 | exp2, x < 0
+//  ----------------------------+-------------+--------------+------------
+//  4 (17 entries)              |  23.46 LSB  |  1.3e-4 rel  |  8.30 LSB
+//  5 (33 entries)              |   6.47 LSB  |  4.1e-5 rel  |  2.70 LSB
+//  6 (65 entries)              |   2.31 LSB  |  1.9e-5 rel  |  1.30 LSB
+//  7 (129 entries)             |   1.30 LSB  |  1.5e-5 rel  |  1.09 LSB
+//
+// Host benchmark with the default table size (x86-64, gcc -O2, ns per call,
+// arguments of every magnitude), from host/fixed_point_test.c:
+//
+//  q16_16_log()        |  ~125
+//  q16_16_log2_fast()  |   ~19
+//  libm log2()         |    ~8
+//  q16_16_exp2_fast()  |    ~4
+//  libm exp2()         |    ~6.5
+//
+// On the PIC24 the gap to q16_16_log() is larger, since its 16 iterations of
+// 32x32 bit multiplication each are replaced by a single 16x16 multiplication.
+//
+q16_16_t q16_16_log2_fast(q16_16_t x)
+{
+    uint32_t u;
+    uint32_t r;
+    uint16_t i;
+    int8_t n = 0;
+
+    if (x <= 0)
+    {
+        return Q16_16_MIN;
+    }
+
+    u = (uint32_t)x;
+
+    //
+    // Normalize x to [1, 2), stored as u = x * 2^31
+    //
+    if (0 == (u & 0xFFFF0000UL))
+    {
+        u <<= 16;
+        n += 16;
+    }
+
+    if (0 == (u & 0xFF000000UL))
+    {
+        u <<= 8;
+        n += 8;
+    }
+
+    if (0 == (u & 0xF0000000UL))
+    {
+        u <<= 4;
+        n += 4;
+    }
+
+    if (0 == (u & 0xC0000000UL))
+    {
+        u <<= 2;
+        n += 2;
+    }
+
+    if (0 == (u & 0x80000000UL))
+    {
+        u <<= 1;
+        n += 1;
+    }
+
+    i = (uint16_t)(u >> (31 - FIXED_POINT_LOG2_TABLE_BITS)) & LOG2_TABLE_MASK;
+    r = (u >> (15 - FIXED_POINT_LOG2_TABLE_BITS)) & 0xFFFF;
+
+    // Interpolate, rounded to nearest
+    r = ((log2_table[i + 1] - log2_table[i]) * r + 0x8000UL) >> 16;
+
+    return int_to_q16_16(15 - n) + (q16_16_t)(log2_table[i] + r);
+}
+
+q16_16_t q16_16_exp2_fast(q16_16_t x)
+{
+    int16_t integer_part = (int16_t)(x >> 16);
+    uint16_t fraction = (uint16_t)x;
+    uint16_t i;
+    uint32_t r;
+    uint32_t y;
+
+    if (integer_part >= 15)
+    {
+        return Q16_16_MAX;
+    }
+    else if (integer_part < -17)
+    {
+        return 0;
+    }
+
+    i = fraction >> (16 - FIXED_POINT_LOG2_TABLE_BITS);
+    r = (uint16_t)(fraction << FIXED_POINT_LOG2_TABLE_BITS);
+
+    // 2^fraction in q16_16_t, the interpolation is rounded to nearest
+    y = exp2_table[i] +
+        (((exp2_table[i + 1] - exp2_table[i]) * r + 0x8000UL) >> 16);
+
+    if (integer_part >= 0)
+    {
+        return (q16_16_t)(y << integer_part);
+    }
+    else
+    {
+        return (q16_16_t)((y + (1UL << (-integer_part - 1))) >> -integer_part);
+    }
+}
+
+uint8_t q16_16_to_str(char * buf, q16_16_t x, uint8_t decimals)
+{
+    uint32_t u;
+    uint16_t integer_part;
+    uint16_t fraction;
+    uint16_t scale;
+    uint8_t len = 0;
+
+    if (decimals > Q16_16_STR_DECIMALS)
+    {
+        decimals = Q16_16_STR_DECIMALS;
+    }
+
+    u = (x < 0) ? (0 - (uint32_t)x) : (uint32_t)x;
+    integer_part = (uint16_t)(u >> 16);
+    scale = decimal_scale[decimals];
+
+    //
+    // Round the fraction to the requested number of decimals, the product
+    // fits in 32 bits since scale <= 10000.
+    //
+    fraction = (uint16_t)((((uint32_t)(uint16_t)u * scale) + 0x8000UL) >> 16);
+
+    if (fraction == scale)
+    {
+        fraction = 0;
+        integer_part++;
+    }
+
+    if ((x < 0) && ((0 != integer_part) || (0 != fraction)))
+    {
+        buf[len++] = '-';
+    }
+
+    len += uint16_to_str(buf + len, integer_part, 1);
+
+    if (0 != decimals)
+    {
+        buf[len++] = '.';
+        len += uint16_to_str(buf + len, fraction, decimals);
+    }
+
+    return len;
+}
+
+bool str_to_q16_16(const char * str, q16_16_t * x, const char ** end)
+{
+    char digits[STR_MAX_FRACTION_DIGITS];
+    uint32_t integer_part = 0;
+    uint32_t fraction = 0;
+    uint8_t nbr_of_digits = 0;
+    uint8_t nbr_of_fraction_digits = 0;
+    uint32_t magnitude;
+    bool negative = false;
+
+    if (('-' == *str) || ('+' == *str))
+    {
+        negative = ('-' == *str);
+        str++;
+    }
+
+    while (('0' <= *str) && (*str <= '9'))
+    {
+        if (integer_part <= INT16_MAX)
+        {
+            integer_part = integer_part * 10 + (*str - '0');
+        }
+
+        str++;
+        nbr_of_digits++;
+    }
+
+    if ('.' == *str)
+    {
+        str++;
+
+        while (('0' <= *str) && (*str <= '9'))
+        {
+            if (nbr_of_fraction_digits != STR_MAX_FRACTION_DIGITS)
+            {
+                digits[nbr_of_fraction_digits++] = *str - '0';
+            }
+
+            str++;
+            nbr_of_digits++;
+        }
+    }
+
+    if (NULL != end)
+    {
+        *end = str;
+    }
+
+    if (0 == nbr_of_digits)
+    {
+        return false;
+    }
+
+    //
+    // Evaluate the fraction from the last digit, f = (f + d) / 10, with
+    // 8 guard bits so that only the final rounding loses precision.
+    // Each step is a 32/16 bit division which the PIC24 does in hardware.
+    //
+    while (0 != nbr_of_fraction_digits)
+    {
+        nbr_of_fraction_digits--;
+        fraction = (fraction + ((uint32_t)digits[nbr_of_fraction_digits] << 24))
+                   / 10;
+    }
+
+    fraction = (fraction + 0x80) >> 8;
+
+    if (integer_part > 0x8000UL)
+    {
+        integer_part = 0x8000UL;
+    }
+
+    magnitude = (integer_part << 16) + fraction;
+
+    if (negative)
+    {
+        *x = (magnitude >= 0x80000000UL) ?
+                Q16_16_MIN : (q16_16_t)(0 - magnitude);
+    }
+    else
+    {
+        *x = (magnitude >= 0x80000000UL) ?
+                Q16_16_MAX : (q16_16_t)magnitude;
+    }
+
+    return true;
+}
+
+uint8_t uint16_to_str(char * buf, uint16_t value, uint8_t width)
+{
+    char tmp[5];
+    uint8_t n = 0;
+    uint8_t len = 0;
+
+    do
+    {
+        tmp[n++] = '0' + (value % 10);
+        value /= 10;
+    } while (0 != value);
+
+    while (width > n)
+    {
+        buf[len++] = '0';
+        width--;
+    }
+
+    while (0 != n)
+    {
+        buf[len++] = tmp[--n];
+    }
+
+    buf[len] = '\0';
+
+    return len;
+}
+
 // =============================================================================
 // Private function definitions
 // =============================================================================
@@ -20,6 +20,7 @@ extern "C" {
 // Include statements
 // =============================================================================
 #include <stdint.h>
+#include <stdbool.h>
 #include <limits.h>
 
 // =============================================================================
@@ -33,6 +34,33 @@ extern "C" {
 //
 typedef int32_t q16_16_t;
 
+// Reciprocal of a q16_16_t value stored in normalized form,
+// 1/d = mantissa * 2^-shift, see q16_16_reciprocal().
+// Used when the same denominator is divided by more than once, so that the
+// expensive part of the division only has to be done once.
+//
+typedef struct q16_16_recip_t
+{
+    uint32_t mantissa;  // 1/x for the normalized x in [0.5, 1), in Q2.30
+    uint8_t shift;      // Right shift to apply to the product a * mantissa,
+                        // 0 if the denominator was zero
+    bool negative;      // True if the denominator was negative
+} q16_16_recip_t;
+
+// Additional 16 bit formats. They are used where the range of q16_16_t is not
+// needed, since the product of two 16 bit values is a single 16x16->32
+// hardware multiplication on the PIC24, while a q16_16_t product needs four.
+//
+//  Format  | Range         | Resolution | Typical use
+//  --------+---------------+------------+-------------------------------
+//  q1_15_t | [-1, 1)       | 2^-15      | Gains and filter factors
+//  q2_14_t | [-2, 2)       | 2^-14      | Model coefficients
+//  q8_8_t  | [-128, 128)   | 2^-8       | Temperature differences
+//
+typedef int16_t q1_15_t;
+typedef int16_t q2_14_t;
+typedef int16_t q8_8_t;
+
 // =============================================================================
 // Global constatants
 // =============================================================================
@@ -40,6 +68,31 @@ typedef int32_t q16_16_t;
 #define Q16_16_MAX      (INT32_MAX)
 #define Q16_16_MIN      (INT32_MIN)
 
+#define Q1_15_MAX       (INT16_MAX)
+#define Q1_15_MIN       (INT16_MIN)
+#define Q2_14_T_ONE     (0x4000)
+#define Q2_14_MAX       (INT16_MAX)
+#define Q2_14_MIN       (INT16_MIN)
+#define Q8_8_T_ONE      (0x0100)
+#define Q8_8_MAX        (INT16_MAX)
+#define Q8_8_MIN        (INT16_MIN)
+
+// Max number of decimals written by q16_16_to_str(), and the number of
+// decimals used when printing parameters. Four decimals is the most that
+// can be represented by the 16 fractional bits.
+#define Q16_16_STR_DECIMALS     (4)
+
+// Buffer size needed by q16_16_to_str(): sign, 5 integer digits, decimal
+// point, decimals and the null terminator.
+#define Q16_16_STR_MAX_LEN      (1 + 5 + 1 + Q16_16_STR_DECIMALS + 1)
+
+// Number of table entries, 2^FIXED_POINT_LOG2_TABLE_BITS, used by
+// q16_16_log2_fast() and q16_16_exp2_fast(). Allowed values are 4 to 7,
+// see fixed_point.c for the accuracy of each size.
+#ifndef FIXED_POINT_LOG2_TABLE_BITS
+#define FIXED_POINT_LOG2_TABLE_BITS 6
+#endif
+
 // =============================================================================
 // Global variable declarations
 // =============================================================================
@@ -50,13 +103,66 @@ typedef int32_t q16_16_t;
 
 /**
  * @brief Calculates the base 2 logarithm of x.
+ * @details Max error 3.61 LSB over all positive x.
  * @param x - function parameter.
  * @return base 2 logarithm of x.
  */
 q16_16_t q16_16_log(q16_16_t x);
 
+/**
+ * @brief Calculates the base 2 logarithm of x using table lookup and linear
+ * interpolation.
+ * @details Much faster than q16_16_log() but less accurate, see
+ * fixed_point.c for the max error.
+ * @param x - function parameter.
+ * @return base 2 logarithm of x, or Q16_16_MIN if x <= 0.
+ */
+q16_16_t q16_16_log2_fast(q16_16_t x);
+
+/**
+ * @brief Calculates 2 to the power of x using table lookup and linear
+ * interpolation.
+ * @param x - function parameter.
+ * @return 2^x, saturated to Q16_16_MAX for x >= 15.
+ */
+q16_16_t q16_16_exp2_fast(q16_16_t x);
+
+/**
+ * @brief Writes x as a decimal string without using floating point.
+ * @details The value is rounded to the nearest representable decimal.
+ * @param buf - Destination, must hold at least Q16_16_STR_MAX_LEN chars.
+ * @param x - The value to write.
+ * @param decimals - Number of decimals, at most Q16_16_STR_DECIMALS.
+ * 0 gives no decimal point.
+ * @return The number of chars written, excluding the null terminator.
+ */
+uint8_t q16_16_to_str(char * buf, q16_16_t x, uint8_t decimals);
+
+/**
+ * @brief Parses a decimal number such as "-12.375" without using floating
+ * point.
+ * @details Integer parts out of the q16_16_t range are saturated, the
+ * fractional part is rounded to the nearest q16_16_t value.
+ * @param str - The string to parse.
+ * @param x - Where to store the result.
+ * @param end - Set to the first char after the number, unless NULL.
+ * @return True if at least one digit was found.
+ */
+bool str_to_q16_16(const char * str, q16_16_t * x, const char ** end);
+
+/**
+ * @brief Writes an unsigned integer as a zero padded decimal string.
+ * @param buf - Destination, must hold at least max(width, 5) + 1 chars.
+ * @param value - The value to write.
+ * @param width - Minimum number of digits.
+ * @return The number of chars written, excluding the null terminator.
+ */
+uint8_t uint16_to_str(char * buf, uint16_t value, uint8_t width);
+
 /**
  * @brief Calculates the product of two q16_16_t numbers.
+ * @details The result is rounded towards minus infinity, so the max error is
+ * 1 LSB. Products outside the q16_16_t range wrap around.
  * @param a - The first q16_16_t factor.
  * @param b - The second q16_16_t factor.
  * @return The product of a * b
@@ -72,6 +178,8 @@ static inline q16_16_t q16_16_multiply(q16_16_t a, q16_16_t b)
 
 /**
  * @brief Calculates the quotient of two q16_16_t numbers.
+ * @details The result is rounded towards zero, so the max error is 1 LSB.
+ * Quotients outside the q16_16_t range wrap around.
  * @param a - The nominator.
  * @param b - The denominator.
  * @return The quotient a / b
@@ -87,58 +195,127 @@ static inline q16_16_t q16_16_divide(q16_16_t a, q16_16_t b)
 }
 
 /**
- * @brief The number of stepps in t rounded down.
- * @param t - the time to round down.
- * @return The number of floored number of stepps in t.
+ * @brief Calculates the reciprocal 1/d without any division.
+ * @details The reciprocal is found by normalizing d to [0.5, 1), looking up a
+ * seed in a small table and refining it with two Newton-Raphson iterations.
+ * A denominator of zero gives a reciprocal which saturates every nonzero
+ * quotient, see q16_16_multiply_reciprocal().
+ * @param d - The denominator to invert.
+ * @return The reciprocal of d, to be used with q16_16_multiply_reciprocal().
+ */
+q16_16_recip_t q16_16_reciprocal(q16_16_t d);
+
+/**
+ * @brief Calculates a / d where d is given as a precalculated reciprocal.
+ * @details Quotients outside the q16_16_t range, and nonzero nominators
+ * divided by zero, saturate to Q16_16_MAX or Q16_16_MIN. 0 / 0 gives 0.
+ * @param a - The nominator.
+ * @param r - The reciprocal of the denominator, from q16_16_reciprocal().
+ * @return The quotient a / d
  */
-static inline int16_t q16_16_floor(q16_16_t t)
+static inline q16_16_t q16_16_multiply_reciprocal(q16_16_t a, q16_16_recip_t r)
 {
-    if (t >= 0)
+    int64_t p;
+
+    if (0 == r.shift)
     {
-        return t & 0xFFFF0000;
+        p = a;
     }
     else
     {
-        return (t & 0xFFFF0000) - Q16_16_T_ONE;
+        p = (int64_t)a * (int64_t)r.mantissa;
+        p = (p + ((int64_t)1 << (r.shift - 1))) >> r.shift;
+    }
+
+    if (r.negative)
+    {
+        p = -p;
+    }
+
+    if ((p > Q16_16_MAX) || ((0 == r.shift) && (p > 0)))
+    {
+        return Q16_16_MAX;
     }
+    else if ((p < Q16_16_MIN) || ((0 == r.shift) && (p < 0)))
+    {
+        return Q16_16_MIN;
+    }
+    else
+    {
+        return (q16_16_t)p;
+    }
+}
+
+/**
+ * @brief Calculates the quotient of two q16_16_t numbers without using a
+ * 64 bit division.
+ * @details Faster than q16_16_divide() but may differ from it by a few
+ * least significant bits, see fixed_point.c.
+ * @param a - The nominator.
+ * @param b - The denominator.
+ * @return The quotient a / b
+ */
+static inline q16_16_t q16_16_divide_fast(q16_16_t a, q16_16_t b)
+{
+    return q16_16_multiply_reciprocal(a, q16_16_reciprocal(b));
+}
+
+#define INT_TO_Q16_16(i) ((int32_t)(i) << 16)
+
+/**
+ * @brief Rounds t down to the nearest integer, towards minus infinity.
+ * @details Exact for every input.
+ * @param t - The value to round down.
+ * @return The largest integer valued q16_16_t which is <= t.
+ */
+static inline q16_16_t q16_16_floor(q16_16_t t)
+{
+    return t & (q16_16_t)0xFFFF0000UL;
 }
 
 /**
- * @brief The number of stepps in t rounded up.
- * @param t - The time to round up.
- * @return The number of stepps in t rounded up.
+ * @brief Rounds t up to the nearest integer, towards plus infinity.
+ * @details Exact for every input except t > 32767.0, which saturates to
+ * 32767.0 since 32768.0 can not be represented.
+ * @param t - The value to round up.
+ * @return The smallest integer valued q16_16_t which is >= t.
  */
-static inline uint16_t q16_16_ceil(q16_16_t t)
+static inline q16_16_t q16_16_ceil(q16_16_t t)
 {
-    if (t >= 0)
+    if (0 == (t & 0x0000FFFF))
     {
-        return (t & 0xFFFF0000) + Q16_16_T_ONE;
+        return t;
+    }
+    else if (t > INT_TO_Q16_16(INT16_MAX))
+    {
+        return INT_TO_Q16_16(INT16_MAX);
     }
     else
     {
-        return t & 0xFFFF0000;
+        return (t | 0x0000FFFF) + 1;
     }
 }
 
 /**
- * @brief The number of stepps in t rounded to the nearest integer.
- * @param t - The time to round.
- * @return The number of stepps in t rounded to the nearest integer.
+ * @brief Rounds t to the nearest integer, halfway cases are rounded up
+ * towards plus infinity.
+ * @details Exact for every input except t >= 32767.5, which saturates to
+ * 32767.0.
+ * @param t - The value to round.
+ * @return The integer valued q16_16_t nearest to t.
  */
 static inline q16_16_t q16_16_round(q16_16_t t)
 {
-    if ((t & 0x0000FFFF) < (UINT16_MAX >> 1))
+    if (t >= INT_TO_Q16_16(INT16_MAX) + (Q16_16_T_ONE >> 1))
     {
-        return t & 0xFFFF0000;
+        return INT_TO_Q16_16(INT16_MAX);
     }
     else
     {
-        return (t & 0xFFFF0000) + Q16_16_T_ONE;
+        return q16_16_floor(t + (Q16_16_T_ONE >> 1));
     }
 }
 
-#define INT_TO_Q16_16(i) ((int32_t)i << 16)
-
 /**
  * @brief Converts an integer to the q16_16_t.
  * @param i - The integer to convert.
@@ -149,6 +326,11 @@ static inline q16_16_t int_to_q16_16(int16_t i)
     return ((int32_t)i) << 16;
 }
 
+/**
+ * @brief Converts a q16_16_t to the nearest integer, see q16_16_round().
+ * @param t - The value to convert.
+ * @return t rounded to the nearest integer.
+ */
 static inline int16_t q16_16_to_int(q16_16_t t)
 {
     return (int16_t)(q16_16_round(t) >> 16);
@@ -176,6 +358,202 @@ static inline double q16_16_to_double(q16_16_t x)
     return ((double)x) / ((double)65536UL);
 }
 
+//
+// Rounded compile time conversions of constants to the 16 bit formats.
+//
+#define DOUBLE_TO_Q1_15(d) ((q1_15_t)((d) * 32768.0 + ((d) < 0 ? -0.5 : 0.5)))
+#define DOUBLE_TO_Q2_14(d) ((q2_14_t)((d) * 16384.0 + ((d) < 0 ? -0.5 : 0.5)))
+#define DOUBLE_TO_Q8_8(d)  ((q8_8_t)((d) * 256.0 + ((d) < 0 ? -0.5 : 0.5)))
+
+/**
+ * @brief Saturates a value to the range of the 16 bit formats.
+ * @param x - Value to saturate.
+ * @return x limited to [INT16_MIN, INT16_MAX].
+ */
+static inline int16_t fixed_point_saturate_16(int32_t x)
+{
+    if (x > INT16_MAX)
+    {
+        return INT16_MAX;
+    }
+    else if (x < INT16_MIN)
+    {
+        return INT16_MIN;
+    }
+    else
+    {
+        return (int16_t)x;
+    }
+}
+
+/**
+ * @brief Converts a q16_16_t to a q1_15_t, rounded to nearest and saturated.
+ * @param x - The q16_16_t to convert.
+ * @return The q1_15_t representation of x.
+ */
+static inline q1_15_t q16_16_to_q1_15(q16_16_t x)
+{
+    if (x >= Q16_16_MAX - 1)
+    {
+        return Q1_15_MAX;
+    }
+
+    return fixed_point_saturate_16((x + 1) >> 1);
+}
+
+/**
+ * @brief Converts a q16_16_t to a q2_14_t, rounded to nearest and saturated.
+ * @param x - The q16_16_t to convert.
+ * @return The q2_14_t representation of x.
+ */
+static inline q2_14_t q16_16_to_q2_14(q16_16_t x)
+{
+    if (x >= Q16_16_MAX - 2)
+    {
+        return Q2_14_MAX;
+    }
+
+    return fixed_point_saturate_16((x + 2) >> 2);
+}
+
+/**
+ * @brief Converts a q16_16_t to a q8_8_t, rounded to nearest and saturated.
+ * @param x - The q16_16_t to convert.
+ * @return The q8_8_t representation of x.
+ */
+static inline q8_8_t q16_16_to_q8_8(q16_16_t x)
+{
+    if (x >= Q16_16_MAX - 0x80)
+    {
+        return Q8_8_MAX;
+    }
+
+    return fixed_point_saturate_16((x + 0x80) >> 8);
+}
+
+/**
+ * @brief Converts a q1_15_t to a q16_16_t, this conversion is exact.
+ * @param a - The q1_15_t to convert.
+ * @return The q16_16_t representation of a.
+ */
+static inline q16_16_t q1_15_to_q16_16(q1_15_t a)
+{
+    return ((q16_16_t)a) * 2;
+}
+
+/**
+ * @brief Converts a q2_14_t to a q16_16_t, this conversion is exact.
+ * @param a - The q2_14_t to convert.
+ * @return The q16_16_t representation of a.
+ */
+static inline q16_16_t q2_14_to_q16_16(q2_14_t a)
+{
+    return ((q16_16_t)a) * 4;
+}
+
+/**
+ * @brief Converts a q8_8_t to a q16_16_t, this conversion is exact.
+ * @param a - The q8_8_t to convert.
+ * @return The q16_16_t representation of a.
+ */
+static inline q16_16_t q8_8_to_q16_16(q8_8_t a)
+{
+    return ((q16_16_t)a) * 256;
+}
+
+/**
+ * @brief Calculates the product of two q1_15_t numbers.
+ * @details -1 * -1 is saturated to the largest q1_15_t value.
+ * @param a - The first factor.
+ * @param b - The second factor.
+ * @return The product a * b
+ */
+static inline q1_15_t q1_15_multiply(q1_15_t a, q1_15_t b)
+{
+    return fixed_point_saturate_16(((int32_t)a * (int32_t)b) >> 15);
+}
+
+/**
+ * @brief Calculates the product of two q2_14_t numbers.
+ * @param a - The first factor.
+ * @param b - The second factor.
+ * @return The product a * b, saturated.
+ */
+static inline q2_14_t q2_14_multiply(q2_14_t a, q2_14_t b)
+{
+    return fixed_point_saturate_16(((int32_t)a * (int32_t)b) >> 14);
+}
+
+/**
+ * @brief Calculates the product of two q8_8_t numbers.
+ * @param a - The first factor.
+ * @param b - The second factor.
+ * @return The product a * b, saturated.
+ */
+static inline q8_8_t q8_8_multiply(q8_8_t a, q8_8_t b)
+{
+    return fixed_point_saturate_16(((int32_t)a * (int32_t)b) >> 8);
+}
+
+/**
+ * @brief Scales a q8_8_t value with a q1_15_t factor.
+ * @details -128 * -1 is saturated to the largest q8_8_t value.
+ * @param a - The q8_8_t factor.
+ * @param b - The q1_15_t factor.
+ * @return The product a * b as a q8_8_t.
+ */
+static inline q8_8_t q8_8_multiply_q1_15(q8_8_t a, q1_15_t b)
+{
+    return fixed_point_saturate_16(((int32_t)a * (int32_t)b) >> 15);
+}
+
+/**
+ * @brief Multiplies a q8_8_t value with a q2_14_t factor.
+ * @details Every product fits in a q16_16_t, so it never saturates. It is
+ * rounded towards minus infinity, so the max error is 1 LSB.
+ * @param a - The q8_8_t factor.
+ * @param b - The q2_14_t factor.
+ * @return The product a * b as a q16_16_t.
+ */
+static inline q16_16_t q8_8_multiply_q2_14(q8_8_t a, q2_14_t b)
+{
+    return ((int32_t)a * (int32_t)b) >> 6;
+}
+
+/**
+ * @brief Multiplies a q16_16_t value with a q2_14_t factor.
+ * @details The 32 bit factor is split in two halves so that the product is
+ * formed by two 16x16->32 multiplications instead of a 32x32->64
+ * multiplication. The result is bit exact compared to
+ * q16_16_multiply(a, q2_14_to_q16_16(b)).
+ * @param a - The q16_16_t factor.
+ * @param b - The q2_14_t factor.
+ * @return The product a * b
+ */
+static inline q16_16_t q16_16_multiply_q2_14(q16_16_t a, q2_14_t b)
+{
+    int32_t high = (int32_t)(int16_t)(a >> 16) * (int32_t)b;
+    int32_t low  = (int32_t)(uint16_t)a * (int32_t)b;
+
+    return high * 4 + (low >> 14);
+}
+
+/**
+ * @brief Multiplies a q16_16_t value with a q1_15_t factor.
+ * @details See q16_16_multiply_q2_14(). The result is bit exact compared to
+ * q16_16_multiply(a, q1_15_to_q16_16(b)).
+ * @param a - The q16_16_t factor.
+ * @param b - The q1_15_t factor.
+ * @return The product a * b
+ */
+static inline q16_16_t q16_16_multiply_q1_15(q16_16_t a, q1_15_t b)
+{
+    int32_t high = (int32_t)(int16_t)(a >> 16) * (int32_t)b;
+    int32_t low  = (int32_t)(uint16_t)a * (int32_t)b;
+
+    return high * 2 + (low >> 15);
+}
+
 #ifdef	__cplusplus
 }
 #endif
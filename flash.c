@@ -13,13 +13,49 @@
  *    -------------------------------------------------------------
  *             BIT0    -    BIT15                  BIT16 -  BIT23
  *
+ * All reads and writes go to a RAM copy of the data memory, the write buffer.
+ * Changed rows are tracked, and flash_write_buffer_to_flash() only commits
+ * the changes. The main loop commits requested writes when no reflow program
+ * is running, see flash_request_commit().
  *
- * References:
- * Document number: DS30009715C, PIC24F Flash Program Memory
- * Document number: DS39715A, Section 4. Program Memory
- * Document number: DS39747D, PIC24FJ128GA010 Family Data Sheet
- * Document number: DS51284F, MPLAB C30 C COMPILER USER?S GUIDE
- * 
+ * Changes to the parameter area, the first FLASH_LOG_AREA_SIZE bytes, are
+ * committed through an append-only log kept in NVM_LOG_BLOCKS separate erase
+ * blocks. Each log record is one instruction, written with a single word
+ * program operation, which holds the new value of one data word:
+ *
+ *    -------------------------------------------------------------
+ *   |             New value                  |  Data word index   |
+ *    -------------------------------------------------------------
+ *             BIT0    -    BIT15                  BIT16 -  BIT23
+ *
+ * An erased instruction (0xFFFFFF) ends the log. A RAM index holds the newest
+ * record of each data word, so the log never has to be searched. When the
+ * log would overflow, or when another area has changed, the whole write
+ * buffer is programmed to a data block and the log is erased.
+ *
+ * There are NVM_DATA_BLOCKS = 2 data blocks. The newest valid one is in use,
+ * and a full commit programs the other one with the next sequence number.
+ * Only when that block reads back with a valid CRC it is switched to and the
+ * log is erased, so a reset during the erase or the row programs leaves the
+ * block in use and its log untouched.
+ *
+ * The data memory has a header at FLASH_INDEX_SEQUENCE, which holds the
+ * sequence number of the data block, HEADER_VERSION and a CRC-16 of all
+ * other bytes of the data memory. The CRC
+ * word is the last word of the parameter area, and a log record of it is the
+ * commit record: a logged commit appends the changed words and then always
+ * the new CRC. Records after the last commit record are left by an
+ * interrupted commit and are ignored, so a commit is either applied or lost.
+ *
+ * A data block is programmed with the CRC of its own contents, and both are
+ * checked on their own at start up. A log which does not give the CRC of its
+ * last commit record when applied to the data block in use, as after a reset
+ * between switching the data block and erasing the log, is ignored. Only if
+ * neither data block is valid, as on a blank device, flash_init() falls back
+ * to the defaults.
+ *
+ * The program memory operations are done through nvm.h, so the same code
+ * can run on a host build against a file backed emulator.
  */
 
 
@@ -31,10 +67,13 @@
 #include "flash.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
-#include <xc.h>
+#include "crc.h"
 #include "fixed_point.h"
+#include "nvm.h"
+#include "profile.h"
 
 // =============================================================================
 // Private type definitions
@@ -48,10 +87,32 @@
 // Private constants
 // =============================================================================
 
-#define INSTRUCTIONS_PER_ROW            64
-#define ROWS_PER_ERASE_BLOCK            8
-#define INSTRUCTIONS_PER_ERASE_BLOCK    512
-#define WORDS_PER_ERASE_BLOCK           (INSTRUCTIONS_PER_ERASE_BLOCK * 2)
+#define FLASH_LOG_SLOTS                 (NVM_LOG_BLOCKS *                      \
+                                         NVM_INSTRUCTIONS_PER_ERASE_BLOCK)
+
+// Bytes of data memory per flash row, and the dirty_rows bit of a byte index
+#define BYTES_PER_ROW                   (NVM_INSTRUCTIONS_PER_ROW * 2)
+#define ROW_BIT(index)                  (1 << ((uint16_t)(index) / BYTES_PER_ROW))
+#define LOG_AREA_ROWS                   ((1 << (FLASH_LOG_AREA_SIZE /          \
+                                                BYTES_PER_ROW)) - 1)
+
+// Upper byte of an erased instruction, ends the log
+#define LOG_RECORD_EMPTY                0xFF
+
+// Data word index of the CRC, a log record of it ends a commit
+#define CRC_WORD                        (FLASH_INDEX_CRC / 2)
+
+// Instruction of a data word within the data region
+#define DATA_INSTR(block, word_index)   ((block) *                             \
+                                         NVM_INSTRUCTIONS_PER_ERASE_BLOCK +     \
+                                         (word_index))
+
+// Magic in the MSB and layout version in the LSB. Increase the version when
+// the layout changes, the stored data is then replaced by the defaults.
+#define HEADER_VERSION                  0xA502
+
+#define DEFAULT_SERVO_FACTOR            DOUBLE_TO_Q16_16(1200.0/50.0)
+#define DEFAULT_FILTER_LEN              16
 
 // =============================================================================
 // Private variables
@@ -59,51 +120,114 @@
 
 static volatile uint8_t buffer[FLASH_MEM_SIZE];
 
-const uint16_t flash_data[WORDS_PER_ERASE_BLOCK] __attribute__((space(prog),aligned(WORDS_PER_ERASE_BLOCK))) =
-{
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0000
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0008
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0010
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0018
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0020
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0028
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0030
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0038
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0040
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0048
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0050
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0058
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0060
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0068
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0070
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0078
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0080
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0088
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0090
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0098
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00A0
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00A8
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00B0
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00B8
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00C0
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00C8
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00D0
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00D8
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00E0
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00E8
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00F0
-    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000     // 0x00F8
-};
+// The data block in use, the newest valid one
+static uint16_t data_block = 0;
+
+// log_index[i] is the log slot + 1 of the newest record of data word i, or 0
+// if the word is only stored in the data block.
+static uint16_t log_index[FLASH_LOG_AREA_SIZE / 2];
+
+// Next free slot in the log
+static uint16_t log_next_slot = 0;
+
+// Rows of the write buffer which differ from the flash memory, see ROW_BIT()
+static uint8_t dirty_rows = 0;
+static bool commit_requested = false;
+
+// True if the header matched the contents when the buffer was loaded
+static bool buffer_valid = false;
 
 // =============================================================================
 // Private function declarations
 // =============================================================================
 
+/**
+ * @brief Checks the version and the CRC of a data block, without the log.
+ * @param block - The data block.
+ * @return True if the data block is valid.
+ */
+static bool data_block_is_valid(uint16_t block);
+
+/**
+ * @brief Selects the valid data block with the newest sequence number.
+ * @return False if neither data block is valid.
+ */
+static bool select_data_block(void);
+
+/**
+ * @brief Builds the RAM index from the records up to the last commit record,
+ * and finds the first empty slot.
+ * @return True if there are records after the last commit record.
+ */
+static bool log_scan(void);
+
+/**
+ * @brief Counts the words of the parameter area which a logged commit would
+ * append, the commit record not included.
+ * @return Number of records.
+ */
+static uint16_t log_count_changes(void);
+
+/**
+ * @brief Appends one record to the log if the word has changed.
+ * @param word_index - Index of the data word, < FLASH_LOG_AREA_SIZE / 2.
+ * @param data - The new value of the data word.
+ */
+static void log_append(uint16_t word_index, uint16_t data);
+
+/**
+ * @brief Appends the commit record, which holds the CRC of the write buffer.
+ */
+static void log_append_commit(void);
+
+/**
+ * @brief Erases all log blocks which have been written to, and clears the
+ * RAM index.
+ */
+static void log_erase(void);
+
+/**
+ * @brief Reads one data word from the data block or the log.
+ * @param word_index - Index of the data word.
+ * @return The data word.
+ */
+static uint16_t read_data_word(uint16_t word_index);
+
+/**
+ * @brief Programs the data block not in use with the write buffer and the
+ * next sequence number. If it validates, it is switched to and the log is
+ * erased.
+ * @return False if the programmed block did not validate, the block in use
+ * and the log are then kept.
+ */
+static bool write_data_block(void);
 
 /**
- * @brief Erases the address page used for data.
+ * @brief Reads one data word from the write buffer.
+ * @param word_index - Index of the data word.
+ * @return The data word.
  */
-static void erase_flash_data(void);
+static uint16_t buffer_word(uint16_t word_index);
+
+/**
+ * @brief Adds one data word to the CRC of the data memory.
+ * @param crc - The CRC so far.
+ * @param word_index - Index of the data word, the CRC word is skipped.
+ * @param data - The data word.
+ * @return The updated CRC.
+ */
+static uint16_t crc_add_word(uint16_t crc, uint16_t word_index, uint16_t data);
+
+/**
+ * @brief Calculates the CRC of the write buffer.
+ * @return The CRC.
+ */
+static uint16_t buffer_crc(void);
+
+/**
+ * @brief Replaces the whole write buffer with the default data.
+ */
+static void write_defaults_to_buffer(void);
 
 // =============================================================================
 // Public function definitions
@@ -111,276 +235,433 @@ static void erase_flash_data(void);
 
 void flash_init(void)
 {
-    if (0 == flash_read_word(FLASH_INDEX_LEAD_FREE_TEMP_CURVE_SIZE))
+    bool data_valid = select_data_block();
+    bool uncommitted = log_scan();
+
+    flash_init_write_buffer();
+
+    if (!data_valid)
     {
-        uint16_t index;
-        uint16_t i;
-        uint16_t temp[] = {25, 100, 150, 170, 200, 240, 250, 250, 75};
-        uint16_t time[] = {0 , 30 , 60,  90 , 120, 150, 160, 190, 240};
-        uint16_t nbr_of_data_point = sizeof(time) / sizeof(uint16_t);
-        
+        // Nothing to fall back on, as on a blank device
+        write_defaults_to_buffer();
+        flash_write_buffer_to_flash();
+    }
+    else if (!buffer_valid)
+    {
+        // The log does not belong to the data block, use the data block only
+        log_erase();
         flash_init_write_buffer();
+    }
+    else if (uncommitted)
+    {
+        // New records can not be appended after the ignored ones, so move
+        // the committed values to the data block, which erases the log
+        write_data_block();
+    }
+}
+
+uint8_t flash_read_byte(flash_index_t index)
+{
+    return buffer[index];
+}
 
-        flash_write_word_to_buffer(FLASH_INDEX_LEAD_FREE_TEMP_CURVE_SIZE,
-                                   nbr_of_data_point);
+uint16_t flash_read_word(flash_index_t index)
+{
+    return ((uint16_t)buffer[index] << 8) | buffer[index + 1];
+}
 
-        flash_write_word_to_buffer(FLASH_INDEX_LEAD_FREE_SOAK_START_SEC, 60);
-        flash_write_word_to_buffer(FLASH_INDEX_LEAD_FREE_REFLOW_START_SEC, 140);
-        flash_write_word_to_buffer(FLASH_INDEX_LEAD_FREE_COOL_START_SEC, 200);
+uint32_t flash_read_dword(flash_index_t index)
+{
+    uint32_t dword = 0x00000000;
 
-        index = FLASH_INDEX_LEAD_FREE_TEMP_CURVE_START;
+    dword |= ((uint32_t)flash_read_word(index) << 16) & (uint32_t)0xFFFF0000;
+    dword |=  (uint32_t)flash_read_word(index + 2)    & (uint32_t)0x0000FFFF;
 
-        for (i = 0; i != nbr_of_data_point; ++i)
+    return dword;
+}
+
+void flash_write_byte(flash_index_t index, uint8_t data)
+{
+    flash_write_byte_to_buffer(index, data);
+    flash_request_commit();
+}
+
+void flash_write_word(flash_index_t index, uint16_t data)
+{
+    flash_write_word_to_buffer(index, data);
+    flash_request_commit();
+}
+
+void flash_write_dword(flash_index_t index, uint32_t data)
+{
+    flash_write_dword_to_buffer(index, data);
+    flash_request_commit();
+}
+
+void flash_init_write_buffer(void)
+{
+    uint16_t crc = CRC16_INIT;
+    uint16_t i;
+
+    for (i = 0; i != FLASH_MEM_SIZE / 2; ++i)
+    {
+        uint16_t d = read_data_word(i);
+        buffer[2 * i] = d >> 8;
+        buffer[2 * i + 1] = d;
+
+        crc = crc_add_word(crc, i, d);
+    }
+
+    buffer_valid = (HEADER_VERSION == buffer_word(FLASH_INDEX_VERSION / 2)) &&
+                   (crc == buffer_word(FLASH_INDEX_CRC / 2));
+
+    dirty_rows = 0;
+    commit_requested = false;
+}
+
+void flash_write_byte_to_buffer(flash_index_t index, uint8_t data)
+{
+    if (buffer[index] != data)
+    {
+        buffer[index] = data;
+        dirty_rows |= ROW_BIT(index);
+    }
+}
+
+void flash_write_word_to_buffer(flash_index_t index, uint16_t data)
+{
+    flash_write_byte_to_buffer(index,     (uint8_t)((data >> 8) & 0xFF));
+    flash_write_byte_to_buffer(index + 1, (uint8_t)( data       & 0xFF));
+}
+
+void flash_write_dword_to_buffer(flash_index_t index, uint32_t data)
+{
+    flash_write_byte_to_buffer(index,     (uint8_t)((data >> 24) & 0xFF));
+    flash_write_byte_to_buffer(index + 1, (uint8_t)((data >> 16) & 0xFF));
+    flash_write_byte_to_buffer(index + 2, (uint8_t)((data >> 8 ) & 0xFF));
+    flash_write_byte_to_buffer(index + 3, (uint8_t)( data        & 0xFF));
+}
+
+void flash_write_buffer_to_flash(void)
+{
+    uint16_t i;
+
+    if (0 == dirty_rows)
+    {
+        commit_requested = false;
+        return;
+    }
+
+    flash_write_word_to_buffer(FLASH_INDEX_CRC, buffer_crc());
+
+    if (dirty_rows & ~LOG_AREA_ROWS)
+    {
+        if (!write_data_block())
         {
-            flash_write_dword_to_buffer(index, int_to_q16_16(temp[i]));
-            index += 4;
-            flash_write_word_to_buffer(index, time[i]);
-            index += 2;
+            // Still differs from the flash memory, see
+            // flash_get_nbr_of_pending_writes()
+            commit_requested = false;
+            return;
         }
+    }
+    else
+    {
+        uint16_t nbr_of_records = log_count_changes();
 
-        flash_write_buffer_to_flash();
+        if (0 == nbr_of_records)
+        {
+            // Rewritten with the same values
+        }
+        else if (log_next_slot + nbr_of_records + 1 > FLASH_LOG_SLOTS)
+        {
+            // The whole commit does not fit, compact instead
+            if (!write_data_block())
+            {
+                commit_requested = false;
+                return;
+            }
+        }
+        else
+        {
+            // Only the parameter area has changed, append the changed words
+            // and then the commit record
+            for (i = 0; i != CRC_WORD; ++i)
+            {
+                if (dirty_rows & ROW_BIT(2 * i))
+                {
+                    log_append(i, buffer_word(i));
+                }
+            }
+
+            log_append_commit();
+        }
     }
 
-    if (0 == flash_read_word(FLASH_INDEX_LEAD_TEMP_CURVE_SIZE))
+    dirty_rows = 0;
+    commit_requested = false;
+}
+
+void flash_request_commit(void)
+{
+    commit_requested = (0 != dirty_rows);
+}
+
+bool flash_is_commit_requested(void)
+{
+    return commit_requested;
+}
+
+uint16_t flash_get_nbr_of_pending_writes(void)
+{
+    uint16_t nbr_of_words = 0;
+    uint16_t i;
+
+    for (i = 0; i != FLASH_MEM_SIZE / 2; ++i)
     {
-        uint16_t index;
-        uint16_t i;
-        uint16_t temp[] = {25, 150, 180, 220, 220, 160, 75};
-        uint16_t time[] = {0 , 90 , 180, 210, 240, 300, 370};
-        uint16_t nbr_of_data_point = sizeof(time) / sizeof(uint16_t);
+        if ((dirty_rows & ROW_BIT(2 * i)) && (read_data_word(i) != buffer_word(i)))
+        {
+            ++nbr_of_words;
+        }
+    }
 
-        flash_init_write_buffer();
+    return nbr_of_words;
+}
 
-        flash_write_word_to_buffer(FLASH_INDEX_LEAD_TEMP_CURVE_SIZE,
-                                   nbr_of_data_point);
+// =============================================================================
+// Private function definitions
+// =============================================================================
 
-        flash_write_word_to_buffer(FLASH_INDEX_LEAD_SOAK_START_SEC, 90);
-        flash_write_word_to_buffer(FLASH_INDEX_LEAD_REFLOW_START_SEC, 190);
-        flash_write_word_to_buffer(FLASH_INDEX_LEAD_COOL_START_SEC, 270);
+static bool write_data_block(void)
+{
+    uint16_t row_data[NVM_INSTRUCTIONS_PER_ROW];
+    uint16_t block = data_block ^ 1;
+    uint16_t row;
+    uint16_t instr;
+    uint16_t word_index = 0;
 
-        index = FLASH_INDEX_LEAD_TEMP_CURVE_START;
+    flash_write_word_to_buffer(FLASH_INDEX_SEQUENCE,
+                               buffer_word(FLASH_INDEX_SEQUENCE / 2) + 1);
+    flash_write_word_to_buffer(FLASH_INDEX_CRC, buffer_crc());
 
-        for (i = 0; i != nbr_of_data_point; ++i)
+    nvm_erase_block(NVM_REGION_DATA, block);
+
+    for (row = 0; row != FLASH_MEM_SIZE / BYTES_PER_ROW; ++row)
+    {
+        for (instr = 0; instr != NVM_INSTRUCTIONS_PER_ROW; ++instr)
         {
-            flash_write_dword_to_buffer(index, int_to_q16_16(temp[i]));
-            index += 4;
-            flash_write_word_to_buffer(index, time[i]);
-            index += 2;
+            row_data[instr] = buffer_word(word_index++);
         }
 
-        flash_write_buffer_to_flash();
+        nvm_program_row(NVM_REGION_DATA,
+                        block * NVM_ROWS_PER_ERASE_BLOCK + row, row_data, NULL);
     }
 
-    if (0 == flash_read_dword(FLASH_INDEX_SERVO_FACTOR))
+    if (!data_block_is_valid(block))
     {
-        flash_init_write_buffer();
-        flash_write_dword_to_buffer(FLASH_INDEX_SERVO_FACTOR,
-                                   (uint32_t)DOUBLE_TO_Q16_16(1200.0/50.0));
-        flash_write_buffer_to_flash();
+        return false;
     }
 
-    if (0 == flash_read_dword(FLASH_INDEX_FILTER_LEN))
+    // The new data block holds the newest value of every word
+    data_block = block;
+    log_erase();
+
+    return true;
+}
+
+static bool data_block_is_valid(uint16_t block)
+{
+    uint16_t crc = CRC16_INIT;
+    uint16_t i;
+
+    for (i = 0; i != FLASH_MEM_SIZE / 2; ++i)
     {
-        flash_init_write_buffer();
-        flash_write_dword_to_buffer(FLASH_INDEX_FILTER_LEN, 16);
-        flash_write_buffer_to_flash();
+        crc = crc_add_word(crc, i,
+                           nvm_read_low(NVM_REGION_DATA, DATA_INSTR(block, i)));
     }
+
+    return (HEADER_VERSION ==
+            nvm_read_low(NVM_REGION_DATA,
+                         DATA_INSTR(block, FLASH_INDEX_VERSION / 2))) &&
+           (crc == nvm_read_low(NVM_REGION_DATA, DATA_INSTR(block, CRC_WORD)));
 }
 
-uint8_t flash_read_byte(flash_index_t index)
+static bool select_data_block(void)
 {
-    uint16_t data;
-    uint8_t ret_val;
-    data = flash_read_word(index & ~0x0001);
+    bool valid_0 = data_block_is_valid(0);
+    bool valid_1 = data_block_is_valid(1);
 
-    if (index & 0x0001)
+    if (valid_0 && valid_1)
     {
-        ret_val = (uint8_t)data;
+        // Newest by serial number arithmetic, the sequence number wraps
+        uint16_t diff =
+            nvm_read_low(NVM_REGION_DATA, DATA_INSTR(1, FLASH_INDEX_SEQUENCE / 2)) -
+            nvm_read_low(NVM_REGION_DATA, DATA_INSTR(0, FLASH_INDEX_SEQUENCE / 2));
+
+        data_block = (diff < 0x8000) ? 1 : 0;
     }
     else
     {
-        ret_val = (uint8_t)(data >> 8);
+        data_block = valid_1 ? 1 : 0;
     }
 
-    return ret_val;
+    return valid_0 || valid_1;
 }
 
-uint16_t flash_read_word(flash_index_t index)
+static bool log_scan(void)
 {
-    uint16_t addr_offset;
-    uint16_t read_word;
-    uint16_t index_offset = (uint16_t)index & 0xFFFE;
-    bool odd_addr = (0 != ((uint16_t)index & 0x0001));
+    uint16_t nbr_of_committed = 0;
+    uint16_t slot;
 
-    TBLPAG = __builtin_tblpage(flash_data);
-    addr_offset = __builtin_tbloffset(flash_data) + index_offset;
-    asm("tblrdl.w [%1], %0" : "=r"(read_word) : "r"(addr_offset));
+    for (slot = 0; slot != FLASH_LOG_AREA_SIZE / 2; ++slot)
+    {
+        log_index[slot] = 0;
+    }
 
-    if (odd_addr)
+    // Find the end of the log and of the last complete commit
+    for (slot = 0; slot != FLASH_LOG_SLOTS; ++slot)
     {
-        uint16_t high_word;
+        uint8_t word_index = nvm_read_high(NVM_REGION_LOG, slot);
 
-        index_offset += 1;
-        TBLPAG = __builtin_tblpage(flash_data);
-        addr_offset = __builtin_tbloffset(flash_data) + index_offset;
-        asm("tblrdl.w [%1], %0" : "=r"(high_word) : "r"(addr_offset));
+        if (LOG_RECORD_EMPTY == word_index)
+        {
+            break;
+        }
 
-        read_word = (read_word << 8) | (0x00FF & (high_word >> 8));
+        if (CRC_WORD == word_index)
+        {
+            nbr_of_committed = slot + 1;
+        }
     }
 
-    return read_word;
-}
+    log_next_slot = slot;
 
-uint32_t flash_read_dword(flash_index_t index)
-{
-    uint32_t dword = 0x00000000;
+    for (slot = 0; slot != nbr_of_committed; ++slot)
+    {
+        uint8_t word_index = nvm_read_high(NVM_REGION_LOG, slot);
 
-    dword |= ((uint32_t)flash_read_word(index) << 16) & (uint32_t)0xFFFF0000;
-    dword |=  (uint32_t)flash_read_word(index + 2)    & (uint32_t)0x0000FFFF;
+        // Records with an index outside the parameter area are skipped
+        if (word_index < FLASH_LOG_AREA_SIZE / 2)
+        {
+            log_index[word_index] = slot + 1;
+        }
+    }
 
-    return dword;
+    return nbr_of_committed != log_next_slot;
 }
 
-void flash_init_write_buffer(void)
+static uint16_t log_count_changes(void)
 {
+    uint16_t nbr_of_records = 0;
     uint16_t i;
 
-    for (i = 0; i != FLASH_MEM_SIZE; i += 2)
+    for (i = 0; i != CRC_WORD; ++i)
     {
-        uint16_t d = flash_read_word(i);
-        buffer[i] = d >> 8;
-        buffer[i + 1] = d;
+        if ((dirty_rows & ROW_BIT(2 * i)) && (read_data_word(i) != buffer_word(i)))
+        {
+            ++nbr_of_records;
+        }
     }
-}
 
-void flash_write_byte_to_buffer(flash_index_t index, uint8_t data)
-{
-    buffer[index] = data;
-}
-
-void flash_write_word_to_buffer(flash_index_t index, uint16_t data)
-{
-    buffer[index]     = (uint8_t)((data >> 8) & 0xFF);
-    buffer[index + 1] = (uint8_t)( data       & 0xFF);
+    return nbr_of_records;
 }
 
-void flash_write_dword_to_buffer(flash_index_t index, uint32_t data)
+static void log_append(uint16_t word_index, uint16_t data)
 {
-    buffer[index]     = (uint8_t)((data >> 24) & 0xFF);
-    buffer[index + 1] = (uint8_t)((data >> 16) & 0xFF);
-    buffer[index + 2] = (uint8_t)((data >> 8 ) & 0xFF);
-    buffer[index + 3] = (uint8_t)( data        & 0xFF);
-}
+    if (read_data_word(word_index) == data)
+    {
+        return;
+    }
 
-/*
- * From DS39715A-page 4-17:
- *
+    nvm_program_word(NVM_REGION_LOG, log_next_slot, data, (uint8_t)word_index);
 
-The user can program one row of program Flash memory at a time. To do this, it is necessary to
-erase the 8-row erase block containing the desired row. The general process is:
-1. Read eight rows of program memory (512 instructions) and store in data RAM.
-2. Update the program data in RAM with the desired new data.
-3. Erase the block:
-a) Set the NVMOP bits (NVMCOM<3:0>) to ?0010? to configure for block erase. Set the
-ERASE (NVMCOM<6>) and WREN (NVMCOM<14>) bits.
-b) Write the starting address of the block to be erased into the TBLPAG and W registers.
-c) Write 55h to NVMKEY.
-d) Write AAh to NVMKEY.
-e) Set the WR bit (NVMCOM<15>). The erase cycle begins and the CPU stalls for the
-duration of the erase cycle. When the erase is done, the WR bit is cleared automatically.
-4. Write the first 64 instructions from data RAM into the program memory buffers (see Section 4.5
-?Program Memory Writes?).
-5. Write the program block to Flash memory:
-a) Set the NVMOP bits to ?0001? to configure for row programming. Clear the ERASE
-bit and set the WREN bit.
-b) Write 55h to NVMKEY.
-c) Write AAh to NVMKEY.
-d) Set the WR bit. The programming cycle begins and the CPU stalls for the duration of the
-write cycle. When the write to Flash memory is done, the WR bit is cleared automatically.
-6. Repeat steps 4 and 5, using the next available 64 instructions from the block in data RAM
-by incrementing the value in TBLPAG, until all 512 instructions are written back to Flash
-memory.
-For protection against accidental operations, the write initiate sequence for NVMKEY must be
-used to allow any erase or program operation to proceed. After the programming command has
-been executed, the user must wait for the programming time until programming is complete. The
-two instructions following the start of the programming sequence should be NOPs, as shown in
-Section 4.6.4.2 ?NVMKEY Register?.
+    log_index[word_index] = ++log_next_slot;
+}
 
- */
-void flash_write_buffer_to_flash(void)
+static void log_append_commit(void)
 {
-    uint16_t row;
-    uint16_t instr;
-    uint16_t offset;
-    uint16_t buffer_index;
-
-    erase_flash_data();
+    // Appended even if the CRC happens to be unchanged, it ends the commit
+    nvm_program_word(NVM_REGION_LOG, log_next_slot, buffer_word(CRC_WORD),
+                     (uint8_t)CRC_WORD);
 
-    // Memory row program operation (ERASE = 0) or no operation (ERASE = 1)
-    NVMCONbits.NVMOP = 1;
-    NVMCONbits.ERASE = 0;
-    NVMCONbits.WREN = 1;
+    log_index[CRC_WORD] = ++log_next_slot;
+}
 
-    TBLPAG = __builtin_tblpage(flash_data);
-    offset = __builtin_tbloffset(flash_data);
-    buffer_index = 0;
+static void log_erase(void)
+{
+    uint16_t block = NVM_LOG_BLOCKS;
+    uint16_t i;
 
-    for (row = 0; row != ROWS_PER_ERASE_BLOCK; ++row)
+    // Last block first, so that an interrupted erase leaves the start of the
+    // log, which flash_init() then checks like a log which was not erased
+    while (0 != block--)
     {
-        uint16_t row_offset = row * (uint16_t)INSTRUCTIONS_PER_ROW * 2;
-        
-        for (instr = 0; instr != INSTRUCTIONS_PER_ROW; ++instr)
+        if (log_next_slot > block * (uint16_t)NVM_INSTRUCTIONS_PER_ERASE_BLOCK)
         {
-            uint16_t low_word;
-            uint8_t dummy_data = 0x00;
-            uint16_t addr = offset + (instr * 2) + row_offset;
+            nvm_erase_block(NVM_REGION_LOG, block);
+        }
+    }
 
-            low_word  = (uint16_t)buffer[buffer_index++] << 8;
-            low_word |= (uint16_t)buffer[buffer_index++];
+    for (i = 0; i != FLASH_LOG_AREA_SIZE / 2; ++i)
+    {
+        log_index[i] = 0;
+    }
 
-            __builtin_tblwtl(addr, low_word);
-            __builtin_tblwth(addr, dummy_data);
-        }
-        __builtin_disi(5);
-        __builtin_write_NVM();
+    log_next_slot = 0;
+}
 
-        while (NVMCONbits.WR)
-        {
-            ;
-        }
-    }  
+static uint16_t read_data_word(uint16_t word_index)
+{
+    if ((word_index < FLASH_LOG_AREA_SIZE / 2) && (0 != log_index[word_index]))
+    {
+        return nvm_read_low(NVM_REGION_LOG, log_index[word_index] - 1);
+    }
+
+    return nvm_read_low(NVM_REGION_DATA, DATA_INSTR(data_block, word_index));
 }
 
-// =============================================================================
-// Private function definitions
-// =============================================================================
+static uint16_t buffer_word(uint16_t word_index)
+{
+    return ((uint16_t)buffer[2 * word_index] << 8) | buffer[2 * word_index + 1];
+}
 
-/**
- * Reference: DS30009715C-page 16
- */
-static void erase_flash_data(void)
+static uint16_t crc_add_word(uint16_t crc, uint16_t word_index, uint16_t data)
 {
-    uint16_t addr_offset;
+    if (FLASH_INDEX_CRC / 2 == word_index)
+    {
+        return crc;
+    }
 
-    NVMCONbits.NVMOP = 0x2;     // Erase block
+    crc = crc16_update(crc, (uint8_t)(data >> 8));
 
-    // Perform the erase operation specified by NVMOP3:NVMOP0 on the next WR command
-    NVMCONbits.ERASE = 1;
+    return crc16_update(crc, (uint8_t)data);
+}
 
-    // Enable Flash program/erase operations
-    NVMCONbits.WREN = 1;
+static uint16_t buffer_crc(void)
+{
+    uint16_t crc = CRC16_INIT;
+    uint16_t i;
 
-    // Set up the address
-    TBLPAG = __builtin_tblpage(flash_data);
-    addr_offset = __builtin_tbloffset(flash_data);
-    __builtin_tblwtl(addr_offset, 0); // Dummy TBLWT to load address
+    for (i = 0; i != FLASH_MEM_SIZE / 2; ++i)
+    {
+        crc = crc_add_word(crc, i, buffer_word(i));
+    }
 
-    // Start sequence accoding to doc: DS39715A-page 4-16
-    __builtin_disi(5);
-    __builtin_write_NVM();  
+    return crc;
+}
 
-    while (NVMCONbits.WR)
+static void write_defaults_to_buffer(void)
+{
+    uint16_t i;
+
+    for (i = 0; i != FLASH_MEM_SIZE; ++i)
     {
-        ;
+        flash_write_byte_to_buffer((flash_index_t)i, 0x00);
     }
+
+    flash_write_word_to_buffer(FLASH_INDEX_VERSION, HEADER_VERSION);
+    flash_write_dword_to_buffer(FLASH_INDEX_SERVO_FACTOR,
+                                (uint32_t)DEFAULT_SERVO_FACTOR);
+    flash_write_dword_to_buffer(FLASH_INDEX_FILTER_LEN, DEFAULT_FILTER_LEN);
+
+    profile_write_defaults_to_buffer();
 }
@@ -7,6 +7,15 @@
  * much as possible in order to minimize wear.
  *
  * Write operations are slow and will stall be whole processor.
+ *
+ * Reads and writes use a RAM copy, writes are committed to flash later. Use
+ * flash_write_byte(), flash_write_word() or flash_write_dword() to have the
+ * change committed by the main loop when no reflow program is running, or the
+ * *_to_buffer() functions to collect changes until an explicit commit.
+ *
+ * Changes to the parameter area, indexes below FLASH_LOG_AREA_SIZE, are
+ * committed by appending records to a log instead of erasing the sector,
+ * which only stalls the processor for one word program per changed word.
  */
 
 
@@ -46,23 +55,29 @@ typedef enum
     FLASH_INDEX_FILTER_LEN  = 0x1A, // Length of temp. moving average filter.
 
     //
-    // Temperature curve
+    // Selected profiles, see profile_select(). In the parameter area so that
+    // a selection is committed through the log.
+    //
+    FLASH_INDEX_PROFILE_SELECTED_LEAD_FREE  = 0x1E,
+    FLASH_INDEX_PROFILE_SELECTED_LEAD       = 0x1F,
+
+    //
+    // Header, see flash_init()
+    //
+    FLASH_INDEX_SEQUENCE    = 0xFA, // Incremented by each data block write
+    FLASH_INDEX_VERSION     = 0xFC, // Magic and layout version
+    FLASH_INDEX_CRC         = 0xFE, // CRC-16 of the rest of the data memory
+
+    //
+    // Profile library, see profile.h
     //
-    FLASH_INDEX_LEAD_FREE_TEMP_CURVE_SIZE   = 0x100,
-    FLASH_INDEX_LEAD_FREE_SOAK_START_SEC    = 0x102,
-    FLASH_INDEX_LEAD_FREE_REFLOW_START_SEC  = 0x104,
-    FLASH_INDEX_LEAD_FREE_COOL_START_SEC    = 0x106,
-    FLASH_INDEX_LEAD_FREE_TEMP_CURVE_START  = 0x108,
-            // index 0x108 - 0x1FF reserved for lead free temp. curve data.
-    FLASH_INDEX_LEAD_FREE_TEMP_CURVE_END    = 0x1FF,
-
-    FLASH_INDEX_LEAD_TEMP_CURVE_SIZE        = 0x200,
-    FLASH_INDEX_LEAD_SOAK_START_SEC         = 0x202,
-    FLASH_INDEX_LEAD_REFLOW_START_SEC       = 0x204,
-    FLASH_INDEX_LEAD_COOL_START_SEC         = 0x206,
-    FLASH_INDEX_LEAD_TEMP_CURVE_START       = 0x208,
-            // index 0x208 - 0x2FF reserved for lead free temp. curve data.
-    FLASH_INDEX_LEAD_TEMP_CURVE_END         = 0x2FF,
+    FLASH_INDEX_PROFILE_DIR_START           = 0x100,
+            // index 0x100 - 0x1BF reserved for 12 directory entries.
+    FLASH_INDEX_PROFILE_DIR_END             = 0x1BF,
+    FLASH_INDEX_PROFILE_COUNT               = 0x1C0,
+    FLASH_INDEX_PROFILE_POINTS_START        = 0x200,
+            // index 0x200 - 0x3FF reserved for 256 profile points.
+    FLASH_INDEX_PROFILE_POINTS_END          = 0x3FF,
 } flash_index_t;
 
 // =============================================================================
@@ -77,12 +92,23 @@ typedef enum
 // Number of bytes the can be stored in the data memory.
 #define FLASH_MEM_SIZE  1024
 
+// Number of bytes in the parameter area, which is written through the log.
+#define FLASH_LOG_AREA_SIZE 0x100
+
 // =============================================================================
 // Public function declarations
 // =============================================================================
 
 /**
- * @brief Initializes the flash by setting any missing values to their default.
+ * @brief Loads the data memory and validates the header.
+ * @details Both data blocks are checked by their version and CRC, and the
+ * valid one with the newest sequence number is used. The log records up to
+ * the last commit record are applied to it. Records after the last commit
+ * record, left by an interrupted commit, are ignored and the log is
+ * compacted. A log which does not give the CRC of its last commit record is
+ * erased and the data block is used alone. Only if neither data block is
+ * valid, as on a blank device, all data is replaced by the defaults in a
+ * single commit.
  */
 void flash_init(void);
 
@@ -108,7 +134,33 @@ uint16_t flash_read_word(flash_index_t index);
 uint32_t flash_read_dword(flash_index_t index);
 
 /**
- * @brief Makes a RAM copy of the flash data memory.
+ * @brief Writes one byte to the write buffer and requests a commit.
+ * @details The new value can be read back at once, but is stored in flash
+ * first when the main loop commits it, see flash_request_commit().
+ * @param index     Index to the byte to write.
+ * @param data      The byte to write.
+ */
+void flash_write_byte(flash_index_t index, uint8_t data);
+
+/**
+ * @brief Writes one word to the write buffer, see flash_write_byte().
+ * @param index     Index to the word to write.
+ * @param data      The word to write.
+ */
+void flash_write_word(flash_index_t index, uint16_t data);
+
+/**
+ * @brief Writes one double word to the write buffer, see flash_write_byte().
+ * @details The two words may become separate log records, but they are
+ * committed together, so a reset never leaves only one of them updated.
+ * @param index     Index to the dword to write.
+ * @param data      The dword to write.
+ */
+void flash_write_dword(flash_index_t index, uint32_t data);
+
+/**
+ * @brief Discards all uncommitted writes by reloading the RAM copy of the
+ * flash data memory.
  */
 void flash_init_write_buffer(void);
 
@@ -134,12 +186,42 @@ void flash_write_word_to_buffer(flash_index_t index, uint16_t data);
 void flash_write_dword_to_buffer(flash_index_t index, uint32_t data);
 
 /**
- * @brief Writes the data memory buffer to the flash memory.
- * @details This function is blocking and will stall the entire cpu
- * for up to a few milliseconds.
+ * @brief Commits the changes in the data memory buffer to the flash memory.
+ * @details This function is blocking. The new CRC is calculated into the
+ * header of the buffer. If only the parameter area has changed, one log
+ * record is programmed per changed word and then a commit record holding
+ * the CRC, so a reset before the commit record leaves the old values. Each
+ * record is a self-timed word program of about 3 ms, so a changed dword
+ * parameter stalls the cpu for about 9 ms and a profile selection for about
+ * 6 ms. Other changes, or a commit which does not fit in the log, erase the
+ * data block not in use and program it row by row with the next sequence
+ * number and the CRC in the header. Only if it then validates, it replaces
+ * the block in use and the log is erased. This stalls the cpu for about
+ * 30 ms. If it does not validate, the changes are left pending.
  */
 void flash_write_buffer_to_flash(void);
 
+/**
+ * @brief Requests that the changes in the data memory buffer are committed.
+ * @details The main loop calls flash_write_buffer_to_flash() when a commit
+ * is requested and no reflow program is running, so several writes are
+ * coalesced into one commit and the control loop is never stalled.
+ */
+void flash_request_commit(void);
+
+/**
+ * @brief Checks if a commit has been requested.
+ * @return True if flash_write_buffer_to_flash() should be called.
+ */
+bool flash_is_commit_requested(void);
+
+/**
+ * @brief Counts the words in the data memory buffer which are not yet
+ * committed to flash.
+ * @return Number of changed words.
+ */
+uint16_t flash_get_nbr_of_pending_writes(void);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -0,0 +1,887 @@
+/*
+ * Host test and benchmark of fixed_point.h.
+ *
+ * Every function is swept against a double reference. The max and the mean
+ * error is printed in LSB of the result format, together with how results
+ * outside of the range of the format were handled and the time per call.
+ * The program fails if an error is above the bound documented for the
+ * function, or if an out of range result does not behave as documented.
+ *
+ * The rounding functions and the logarithms are swept over every STRIDE:th
+ * input, or over all 2^32 inputs with --full, and q16_16_exp2_fast() over
+ * every input below 15.0 where the result is not saturated. The other
+ * functions are tested with random operands of every magnitude.
+ *
+ * Build and run with
+ *   make -C host test
+ */
+
+// =============================================================================
+// Include statements
+// =============================================================================
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "fixed_point.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// =============================================================================
+// Private type definitions
+// =============================================================================
+
+typedef struct sweep_t
+{
+    const char * name;
+    double bound;               // Max allowed error in LSB, < 0 for none
+    bool relative;              // Errors and bound relative to the result
+    const char * out_of_range;  // Documented handling of out of range results
+    uint64_t samples;
+    double max_error;
+    double sum_error;
+    uint64_t nbr_out_of_range;
+    uint64_t failures;          // Out of range results not as documented
+    double ns_per_op;
+} sweep_t;
+
+// The 16 bit multiplications, see test_multiply_16()
+typedef enum
+{
+    MULTIPLY_Q1_15 = 0,
+    MULTIPLY_Q2_14,
+    MULTIPLY_Q8_8,
+    MULTIPLY_Q8_8_Q1_15,
+    MULTIPLY_Q8_8_Q2_14,
+    NBR_OF_MULTIPLY_16
+} multiply_16_t;
+
+// =============================================================================
+// Private constants
+// =============================================================================
+
+#define STRIDE              97
+#define RANDOM_SAMPLES      10000000UL
+#define BENCH_SIZE          4096
+#define BENCH_ROUNDS        2000
+
+// Lowest bit of the inputs swept with a stride, so that the sweep covers
+// every fraction
+#define SWEEP_START(stride) (INT32_MIN + (int64_t)(stride) - 1)
+
+#define LSB                 (1.0 / 65536.0)
+
+// Runs expr BENCH_ROUNDS times over the benchmark operands a and b and stores
+// the time per call in s
+#define BENCHMARK(s, type, expr)                                               \
+    do {                                                                       \
+        volatile type sink_;                                                   \
+        type acc_ = 0;                                                         \
+        double t_ = now_ns();                                                  \
+        uint32_t r_;                                                           \
+        uint16_t i_;                                                           \
+        for (r_ = 0; r_ < BENCH_ROUNDS; r_++)                                  \
+        {                                                                      \
+            for (i_ = 0; i_ < BENCH_SIZE; i_++)                                \
+            {                                                                  \
+                q16_16_t a = bench_a[i_];                                      \
+                q16_16_t b = bench_b[i_];                                      \
+                (void)a;                                                       \
+                (void)b;                                                       \
+                acc_ += (expr);                                                \
+            }                                                                  \
+        }                                                                      \
+        sink_ = acc_;                                                          \
+        (void)sink_;                                                           \
+        (s)->ns_per_op = (now_ns() - t_) /                                     \
+                         ((double)BENCH_ROUNDS * BENCH_SIZE);                  \
+    } while (0)
+
+// =============================================================================
+// Private variables
+// =============================================================================
+
+static uint64_t random_state = 0x2545F4914F6CDD1DULL;
+
+static q16_16_t bench_a[BENCH_SIZE];
+static q16_16_t bench_b[BENCH_SIZE];
+
+static uint32_t stride = STRIDE;
+
+static uint16_t nbr_of_failed = 0;
+
+// =============================================================================
+// Private function declarations
+// =============================================================================
+
+/**
+ * @brief Gets a pseudo random number, xorshift64*.
+ * @return The random number.
+ */
+static uint32_t random_u32(void);
+
+/**
+ * @brief Gets a random q16_16_t with a random number of significant bits, so
+ * that small and large magnitudes are tested equally often.
+ * @return The random value.
+ */
+static q16_16_t random_q16_16(void);
+
+/**
+ * @brief Gets a monotonic time stamp.
+ * @return The time in ns.
+ */
+static double now_ns(void);
+
+/**
+ * @brief Fills the benchmark operands with random values.
+ * @param positive - True to only use positive values.
+ */
+static void bench_fill(bool positive);
+
+/**
+ * @brief Fills the first benchmark operands with random values in a range.
+ * @param min - The smallest value.
+ * @param max - The largest value.
+ */
+static void bench_fill_range(q16_16_t min, q16_16_t max);
+
+/**
+ * @brief Starts a new sweep.
+ * @param s - The sweep.
+ * @param name - Name of the function.
+ * @param bound - Max allowed error in LSB, < 0 for no check.
+ * @param out_of_range - Documented handling of out of range results.
+ */
+static void bench_fill_range(q16_16_t min, q16_16_t max)
+{
+    uint16_t i;
+
+    for (i = 0; i < BENCH_SIZE; i++)
+    {
+        bench_a[i] = min + (q16_16_t)(random_u32() % ((uint32_t)(max - min)));
+    }
+}
+
+static void sweep_start(sweep_t * s,
+                        const char * name,
+                        double bound,
+                        const char * out_of_range);
+
+/**
+ * @brief Adds a result which is within the range of the format.
+ * @param s - The sweep.
+ * @param result - The result in LSB.
+ * @param reference - The exact result in LSB.
+ */
+static void sweep_add(sweep_t * s, double result, double reference);
+
+/**
+ * @brief Adds a result which is outside the range of the format.
+ * @param s - The sweep.
+ * @param ok - True if the result was handled as documented.
+ */
+static void sweep_add_out_of_range(sweep_t * s, bool ok);
+
+/**
+ * @brief Prints the result of a sweep and counts it if it failed.
+ * @param s - The sweep.
+ */
+static void sweep_end(const sweep_t * s);
+
+/**
+ * @brief Tests q16_16_floor(), q16_16_ceil(), q16_16_round() and
+ * q16_16_to_int().
+ */
+static void test_rounding(void);
+
+/**
+ * @brief Tests q16_16_multiply().
+ */
+static void test_multiply(void);
+
+/**
+ * @brief Tests q16_16_divide() and q16_16_divide_fast().
+ */
+static void test_divide(void);
+
+/**
+ * @brief Tests q16_16_log().
+ */
+static void test_log(void);
+
+/**
+ * @brief Tests q16_16_log2_fast() and q16_16_exp2_fast().
+ */
+static void test_log2_exp2_fast(void);
+
+/**
+ * @brief Tests q16_16_multiply_q2_14() and q16_16_multiply_q1_15().
+ */
+static void test_split_multiply(void);
+
+/**
+ * @brief Tests the multiplications of the 16 bit formats.
+ */
+static void test_multiply_16(void);
+
+/**
+ * @brief Tests the 16 bit multiplications with one factor and every value of
+ * the other factor.
+ * @param s - The sweeps, indexed by multiply_16_t.
+ * @param x - The first factor.
+ */
+static void test_multiply_16_factor(sweep_t * s, int16_t x);
+
+/**
+ * @brief Adds the result of a 16 bit multiplication which saturates.
+ * @param s - The sweep.
+ * @param result - The result.
+ * @param exact - The exact result in LSB.
+ * @param max - The largest value of the format.
+ * @param min - The smallest value of the format.
+ */
+static void check_multiply_16(sweep_t * s,
+                              int16_t result,
+                              double exact,
+                              int16_t max,
+                              int16_t min);
+
+// =============================================================================
+// Public function definitions
+// =============================================================================
+
+int main(int argc, char ** argv)
+{
+    if ((argc > 1) && (0 == strcmp(argv[1], "--full")))
+    {
+        stride = 1;
+    }
+
+    printf("%-26s %10s %8s %8s %6s  %-24s %7s\n", "function", "samples",
+           "max LSB", "mean LSB", "bound", "out of range", "ns/op");
+
+    test_rounding();
+    test_multiply();
+    test_divide();
+    test_log();
+    test_log2_exp2_fast();
+    test_split_multiply();
+    test_multiply_16();
+
+    if (nbr_of_failed > 0)
+    {
+        printf("%u functions FAILED\n", nbr_of_failed);
+        return 1;
+    }
+
+    printf("All functions passed\n");
+    return 0;
+}
+
+// =============================================================================
+// Private function definitions
+// =============================================================================
+
+static uint32_t random_u32(void)
+{
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+
+    return (uint32_t)((random_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static q16_16_t random_q16_16(void)
+{
+    uint32_t r = random_u32();
+    uint8_t bits = (uint8_t)(random_u32() % 32);
+
+    return (q16_16_t)r >> bits;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void bench_fill(bool positive)
+{
+    uint16_t i;
+
+    for (i = 0; i < BENCH_SIZE; i++)
+    {
+        do
+        {
+            bench_a[i] = random_q16_16();
+            bench_b[i] = random_q16_16();
+        } while ((0 == bench_b[i]) ||
+                 (positive && ((bench_a[i] <= 0) || (bench_b[i] <= 0))));
+    }
+}
+
+static void sweep_start(sweep_t * s,
+                        const char * name,
+                        double bound,
+                        const char * out_of_range)
+{
+    memset(s, 0, sizeof(*s));
+    s->name = name;
+    s->bound = bound;
+    s->out_of_range = out_of_range;
+}
+
+static void sweep_add(sweep_t * s, double result, double reference)
+{
+    double error = fabs(result - reference);
+
+    if (s->relative)
+    {
+        error /= fabs(reference);
+    }
+
+    s->samples++;
+    s->sum_error += error;
+
+    if (error > s->max_error)
+    {
+        s->max_error = error;
+    }
+}
+
+static void sweep_add_out_of_range(sweep_t * s, bool ok)
+{
+    s->samples++;
+    s->nbr_out_of_range++;
+
+    if (!ok)
+    {
+        s->failures++;
+    }
+}
+
+static void sweep_end(const sweep_t * s)
+{
+    char bound[16];
+    char out_of_range[32];
+    bool failed;
+
+    if (0 == s->samples)
+    {
+        // Reference implementations are only benchmarked
+        printf("%-26s %10s %8s %8s %6s  %-24s %7.1f\n", s->name, "-", "-",
+               "-", "-", "-", s->ns_per_op);
+        return;
+    }
+
+    // Errors are compared with the bound rounded as it is documented, to two
+    // decimals or to two significant digits if relative
+    failed = (s->bound >= 0) &&
+             (s->max_error > (s->relative ? s->bound * 1.025 : s->bound + 0.005));
+    failed = failed || (s->failures > 0);
+
+    if (s->relative)
+    {
+        snprintf(bound, sizeof(bound), "%6.1e", s->bound);
+    }
+    else if (s->bound >= 0)
+    {
+        snprintf(bound, sizeof(bound), "%6.2f", s->bound);
+    }
+    else
+    {
+        snprintf(bound, sizeof(bound), "%6s", "-");
+    }
+
+    if (0 == s->nbr_out_of_range)
+    {
+        snprintf(out_of_range, sizeof(out_of_range), "-");
+    }
+    else
+    {
+        snprintf(out_of_range, sizeof(out_of_range), "%s %llu",
+                 s->out_of_range, (unsigned long long)s->nbr_out_of_range);
+    }
+
+    printf(s->relative ? "%-26s %10llu %8.1e %8.1e %s  %-24s %7.1f%s\n" :
+                         "%-26s %10llu %8.2f %8.3f %s  %-24s %7.1f%s\n", s->name,
+           (unsigned long long)s->samples, s->max_error,
+           s->samples > s->nbr_out_of_range ?
+               s->sum_error / (double)(s->samples - s->nbr_out_of_range) : 0.0,
+           bound, out_of_range, s->ns_per_op, failed ? "  FAILED" : "");
+
+    if (s->failures > 0)
+    {
+        printf("  %llu out of range results not handled as documented\n",
+               (unsigned long long)s->failures);
+    }
+
+    if (failed)
+    {
+        nbr_of_failed++;
+    }
+}
+
+//
+// floor, ceil, round and to_int are exact except where the result can not be
+// represented, then ceil and round saturate to 32767.0.
+//
+static void test_rounding(void)
+{
+    sweep_t floor_s;
+    sweep_t ceil_s;
+    sweep_t round_s;
+    sweep_t to_int_s;
+    int64_t i;
+
+    sweep_start(&floor_s, "q16_16_floor", 0.0, "");
+    sweep_start(&ceil_s, "q16_16_ceil", 0.0, "saturates");
+    sweep_start(&round_s, "q16_16_round", 0.0, "saturates");
+    sweep_start(&to_int_s, "q16_16_to_int", 0.0, "saturates");
+
+    for (i = SWEEP_START(stride); i <= INT32_MAX; i += stride)
+    {
+        q16_16_t t = (q16_16_t)i;
+        double x = (double)t * LSB;
+        double c = ceil(x);
+        double r = floor(x + 0.5);
+
+        sweep_add(&floor_s, (double)q16_16_floor(t), floor(x) * 65536.0);
+
+        if (c > INT16_MAX)
+        {
+            sweep_add_out_of_range(&ceil_s,
+                                   INT_TO_Q16_16(INT16_MAX) == q16_16_ceil(t));
+        }
+        else
+        {
+            sweep_add(&ceil_s, (double)q16_16_ceil(t), c * 65536.0);
+        }
+
+        if (r > INT16_MAX)
+        {
+            sweep_add_out_of_range(&round_s,
+                                   INT_TO_Q16_16(INT16_MAX) == q16_16_round(t));
+            sweep_add_out_of_range(&to_int_s, INT16_MAX == q16_16_to_int(t));
+        }
+        else
+        {
+            sweep_add(&round_s, (double)q16_16_round(t), r * 65536.0);
+            sweep_add(&to_int_s, (double)q16_16_to_int(t), r);
+        }
+    }
+
+    bench_fill(false);
+    BENCHMARK(&floor_s, q16_16_t, q16_16_floor(a));
+    BENCHMARK(&ceil_s, q16_16_t, q16_16_ceil(a));
+    BENCHMARK(&round_s, q16_16_t, q16_16_round(a));
+    BENCHMARK(&to_int_s, int32_t, q16_16_to_int(a));
+
+    sweep_end(&floor_s);
+    sweep_end(&ceil_s);
+    sweep_end(&round_s);
+    sweep_end(&to_int_s);
+}
+
+//
+// The product is rounded towards minus infinity, out of range products wrap.
+//
+static void test_multiply(void)
+{
+    sweep_t s;
+    sweep_t ref;
+    uint32_t i;
+
+    sweep_start(&s, "q16_16_multiply", 1.0, "wraps");
+    sweep_start(&ref, "  double a * b", -1.0, "");
+
+    for (i = 0; i < RANDOM_SAMPLES; i++)
+    {
+        q16_16_t a = random_q16_16();
+        q16_16_t b = random_q16_16();
+        double exact = (double)a * (double)b * LSB;
+        q16_16_t p = q16_16_multiply(a, b);
+
+        if ((exact >= (double)INT32_MAX + 1.0) || (exact < (double)INT32_MIN))
+        {
+            int64_t wide = ((int64_t)a * (int64_t)b) >> 16;
+
+            sweep_add_out_of_range(&s, (uint32_t)wide == (uint32_t)p);
+        }
+        else
+        {
+            sweep_add(&s, (double)p, exact);
+        }
+    }
+
+    bench_fill(false);
+    BENCHMARK(&s, q16_16_t, q16_16_multiply(a, b));
+    BENCHMARK(&ref, double, (double)a * LSB * ((double)b * LSB));
+
+    sweep_end(&s);
+    sweep_end(&ref);
+}
+
+//
+// q16_16_divide() rounds towards zero and wraps, q16_16_divide_fast() rounds
+// to nearest and saturates. Division by zero is only defined for the latter.
+//
+static void test_divide(void)
+{
+    sweep_t s;
+    sweep_t fast;
+    sweep_t ref;
+    uint32_t i;
+
+    sweep_start(&s, "q16_16_divide", 1.0, "wraps");
+    sweep_start(&fast, "q16_16_divide_fast", 2.5, "saturates");
+    sweep_start(&ref, "  double a / b", -1.0, "");
+
+    for (i = 0; i < RANDOM_SAMPLES; i++)
+    {
+        q16_16_t a = random_q16_16();
+        q16_16_t b = random_q16_16();
+        double exact;
+        q16_16_t q;
+
+        if (0 == b)
+        {
+            q = q16_16_divide_fast(a, b);
+
+            if (0 == a)
+            {
+                sweep_add(&fast, (double)q, 0.0);
+            }
+            else
+            {
+                sweep_add_out_of_range(&fast,
+                                       q == (a > 0 ? Q16_16_MAX : Q16_16_MIN));
+            }
+
+            continue;
+        }
+
+        exact = (double)a / (double)b * 65536.0;
+        q = q16_16_divide(a, b);
+
+        if ((exact >= (double)INT32_MAX + 1.0) || (exact < (double)INT32_MIN))
+        {
+            int64_t wide = ((int64_t)a << 16) / b;
+
+            sweep_add_out_of_range(&s, (uint32_t)wide == (uint32_t)q);
+        }
+        else
+        {
+            sweep_add(&s, (double)q, exact);
+        }
+
+        q = q16_16_divide_fast(a, b);
+
+        if ((exact >= (double)INT32_MAX + 0.5) || (exact < (double)INT32_MIN))
+        {
+            sweep_add_out_of_range(&fast,
+                                   q == (exact > 0 ? Q16_16_MAX : Q16_16_MIN));
+        }
+        else
+        {
+            sweep_add(&fast, (double)q, exact);
+        }
+    }
+
+    bench_fill(false);
+    BENCHMARK(&s, q16_16_t, q16_16_divide(a, b));
+    BENCHMARK(&fast, q16_16_t, q16_16_divide_fast(a, b));
+    BENCHMARK(&ref, double, (double)a / (double)b);
+
+    sweep_end(&s);
+    sweep_end(&fast);
+    sweep_end(&ref);
+}
+
+//
+// q16_16_log() is the base 2 logarithm, Q16_16_MIN for x <= 0.
+//
+static void test_log(void)
+{
+    sweep_t s;
+    int64_t i;
+
+    sweep_start(&s, "q16_16_log", 3.61, "Q16_16_MIN");
+
+    for (i = SWEEP_START(stride); i <= INT32_MAX; i += stride)
+    {
+        q16_16_t x = (q16_16_t)i;
+
+        if (x <= 0)
+        {
+            // Only a few non-positive inputs, they all take the same path
+            if (0 == (i & 0xFFFFF))
+            {
+                sweep_add_out_of_range(&s, Q16_16_MIN == q16_16_log(x));
+            }
+        }
+        else
+        {
+            sweep_add(&s, (double)q16_16_log(x),
+                      log2((double)x * LSB) * 65536.0);
+        }
+    }
+
+    // Every input below 2.0, where the relative resolution is the lowest
+    for (i = 1; i < 2 * Q16_16_T_ONE; i++)
+    {
+        sweep_add(&s, (double)q16_16_log((q16_16_t)i),
+                  log2((double)i * LSB) * 65536.0);
+    }
+
+    sweep_add_out_of_range(&s, Q16_16_MIN == q16_16_log(0));
+
+    bench_fill(true);
+    BENCHMARK(&s, q16_16_t, q16_16_log(a));
+
+    sweep_end(&s);
+}
+
+//
+// The fast functions are compared to libm, with the bounds documented in
+// fixed_point.c for the default table size. q16_16_exp2_fast() is 0 below
+// -17.0 where the result rounds to 0.
+//
+static void test_log2_exp2_fast(void)
+{
+    sweep_t log2_s;
+    sweep_t log2_ref;
+    sweep_t exp2_pos;
+    sweep_t exp2_neg;
+    sweep_t exp2_ref;
+    int64_t i;
+
+    sweep_start(&log2_s, "q16_16_log2_fast", 2.31, "Q16_16_MIN");
+    sweep_start(&log2_ref, "  libm log2", -1.0, "");
+    sweep_start(&exp2_pos, "q16_16_exp2_fast x >= 0", 1.9e-5, "saturates");
+    sweep_start(&exp2_neg, "q16_16_exp2_fast x < 0", 1.30, "");
+    sweep_start(&exp2_ref, "  libm exp2", -1.0, "");
+    exp2_pos.relative = true;
+
+    for (i = SWEEP_START(stride); i <= INT32_MAX; i += stride)
+    {
+        q16_16_t x = (q16_16_t)i;
+
+        if (x <= 0)
+        {
+            if (0 == (i & 0xFFFFF))
+            {
+                sweep_add_out_of_range(&log2_s,
+                                       Q16_16_MIN == q16_16_log2_fast(x));
+            }
+        }
+        else
+        {
+            sweep_add(&log2_s, (double)q16_16_log2_fast(x),
+                      log2((double)x * LSB) * 65536.0);
+        }
+    }
+
+    for (i = 1; i < 2 * Q16_16_T_ONE; i++)
+    {
+        sweep_add(&log2_s, (double)q16_16_log2_fast((q16_16_t)i),
+                  log2((double)i * LSB) * 65536.0);
+    }
+
+    sweep_add_out_of_range(&log2_s, Q16_16_MIN == q16_16_log2_fast(0));
+
+    for (i = SWEEP_START(stride); i < INT_TO_Q16_16(-17); i += stride)
+    {
+        sweep_add(&exp2_neg, (double)q16_16_exp2_fast((q16_16_t)i),
+                  exp2((double)i * LSB) * 65536.0);
+    }
+
+    for (i = INT_TO_Q16_16(-17); i < INT_TO_Q16_16(15); i++)
+    {
+        q16_16_t x = (q16_16_t)i;
+        double exact = exp2((double)x * LSB) * 65536.0;
+
+        sweep_add(x < 0 ? &exp2_neg : &exp2_pos,
+                  (double)q16_16_exp2_fast(x), exact);
+    }
+
+    for (i = INT_TO_Q16_16(15); i <= INT32_MAX; i += stride)
+    {
+        sweep_add_out_of_range(&exp2_pos,
+                               Q16_16_MAX == q16_16_exp2_fast((q16_16_t)i));
+    }
+
+    bench_fill(true);
+    BENCHMARK(&log2_s, q16_16_t, q16_16_log2_fast(a));
+    BENCHMARK(&log2_ref, double, log2((double)a * LSB));
+    bench_fill_range(INT_TO_Q16_16(-16), INT_TO_Q16_16(15));
+    BENCHMARK(&exp2_pos, q16_16_t, q16_16_exp2_fast(a));
+    exp2_neg.ns_per_op = exp2_pos.ns_per_op;
+    BENCHMARK(&exp2_ref, double, exp2((double)a * LSB));
+
+    sweep_end(&log2_s);
+    sweep_end(&log2_ref);
+    sweep_end(&exp2_pos);
+    sweep_end(&exp2_neg);
+    sweep_end(&exp2_ref);
+}
+
+//
+// The split multiplications must be bit exact compared to q16_16_multiply()
+// for every factor, including the products which wrap.
+//
+static void test_split_multiply(void)
+{
+    sweep_t q2_14;
+    sweep_t q1_15;
+    uint32_t i;
+    int32_t b;
+
+    sweep_start(&q2_14, "q16_16_multiply_q2_14", 1.0, "wraps");
+    sweep_start(&q1_15, "q16_16_multiply_q1_15", 1.0, "wraps");
+
+    for (i = 0; i < RANDOM_SAMPLES / 65536 + 1; i++)
+    {
+        q16_16_t a = random_q16_16();
+
+        for (b = INT16_MIN; b <= INT16_MAX; b++)
+        {
+            q16_16_t p;
+            double exact;
+
+            p = q16_16_multiply_q2_14(a, (q2_14_t)b);
+            exact = (double)a * (double)b / 16384.0;
+
+            if (p != q16_16_multiply(a, q2_14_to_q16_16((q2_14_t)b)))
+            {
+                // Counted as a failure even if the product is in range
+                sweep_add_out_of_range(&q2_14, false);
+            }
+            else if ((exact >= (double)INT32_MAX + 1.0) ||
+                     (exact < (double)INT32_MIN))
+            {
+                sweep_add_out_of_range(&q2_14, true);
+            }
+            else
+            {
+                sweep_add(&q2_14, (double)p, exact);
+            }
+
+            p = q16_16_multiply_q1_15(a, (q1_15_t)b);
+            exact = (double)a * (double)b / 32768.0;
+
+            if (p != q16_16_multiply(a, q1_15_to_q16_16((q1_15_t)b)))
+            {
+                sweep_add_out_of_range(&q1_15, false);
+            }
+            else if ((exact >= (double)INT32_MAX + 1.0) ||
+                     (exact < (double)INT32_MIN))
+            {
+                sweep_add_out_of_range(&q1_15, true);
+            }
+            else
+            {
+                sweep_add(&q1_15, (double)p, exact);
+            }
+        }
+    }
+
+    bench_fill(false);
+    BENCHMARK(&q2_14, q16_16_t, q16_16_multiply_q2_14(a, (q2_14_t)b));
+    BENCHMARK(&q1_15, q16_16_t, q16_16_multiply_q1_15(a, (q1_15_t)b));
+
+    sweep_end(&q2_14);
+    sweep_end(&q1_15);
+}
+
+//
+// The 16 bit products round towards minus infinity, out of range products
+// saturate.
+//
+static void test_multiply_16(void)
+{
+    static const int16_t EDGES[] = {INT16_MIN, INT16_MIN + 1, -1, INT16_MAX};
+    sweep_t s[NBR_OF_MULTIPLY_16];
+    uint32_t a;
+    uint8_t i;
+
+    sweep_start(&s[MULTIPLY_Q1_15], "q1_15_multiply", 1.0, "saturates");
+    sweep_start(&s[MULTIPLY_Q2_14], "q2_14_multiply", 1.0, "saturates");
+    sweep_start(&s[MULTIPLY_Q8_8], "q8_8_multiply", 1.0, "saturates");
+    sweep_start(&s[MULTIPLY_Q8_8_Q1_15], "q8_8_multiply_q1_15", 1.0,
+                "saturates");
+    sweep_start(&s[MULTIPLY_Q8_8_Q2_14], "q8_8_multiply_q2_14", 1.0, "");
+
+    // Every second factor, with the stride on the first factor
+    for (a = 0; a < 65536; a += stride > 1 ? 7 : 1)
+    {
+        test_multiply_16_factor(s, (int16_t)a);
+    }
+
+    for (i = 0; i < sizeof(EDGES) / sizeof(EDGES[0]); i++)
+    {
+        test_multiply_16_factor(s, EDGES[i]);
+    }
+
+    bench_fill(false);
+    BENCHMARK(&s[MULTIPLY_Q1_15], int32_t,
+              q1_15_multiply((q1_15_t)a, (q1_15_t)b));
+    BENCHMARK(&s[MULTIPLY_Q2_14], int32_t,
+              q2_14_multiply((q2_14_t)a, (q2_14_t)b));
+    BENCHMARK(&s[MULTIPLY_Q8_8], int32_t,
+              q8_8_multiply((q8_8_t)a, (q8_8_t)b));
+    BENCHMARK(&s[MULTIPLY_Q8_8_Q1_15], int32_t,
+              q8_8_multiply_q1_15((q8_8_t)a, (q1_15_t)b));
+    BENCHMARK(&s[MULTIPLY_Q8_8_Q2_14], q16_16_t,
+              q8_8_multiply_q2_14((q8_8_t)a, (q2_14_t)b));
+
+    for (i = 0; i < NBR_OF_MULTIPLY_16; i++)
+    {
+        sweep_end(&s[i]);
+    }
+}
+
+static void test_multiply_16_factor(sweep_t * s, int16_t x)
+{
+    int32_t y;
+
+    for (y = INT16_MIN; y <= INT16_MAX; y++)
+    {
+        double p = (double)x * (double)y;
+
+        check_multiply_16(&s[MULTIPLY_Q1_15], q1_15_multiply(x, y),
+                          p / 32768.0, Q1_15_MAX, Q1_15_MIN);
+        check_multiply_16(&s[MULTIPLY_Q8_8_Q1_15], q8_8_multiply_q1_15(x, y),
+                          p / 32768.0, Q8_8_MAX, Q8_8_MIN);
+        check_multiply_16(&s[MULTIPLY_Q2_14], q2_14_multiply(x, y),
+                          p / 16384.0, Q2_14_MAX, Q2_14_MIN);
+        check_multiply_16(&s[MULTIPLY_Q8_8], q8_8_multiply(x, y),
+                          p / 256.0, Q8_8_MAX, Q8_8_MIN);
+        sweep_add(&s[MULTIPLY_Q8_8_Q2_14], (double)q8_8_multiply_q2_14(x, y),
+                  p / 64.0);
+    }
+}
+
+static void check_multiply_16(sweep_t * s,
+                              int16_t result,
+                              double exact,
+                              int16_t max,
+                              int16_t min)
+{
+    if ((exact >= (double)max + 1.0) || (exact < (double)min))
+    {
+        sweep_add_out_of_range(s, result == (exact > 0 ? max : min));
+    }
+    else
+    {
+        sweep_add(s, (double)result, exact);
+    }
+}
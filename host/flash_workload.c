@@ -0,0 +1,588 @@
+/*
+ * Host workload of the program memory users, flash.c, profile.c and
+ * recorder.c, run against the file backed emulator in nvm_host.c.
+ *
+ * Three workloads are run on a blank device, and the erases, programs and
+ * CPU stall time of each are reported per region:
+ *
+ * - A tuning session: PID parameters, filter lengths, profile selections,
+ *   phase starts and a segment program are changed from the terminal, each
+ *   change committed by the main loop as on the device.
+ * - 50 edits of two segment programs, taking turns, each of which
+ *   alternately shrinks and grows to PROFILE_MAX_SEGMENTS segments. Every
+ *   edit must fit, and the other profiles must load the same points
+ *   afterwards.
+ * - 100 reflow runs of 300 s, recorded at 10 Hz with recorder_service()
+ *   called after each sample like handle_pid_event() does. The samples of
+ *   the last run must read back within the recorded resolution.
+ * - Power losses injected during commits: between the erase and the first
+ *   row program of a data block, halfway through its row programs, between
+ *   a logged parameter and the CRC record, and between the programmed data
+ *   block and the log erase. After each the device is restarted and it is
+ *   reported whether the parameters hold the new or the old values, or were
+ *   replaced by the defaults.
+ *
+ * Any other result than the new or the old values fails the workload. The
+ * device is restarted once more after the next commit to check that it is
+ * kept too.
+ *
+ * Build and run with
+ *   make -C host workload
+ */
+
+// =============================================================================
+// Include statements
+// =============================================================================
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "fixed_point.h"
+#include "flash.h"
+#include "nvm.h"
+#include "nvm_host.h"
+#include "params.h"
+#include "profile.h"
+#include "recorder.h"
+
+// =============================================================================
+// Private type definitions
+// =============================================================================
+
+// =============================================================================
+// Private constants
+// =============================================================================
+
+#define DEFAULT_PATH        "flash_workload.bin"
+
+#define NBR_OF_PROGRAM_EDITS 50
+#define NBR_OF_REFLOWS      100
+#define REFLOW_SECONDS      300
+
+// Number of data block rows, programmed after the erase by a full commit
+#define DATA_ROWS           (FLASH_MEM_SIZE / (NVM_INSTRUCTIONS_PER_ROW * 2))
+
+static const char * const REGION_NAMES[NVM_NBR_OF_REGIONS] =
+{
+    "data", "log", "record"
+};
+
+static const char * const OP_NAMES[NVM_HOST_NBR_OF_OPS] =
+{
+    "erases", "row programs", "word programs"
+};
+
+// =============================================================================
+// Private variables
+// =============================================================================
+
+// Longest stall of a single commit or control tick in the current workload
+static uint64_t max_stall_us = 0;
+
+static uint16_t nbr_of_failed = 0;
+
+// =============================================================================
+// Private function declarations
+// =============================================================================
+
+/**
+ * @brief Restarts the device from what is in the program memory file.
+ */
+static void boot(void);
+
+/**
+ * @brief Commits requested flash writes like the main loop does, and keeps
+ * track of the longest stall.
+ */
+static void main_loop_commit(void);
+
+/**
+ * @brief Runs the tuning session workload.
+ */
+static void run_tuning_session(void);
+
+/**
+ * @brief Runs the program edit workload.
+ */
+static void run_program_edits(void);
+
+/**
+ * @brief Loads the first profiles and sums up their points.
+ * @param nbr_of_profiles - Number of profiles.
+ * @return A checksum of the points.
+ */
+static uint32_t profile_checksum(uint8_t nbr_of_profiles);
+
+/**
+ * @brief Records reflow runs.
+ * @param nbr_of_runs - Number of runs.
+ */
+static void run_reflows(uint16_t nbr_of_runs);
+
+/**
+ * @brief Gets one sample of a recorded reflow run.
+ * @param run - Index of the run.
+ * @param i - Index of the sample.
+ * @param sample - Where to store the sample.
+ */
+static void get_reflow_sample(uint16_t run, uint16_t i,
+                              recorder_sample_t * sample);
+
+/**
+ * @brief Reads back the last recorded run and compares it with the
+ * recorded samples.
+ * @param run - Index of the run.
+ */
+static void check_reflow(uint16_t run);
+
+/**
+ * @brief Injects a power loss during a commit, restarts and reports what
+ * was kept.
+ * @param name - Description of the commit.
+ * @param op - Type of the operation after which the power is lost.
+ * @param count - Number of such operations which complete first.
+ * @param full_commit - True to also change a phase start, which is outside
+ * the parameter area, so that the whole data block is written.
+ */
+static void run_power_loss(const char * name,
+                           nvm_host_op_t op,
+                           uint32_t count,
+                           bool full_commit);
+
+/**
+ * @brief Prints the counters of the emulator and resets them.
+ * @param name - Name of the workload.
+ */
+static void report(const char * name);
+
+// =============================================================================
+// Public function definitions
+// =============================================================================
+
+int main(int argc, char ** argv)
+{
+    const char * path = (argc > 1) ? argv[1] : DEFAULT_PATH;
+
+    // Start from a blank device
+    unlink(path);
+
+    if (!nvm_host_open(path))
+    {
+        printf("Could not open %s\n", path);
+        return 1;
+    }
+
+    boot();
+    report("first boot, defaults");
+
+    run_tuning_session();
+    report("tuning session");
+
+    run_program_edits();
+    report("50 program edits");
+
+    run_reflows(NBR_OF_REFLOWS);
+    report("100 reflows");
+
+    printf("\npower loss during a commit, then restart:\n");
+    run_power_loss("erase -> row program of the data block",
+                   NVM_HOST_OP_ERASE, 1, true);
+    run_power_loss("halfway through the data block rows",
+                   NVM_HOST_OP_ROW_PROGRAM, DATA_ROWS / 2, true);
+    run_power_loss("logged parameter -> CRC record",
+                   NVM_HOST_OP_WORD_PROGRAM, 1, false);
+    run_power_loss("data block programmed -> log erase",
+                   NVM_HOST_OP_ROW_PROGRAM, DATA_ROWS, true);
+
+    nvm_host_close();
+    unlink(path);
+
+    return (0 == nbr_of_failed) ? 0 : 1;
+}
+
+// =============================================================================
+// Private function definitions
+// =============================================================================
+
+static void boot(void)
+{
+    uint64_t stall_us = nvm_host_get_stats()->stall_us;
+
+    flash_init();
+    params_init();
+    recorder_init();
+
+    stall_us = nvm_host_get_stats()->stall_us - stall_us;
+
+    if (stall_us > max_stall_us)
+    {
+        max_stall_us = stall_us;
+    }
+}
+
+static void main_loop_commit(void)
+{
+    uint64_t stall_us = nvm_host_get_stats()->stall_us;
+
+    if (flash_is_commit_requested())
+    {
+        flash_write_buffer_to_flash();
+    }
+
+    stall_us = nvm_host_get_stats()->stall_us - stall_us;
+
+    if (stall_us > max_stall_us)
+    {
+        max_stall_us = stall_us;
+    }
+}
+
+static void run_tuning_session(void)
+{
+    static const profile_segment_t SEGMENTS[] =
+    {
+        {150, 15, 0, PROFILE_NO_PHASE},
+        {180, 5, 30, TEMP_CURVE_PHASE_SOAK},
+        {245, 20, 10, TEMP_CURVE_PHASE_REFLOW},
+        {50, 0, 60, TEMP_CURVE_PHASE_COOL}
+    };
+    uint16_t i;
+
+    // Step responses with a few values of each PID parameter
+    for (i = 0; i != 10; ++i)
+    {
+        params_set_k(DOUBLE_TO_Q16_16(2.0) + (q16_16_t)i * 0x2000);
+        main_loop_commit();
+        params_set_ti(INT_TO_Q16_16(60 + 5 * i));
+        main_loop_commit();
+        params_set_td(DOUBLE_TO_Q16_16(0.5) + (q16_16_t)i * 0x1000);
+        main_loop_commit();
+    }
+
+    params_set_ttr(INT_TO_Q16_16(30));
+    main_loop_commit();
+    params_set_d_max_gain(INT_TO_Q16_16(8));
+    main_loop_commit();
+
+    for (i = 0; i != 3; ++i)
+    {
+        params_set_filter_len(8 << i);
+        main_loop_commit();
+    }
+
+    // Switch between the profiles and adjust one of them
+    for (i = 0; i != 4; ++i)
+    {
+        profile_select(TEMP_CURVE_LEAD_FREE, (uint8_t)(i & 1));
+        main_loop_commit();
+    }
+
+    profile_set_phase_start(0, TEMP_CURVE_PHASE_REFLOW, 170);
+    main_loop_commit();
+    profile_set_phase_start(0, TEMP_CURVE_PHASE_COOL, 230);
+    main_loop_commit();
+
+    profile_write_program(profile_get_count(), "tuned", 25, SEGMENTS,
+                          sizeof(SEGMENTS) / sizeof(SEGMENTS[0]));
+    main_loop_commit();
+}
+
+static void run_program_edits(void)
+{
+    profile_segment_t segments[PROFILE_MAX_SEGMENTS];
+    uint8_t first_edited = profile_get_count();
+    uint32_t checksum = profile_checksum(first_edited);
+    uint16_t nbr_of_written = 0;
+    uint16_t i;
+
+    for (i = 0; i != PROFILE_MAX_SEGMENTS; ++i)
+    {
+        segments[i].target = 100 + 7 * i;
+        segments[i].rate = 10;
+        segments[i].hold = (uint8_t)i;
+        segments[i].phase = PROFILE_NO_PHASE;
+    }
+
+    profile_write_program(first_edited, "edit1", 25, segments, 2);
+    main_loop_commit();
+    profile_write_program(first_edited + 1, "edit2", 25, segments, 2);
+    main_loop_commit();
+
+    // A program which grows never fits in its old place, and each one has
+    // the other after it half of the time
+    for (i = 0; i != NBR_OF_PROGRAM_EDITS; ++i)
+    {
+        uint8_t nbr_of_segments = (i & 2) ? PROFILE_MAX_SEGMENTS : 2;
+
+        if (profile_write_program(first_edited + (i & 1), "edit", 25,
+                                  segments, nbr_of_segments))
+        {
+            ++nbr_of_written;
+        }
+
+        main_loop_commit();
+    }
+
+    boot();
+
+    printf("\n%u of %u program edits written, other profiles %s\n",
+           nbr_of_written, NBR_OF_PROGRAM_EDITS,
+           (profile_checksum(first_edited) == checksum) ? "kept" : "changed");
+
+    if ((NBR_OF_PROGRAM_EDITS != nbr_of_written) ||
+        (profile_checksum(first_edited) != checksum))
+    {
+        printf("FAILED\n");
+        ++nbr_of_failed;
+    }
+}
+
+static uint32_t profile_checksum(uint8_t nbr_of_profiles)
+{
+    temp_curve_calib_point_t points[PROFILE_MAX_POINTS + 1];
+    uint16_t phase_start[TEMP_CURVE_NBR_OF_PHASES];
+    uint32_t checksum = 0;
+    uint8_t index;
+    uint8_t n;
+    uint8_t i;
+
+    for (index = 0; index != nbr_of_profiles; ++index)
+    {
+        n = profile_load(index, points, PROFILE_MAX_POINTS + 1, phase_start);
+
+        for (i = 0; i != n; ++i)
+        {
+            checksum = checksum * 31 + (uint32_t)points[i].temp +
+                       points[i].time;
+        }
+    }
+
+    return checksum;
+}
+
+static void run_reflows(uint16_t nbr_of_runs)
+{
+    recorder_sample_t sample;
+    uint16_t run;
+    uint16_t i;
+
+    for (run = 0; run != nbr_of_runs; ++run)
+    {
+        uint64_t stall_us = nvm_host_get_stats()->stall_us;
+
+        get_reflow_sample(run, 0, &sample);
+        recorder_start_run(0, &sample);
+
+        stall_us = nvm_host_get_stats()->stall_us - stall_us;
+
+        if (stall_us > max_stall_us)
+        {
+            max_stall_us = stall_us;
+        }
+
+        for (i = 0; i != REFLOW_SECONDS * RECORDER_SAMPLE_RATE; ++i)
+        {
+            get_reflow_sample(run, i, &sample);
+
+            stall_us = nvm_host_get_stats()->stall_us;
+
+            recorder_add_sample(&sample);
+            recorder_service();
+
+            stall_us = nvm_host_get_stats()->stall_us - stall_us;
+
+            if (stall_us > max_stall_us)
+            {
+                max_stall_us = stall_us;
+            }
+        }
+
+        recorder_stop_run();
+    }
+
+    check_reflow(nbr_of_runs - 1);
+}
+
+static void get_reflow_sample(uint16_t run, uint16_t i,
+                              recorder_sample_t * sample)
+{
+    // A slow ramp to 245 C and back with some noise, the heater and the
+    // servo both in use while cooling
+    uint16_t target = (i < 2000) ? (uint16_t)(100 + i * 44UL / 100) :
+                                   (uint16_t)(980 - (i - 2000) / 2);
+
+    sample->target = target;
+    sample->temp = target + (uint16_t)((i * 7 + run) % 9) - 4;
+    sample->duty = (uint8_t)(i % 51);
+    sample->servo = (i < 2000) ? 0 : (uint16_t)(i % 1201);
+}
+
+static void check_reflow(uint16_t run)
+{
+    recorder_run_t runs[RECORDER_MAX_RUNS];
+    recorder_sample_t expected;
+    recorder_sample_t sample;
+    uint8_t nbr_of_runs = recorder_get_runs(runs, RECORDER_MAX_RUNS);
+    uint16_t nbr_of_matching = 0;
+    uint16_t i = 0;
+
+    if ((0 != nbr_of_runs) &&
+        recorder_open_run(runs[nbr_of_runs - 1].number))
+    {
+        while (recorder_read_sample(&sample))
+        {
+            get_reflow_sample(run, i++, &expected);
+
+            if ((sample.temp == expected.temp) &&
+                (sample.target == expected.target) &&
+                (abs(sample.duty - expected.duty) <=
+                 RECORDER_DUTY_SCALE / 2) &&
+                (abs(sample.servo - expected.servo) <=
+                 RECORDER_SERVO_SCALE / 2))
+            {
+                ++nbr_of_matching;
+            }
+        }
+    }
+
+    printf("\n%u of %u samples of the last run read back\n", nbr_of_matching,
+           REFLOW_SECONDS * RECORDER_SAMPLE_RATE);
+
+    if (REFLOW_SECONDS * RECORDER_SAMPLE_RATE != nbr_of_matching)
+    {
+        printf("FAILED\n");
+        ++nbr_of_failed;
+    }
+}
+
+static void run_power_loss(const char * name,
+                           nvm_host_op_t op,
+                           uint32_t count,
+                           bool full_commit)
+{
+    q16_16_t ti = params_get()->ti;
+    q16_16_t old_k = params_get()->k;
+    q16_16_t new_k = old_k + Q16_16_T_ONE;
+    uint16_t cool_start = profile_get_phase_start(0, TEMP_CURVE_PHASE_COOL);
+    const char * result;
+    bool failed = false;
+
+    params_set_k(new_k);
+
+    if (full_commit)
+    {
+        profile_set_phase_start(0, TEMP_CURVE_PHASE_COOL, cool_start ^ 1);
+    }
+
+    nvm_host_cut_power(op, count);
+    main_loop_commit();
+
+    // The power was lost during the commit, start again
+    nvm_host_power_on();
+    boot();
+
+    if (params_get()->ti != ti)
+    {
+        result = "replaced by the defaults";
+        failed = true;
+    }
+    else if (params_get()->k == new_k)
+    {
+        result = "new values";
+    }
+    else if (params_get()->k == old_k)
+    {
+        result = "old values";
+    }
+    else
+    {
+        result = "corrupted";
+        failed = true;
+    }
+
+    // Make the parameters distinguishable from the defaults again, and check
+    // that this commit survives a restart
+    old_k = params_get()->k;
+    params_set_ti(ti);
+    main_loop_commit();
+    boot();
+
+    if ((params_get()->ti != ti) || (params_get()->k != old_k))
+    {
+        result = "lost the next commit";
+        failed = true;
+    }
+
+    printf("  %-42s %s%s\n", name, result, failed ? ", FAILED" : "");
+
+    if (failed)
+    {
+        ++nbr_of_failed;
+    }
+
+    nvm_host_reset_stats();
+}
+
+static void report(const char * name)
+{
+    const nvm_host_stats_t * stats = nvm_host_get_stats();
+    uint32_t max_erases = 0;
+    uint16_t region;
+    uint16_t block;
+    uint8_t op;
+
+    printf("\n%s:\n", name);
+
+    for (region = 0; region != NVM_NBR_OF_REGIONS; ++region)
+    {
+        uint16_t nbr_of_blocks = (NVM_REGION_DATA == region) ? NVM_DATA_BLOCKS :
+                                 (NVM_REGION_LOG == region) ? NVM_LOG_BLOCKS :
+                                                              NVM_RECORD_BLOCKS;
+
+        printf("  %-8s", REGION_NAMES[region]);
+
+        for (op = 0; op != NVM_HOST_NBR_OF_OPS; ++op)
+        {
+            uint32_t sum = 0;
+
+            for (block = 0; block != nbr_of_blocks; ++block)
+            {
+                sum += stats->ops[nvm_host_get_block((nvm_region_t)region,
+                                                     block)][op];
+            }
+
+            printf(" %6lu %s", (unsigned long)sum, OP_NAMES[op]);
+        }
+
+        printf("\n");
+
+        for (block = 0; block != nbr_of_blocks; ++block)
+        {
+            uint32_t erases = stats->ops[nvm_host_get_block(
+                    (nvm_region_t)region, block)][NVM_HOST_OP_ERASE];
+
+            if (erases > max_erases)
+            {
+                max_erases = erases;
+            }
+        }
+    }
+
+    printf("  stall %.1f ms in total, %.1f ms at most at once, "
+           "%lu erases of the most worn block (endurance %u)\n",
+           (double)stats->stall_us / 1000.0, (double)max_stall_us / 1000.0,
+           (unsigned long)max_erases, NVM_HOST_ENDURANCE);
+
+    if ((0 != stats->bad_programs) || (0 != stats->dropped_ops))
+    {
+        printf("  %lu programs of instructions which were not erased, "
+               "%lu operations dropped\n", (unsigned long)stats->bad_programs,
+               (unsigned long)stats->dropped_ops);
+    }
+
+    nvm_host_reset_stats();
+    max_stall_us = 0;
+}
@@ -0,0 +1,313 @@
+// =============================================================================
+// Include statements
+// =============================================================================
+
+// For ftruncate() and mmap() in strict C99 builds
+#define _POSIX_C_SOURCE 200809L
+
+#include "nvm_host.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "nvm.h"
+
+// =============================================================================
+// Private type definitions
+// =============================================================================
+
+// =============================================================================
+// Global variables
+// =============================================================================
+
+// =============================================================================
+// Private constants
+// =============================================================================
+
+#define ERASED_INSTRUCTION      0x00FFFFFFu
+
+#define DATA_INSTRUCTIONS       (NVM_DATA_BLOCKS * NVM_INSTRUCTIONS_PER_ERASE_BLOCK)
+#define LOG_INSTRUCTIONS        (NVM_LOG_BLOCKS * NVM_INSTRUCTIONS_PER_ERASE_BLOCK)
+#define RECORD_INSTRUCTIONS     (NVM_RECORD_BLOCKS *                           \
+                                 NVM_INSTRUCTIONS_PER_ERASE_BLOCK)
+#define FILE_SIZE               ((DATA_INSTRUCTIONS + LOG_INSTRUCTIONS +       \
+                                  RECORD_INSTRUCTIONS) * sizeof(uint32_t))
+
+// First instruction of each region in the file
+static const uint32_t REGION_START[NVM_NBR_OF_REGIONS] =
+{
+    0, DATA_INSTRUCTIONS, DATA_INSTRUCTIONS + LOG_INSTRUCTIONS
+};
+
+// First erase block of each region, see nvm_host_get_block()
+static const uint16_t REGION_FIRST_BLOCK[NVM_NBR_OF_REGIONS] =
+{
+    0, NVM_DATA_BLOCKS, NVM_DATA_BLOCKS + NVM_LOG_BLOCKS
+};
+
+// =============================================================================
+// Private variables
+// =============================================================================
+
+static uint32_t * memory = NULL;
+
+static nvm_host_stats_t stats;
+
+static bool powered = true;
+static bool power_cut_armed = false;
+static nvm_host_op_t power_cut_op;
+static uint32_t power_cut_count;
+
+// =============================================================================
+// Private function declarations
+// =============================================================================
+
+/**
+ * @brief Gets one instruction of the mapped file.
+ * @param region - The region.
+ * @param instr - Index of the instruction within the region.
+ * @return Pointer to the instruction.
+ */
+static uint32_t * instruction(nvm_region_t region, uint16_t instr);
+
+/**
+ * @brief Checks if an operation may be performed, drops it without power.
+ * @return True if the operation should be performed.
+ */
+static bool begin_op(void);
+
+/**
+ * @brief Counts a completed operation and loses power if armed for it.
+ * @param op - Type of the operation.
+ * @param block - Index of the erase block, see nvm_host_get_block().
+ * @param stall_us - Time the CPU is stalled by the operation.
+ */
+static void end_op(nvm_host_op_t op, uint16_t block, uint32_t stall_us);
+
+/**
+ * @brief Programs one instruction, programming can only clear bits.
+ * @param instr - The instruction.
+ * @param value - The 24 bit value.
+ */
+static void program(uint32_t * instr, uint32_t value);
+
+// =============================================================================
+// Public function definitions
+// =============================================================================
+
+bool nvm_host_open(const char * path)
+{
+    struct stat st;
+    bool is_new;
+    void * map;
+    int fd;
+    uint32_t i;
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    if ((0 != fstat(fd, &st)) ||
+        ((st.st_size != FILE_SIZE) && (0 != ftruncate(fd, FILE_SIZE))))
+    {
+        close(fd);
+        return false;
+    }
+
+    is_new = (st.st_size != FILE_SIZE);
+
+    map = mmap(NULL, FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (MAP_FAILED == map)
+    {
+        return false;
+    }
+
+    memory = (uint32_t *)map;
+
+    if (is_new)
+    {
+        // As programmed into the device, the log and recorder are not loaded
+        for (i = 0; i != DATA_INSTRUCTIONS; ++i)
+        {
+            memory[i] = 0;
+        }
+
+        for (i = DATA_INSTRUCTIONS; i != FILE_SIZE / sizeof(uint32_t); ++i)
+        {
+            memory[i] = ERASED_INSTRUCTION;
+        }
+    }
+
+    nvm_host_reset_stats();
+    nvm_host_power_on();
+
+    return true;
+}
+
+void nvm_host_close(void)
+{
+    if (NULL != memory)
+    {
+        msync(memory, FILE_SIZE, MS_SYNC);
+        munmap(memory, FILE_SIZE);
+        memory = NULL;
+    }
+}
+
+const nvm_host_stats_t * nvm_host_get_stats(void)
+{
+    return &stats;
+}
+
+void nvm_host_reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+uint16_t nvm_host_get_block(nvm_region_t region, uint16_t block)
+{
+    return REGION_FIRST_BLOCK[region] + block;
+}
+
+void nvm_host_cut_power(nvm_host_op_t op, uint32_t count)
+{
+    power_cut_armed = (0 != count);
+    power_cut_op = op;
+    power_cut_count = count;
+}
+
+bool nvm_host_is_powered(void)
+{
+    return powered;
+}
+
+void nvm_host_power_on(void)
+{
+    powered = true;
+    power_cut_armed = false;
+}
+
+uint16_t nvm_read_low(nvm_region_t region, uint16_t instr)
+{
+    return (uint16_t)*instruction(region, instr);
+}
+
+uint8_t nvm_read_high(nvm_region_t region, uint16_t instr)
+{
+    return (uint8_t)(*instruction(region, instr) >> 16);
+}
+
+void nvm_erase_block(nvm_region_t region, uint16_t block)
+{
+    uint32_t * first = instruction(region,
+                                   block * (uint16_t)NVM_INSTRUCTIONS_PER_ERASE_BLOCK);
+    uint16_t i;
+
+    if (!begin_op())
+    {
+        return;
+    }
+
+    for (i = 0; i != NVM_INSTRUCTIONS_PER_ERASE_BLOCK; ++i)
+    {
+        first[i] = ERASED_INSTRUCTION;
+    }
+
+    end_op(NVM_HOST_OP_ERASE,
+           nvm_host_get_block(region, block),
+           NVM_HOST_ERASE_US);
+}
+
+void nvm_program_row(nvm_region_t region,
+                     uint16_t row,
+                     const uint16_t * data,
+                     const uint8_t * high)
+{
+    uint32_t * first = instruction(region,
+                                   row * (uint16_t)NVM_INSTRUCTIONS_PER_ROW);
+    uint16_t i;
+
+    if (!begin_op())
+    {
+        return;
+    }
+
+    for (i = 0; i != NVM_INSTRUCTIONS_PER_ROW; ++i)
+    {
+        program(&first[i],
+                ((uint32_t)((NULL != high) ? high[i] : 0) << 16) | data[i]);
+    }
+
+    end_op(NVM_HOST_OP_ROW_PROGRAM,
+           nvm_host_get_block(region, row / NVM_ROWS_PER_ERASE_BLOCK),
+           NVM_HOST_ROW_PROGRAM_US);
+}
+
+void nvm_program_word(nvm_region_t region,
+                      uint16_t instr,
+                      uint16_t low,
+                      uint8_t high)
+{
+    if (!begin_op())
+    {
+        return;
+    }
+
+    program(instruction(region, instr), ((uint32_t)high << 16) | low);
+
+    end_op(NVM_HOST_OP_WORD_PROGRAM,
+           nvm_host_get_block(region, instr / NVM_INSTRUCTIONS_PER_ERASE_BLOCK),
+           NVM_HOST_WORD_PROGRAM_US);
+}
+
+// =============================================================================
+// Private function definitions
+// =============================================================================
+
+static uint32_t * instruction(nvm_region_t region, uint16_t instr)
+{
+    return &memory[REGION_START[region] + instr];
+}
+
+static bool begin_op(void)
+{
+    if (!powered)
+    {
+        ++stats.dropped_ops;
+    }
+
+    return powered;
+}
+
+static void end_op(nvm_host_op_t op, uint16_t block, uint32_t stall_us)
+{
+    ++stats.ops[block][op];
+    stats.stall_us += stall_us;
+
+    if (power_cut_armed && (op == power_cut_op) && (0 == --power_cut_count))
+    {
+        power_cut_armed = false;
+        powered = false;
+    }
+}
+
+static void program(uint32_t * instr, uint32_t value)
+{
+    if (ERASED_INSTRUCTION != *instr)
+    {
+        ++stats.bad_programs;
+    }
+
+    *instr &= value & ERASED_INSTRUCTION;
+}
@@ -0,0 +1,146 @@
+/*
+ * This file implements nvm.h for host builds, on a memory mapped file.
+ *
+ * The file holds every region of nvm.h, one uint32_t per instruction, so the
+ * contents survive between runs like the program memory of the device. A new
+ * file is initialized the way the device is programmed: the data blocks to 0
+ * and the log and the recorder erased.
+ *
+ * The same constraints as on the device apply: erases are done per erase
+ * block and rows are programmed whole, and programming can only clear bits.
+ * Erases and programs are counted per erase block, together with the
+ * estimated time the CPU would have been stalled, so the wear and the stall
+ * cost of a sequence of flash.h calls can be measured.
+ *
+ * A power loss can be injected after a given number of operations, for
+ * example between the erase and the first row program of a block write.
+ * Operations are then dropped until nvm_host_power_on() is called, after
+ * which flash_init() restarts from what is in the file.
+ *
+ * Build together with flash.c, for example:
+ *   gcc -I. -Ihost flash.c profile.c fixed_point.c host/nvm_host.c app.c
+ */
+
+#ifndef NVM_HOST_H
+#define	NVM_HOST_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+// =============================================================================
+// Include statements
+// =============================================================================
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nvm.h"
+
+// =============================================================================
+// Public type definitions
+// =============================================================================
+
+typedef enum
+{
+    NVM_HOST_OP_ERASE = 0,
+    NVM_HOST_OP_ROW_PROGRAM,
+    NVM_HOST_OP_WORD_PROGRAM,
+    NVM_HOST_NBR_OF_OPS
+} nvm_host_op_t;
+
+#define NVM_HOST_NBR_OF_BLOCKS  (NVM_DATA_BLOCKS + NVM_LOG_BLOCKS +            \
+                                 NVM_RECORD_BLOCKS)
+
+typedef struct nvm_host_stats_t
+{
+    // Completed operations per erase block, see nvm_host_get_block()
+    uint32_t ops[NVM_HOST_NBR_OF_BLOCKS][NVM_HOST_NBR_OF_OPS];
+
+    // Programs of instructions which were not erased
+    uint32_t bad_programs;
+
+    // Operations dropped because the power was lost
+    uint32_t dropped_ops;
+
+    // Estimated time the CPU was stalled by the operations, in us
+    uint64_t stall_us;
+} nvm_host_stats_t;
+
+// =============================================================================
+// Global variable declarations
+// =============================================================================
+
+// =============================================================================
+// Global constatants
+// =============================================================================
+
+// Typical self-timed write cycle time TIW, DS39747D
+#define NVM_HOST_ERASE_US           3000
+#define NVM_HOST_ROW_PROGRAM_US     3000
+#define NVM_HOST_WORD_PROGRAM_US    3000
+
+// Minimum cell endurance in erase/write cycles, DS39747D
+#define NVM_HOST_ENDURANCE          1000
+
+// =============================================================================
+// Public function declarations
+// =============================================================================
+
+/**
+ * @brief Maps the program memory file, it is created if needed.
+ * @param path - Path of the file.
+ * @return False if the file could not be opened or mapped.
+ */
+bool nvm_host_open(const char * path);
+
+/**
+ * @brief Unmaps the program memory file.
+ */
+void nvm_host_close(void);
+
+/**
+ * @brief Gets the counters, accumulated since the last reset.
+ * @return The counters.
+ */
+const nvm_host_stats_t * nvm_host_get_stats(void);
+
+/**
+ * @brief Resets the counters.
+ */
+void nvm_host_reset_stats(void);
+
+/**
+ * @brief Gets the index used for an erase block in nvm_host_stats_t.
+ * @param region - The region.
+ * @param block - Index of the erase block within the region.
+ * @return Index of the erase block, data blocks first, then the log and the
+ * recorder.
+ */
+uint16_t nvm_host_get_block(nvm_region_t region, uint16_t block);
+
+/**
+ * @brief Injects a power loss.
+ * @param op - Type of the operation after which the power is lost.
+ * @param count - Number of operations of that type which complete first,
+ * 1 to lose power right after the next one.
+ */
+void nvm_host_cut_power(nvm_host_op_t op, uint32_t count);
+
+/**
+ * @brief Checks if the power has been lost.
+ * @return False after an injected power loss, until nvm_host_power_on().
+ */
+bool nvm_host_is_powered(void);
+
+/**
+ * @brief Restores the power and disarms any injected power loss.
+ */
+void nvm_host_power_on(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* NVM_HOST_H */
+
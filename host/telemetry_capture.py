@@ -0,0 +1,419 @@
+# This script captures the binary telemetry stream of the controller, see
+# telemetry.h, from a serial port or a pty.
+#
+# Each signal is appended to its own file in the output directory, as a raw
+# little endian array, so analysis scripts can map the files directly:
+#
+#   temp = numpy.memmap("run/temp.u16", dtype="<u2", mode="r") * 0.25
+#
+# columns.txt in the output directory lists the files with their numpy type
+# and the scale which gives the value in C, ms or percent. While capturing,
+# rolling statistics of the last seconds are written once per second. Lost
+# records are found from gaps in the sequence numbers, bad frames include
+# terminal answers sent between the records.
+#
+# The controller has to be switched to binary mode first with
+# "set telemetry binary", and to a faster link with "set baud <rate>".
+#
+# Usage:
+#   python3 telemetry_capture.py /dev/ttyUSB0 run --baud 115200
+#
+# A fake device which sends generated records on a pty can be started with
+#   python3 telemetry_capture.py --fake --rate 1000
+# and captured from the pty path it prints.
+
+import argparse
+import array
+import binascii
+import collections
+import math
+import os
+import pty
+import select
+import struct
+import sys
+import termios
+import time
+import tty
+
+RECORD_CONTROL = 0x01
+RECORD_FORMAT = struct.Struct("<BBIHHiiiiBHB")
+RECORD_SIZE = RECORD_FORMAT.size + 2
+CRC16_INIT = 0xFFFF
+
+# Name, array type code, numpy type and scale of each field of the record
+COLUMNS = [
+    ("type",     "B", "u1", 1),
+    ("sequence", "B", "u1", 1),
+    ("time",     "I", "<u4", 1),
+    ("raw_temp", "H", "<u2", 0.25),
+    ("temp",     "H", "<u2", 0.25),
+    ("target",   "i", "<i4", 1 / 65536),
+    ("p",        "i", "<i4", 1 / 65536),
+    ("i",        "i", "<i4", 1 / 65536),
+    ("d",        "i", "<i4", 1 / 65536),
+    ("duty",     "B", "u1", 1),
+    ("servo",    "H", "<u2", 1),
+    ("phase",    "B", "u1", 1),
+]
+
+SUFFIXES = {"u1": "u8", "<u2": "u16", "<u4": "u32", "<i4": "i32"}
+
+# Rolling statistics cover this many seconds
+STATS_WINDOW_SEC = 10
+
+
+# @brief Decodes one COBS encoded frame, without delimiters
+# @param frame - The encoded bytes
+# @return The decoded bytes, or None if the frame is malformed
+def cobs_decode(frame):
+    out = bytearray()
+    i = 0
+
+    while i < len(frame):
+        code = frame[i]
+
+        if (0 == code) or (i + code > len(frame)):
+            return None
+
+        out += frame[i + 1:i + code]
+        i += code
+
+        if (code < 0xFF) and (i < len(frame)):
+            out.append(0)
+
+    return bytes(out)
+
+
+# @brief COBS encodes a block of bytes, see cobs_encode() in telemetry.c
+# @param data - The bytes
+# @return The encoded bytes, without delimiters
+def cobs_encode(data):
+    out = bytearray([0])
+    code_index = 0
+
+    for byte in data:
+        if 0 == byte:
+            out[code_index] = len(out) - code_index
+            code_index = len(out)
+            out.append(0)
+        else:
+            out.append(byte)
+
+            if 0xFF == len(out) - code_index:
+                out[code_index] = 0xFF
+                code_index = len(out)
+                out.append(0)
+
+    out[code_index] = len(out) - code_index
+    return bytes(out)
+
+
+# @brief CRC-16/CCITT-FALSE, see crc.h
+def crc16(data):
+    return binascii.crc_hqx(data, CRC16_INIT)
+
+
+class Frame_decoder:
+    frames = 0
+    bad_frames = 0
+    lost_records = 0
+
+    # @brief Creates a decoder with no pending bytes
+    def __init__(self):
+        self.pending = b""
+        self.last_sequence = None
+
+    # @brief Decodes the complete frames in the received bytes, the rest is
+    # kept until the next call
+    # @param data - The received bytes
+    # @return List of records, one tuple of the COLUMNS fields per record
+    def feed(self, data):
+        parts = (self.pending + data).split(b"\0")
+        self.pending = parts.pop()
+        records = []
+
+        for frame in parts:
+            if not frame:
+                continue
+
+            record = self.decode(frame)
+
+            if record is None:
+                self.bad_frames += 1
+                continue
+
+            if self.last_sequence is not None:
+                self.lost_records += (record[1] - self.last_sequence - 1) & 0xFF
+
+            self.last_sequence = record[1]
+            self.frames += 1
+            records.append(record)
+
+        return records
+
+    # @brief Decodes one frame
+    # @param frame - The frame, without delimiters
+    # @return The record, or None if the frame is not a valid record
+    def decode(self, frame):
+        data = cobs_decode(frame)
+
+        if (data is None) or (RECORD_SIZE != len(data)):
+            return None
+
+        payload = data[:-2]
+
+        if crc16(payload) != struct.unpack_from("<H", data, len(payload))[0]:
+            return None
+
+        record = RECORD_FORMAT.unpack(payload)
+
+        if RECORD_CONTROL != record[0]:
+            return None
+
+        return record
+
+
+class Column_files:
+    # @brief Opens the column files for appending, and writes columns.txt
+    # @param directory - The output directory, created if needed
+    def __init__(self, directory):
+        os.makedirs(directory, exist_ok=True)
+
+        self.files = []
+        self.columns = []
+
+        with open(os.path.join(directory, "columns.txt"), "w") as f:
+            print("# file numpy_type scale", file=f)
+
+            for name, code, dtype, scale in COLUMNS:
+                filename = name + "." + SUFFIXES[dtype]
+                print(filename, dtype, repr(scale), file=f)
+
+                self.files.append(open(os.path.join(directory, filename), "ab"))
+                self.columns.append(array.array(code))
+
+        for column, (_, code, dtype, _) in zip(self.columns, COLUMNS):
+            if column.itemsize != int(SUFFIXES[dtype][1:]) // 8:
+                raise RuntimeError("No %d bit array type" % column.itemsize)
+
+    # @brief Adds records to the columns, written by flush()
+    # @param records - List of records
+    def append(self, records):
+        for column, values in zip(self.columns, zip(*records)):
+            column.extend(values)
+
+    # @brief Appends the added records to the files
+    def flush(self):
+        for f, column in zip(self.files, self.columns):
+            if "big" == sys.byteorder:
+                column.byteswap()
+
+            column.tofile(f)
+            f.flush()
+            del column[:]
+
+    # @brief Flushes and closes the files
+    def close(self):
+        self.flush()
+
+        for f in self.files:
+            f.close()
+
+
+class Rolling_stats:
+    # @brief Creates empty statistics
+    # @param window - Number of records to cover
+    def __init__(self, window):
+        self.errors = collections.deque(maxlen=window)
+        self.duties = collections.deque(maxlen=window)
+        self.periods = collections.deque(maxlen=window)
+        self.last_time = None
+
+    # @brief Adds records to the statistics
+    # @param records - List of records
+    def append(self, records):
+        for record in records:
+            time_ms = record[2]
+
+            self.errors.append(record[5] / 65536 - record[4] / 4)
+            self.duties.append(record[9])
+
+            if self.last_time is not None:
+                self.periods.append((time_ms - self.last_time) & 0xFFFFFFFF)
+
+            self.last_time = time_ms
+
+    # @brief Formats the statistics as one line
+    def summary(self):
+        if not self.periods:
+            return "waiting for records"
+
+        n = len(self.errors)
+        mean_error = sum(self.errors) / n
+        rms_error = math.sqrt(sum(e * e for e in self.errors) / n)
+        mean_duty = sum(self.duties) / len(self.duties)
+        mean_period = sum(self.periods) / len(self.periods)
+        jitter = math.sqrt(sum((p - mean_period) ** 2 for p in self.periods) /
+                           len(self.periods))
+
+        return ("error %+.2f C rms %.2f C  duty %.1f  period %.1f ms "
+                "jitter %.2f ms (%d..%d)" % (
+                    mean_error, rms_error, mean_duty, mean_period, jitter,
+                    min(self.periods), max(self.periods)))
+
+
+# @brief Opens a tty or pty in raw mode
+# @param path - Path of the device
+# @param baud - Baud rate, ignored for a pty
+# @return The file descriptor
+def open_port(path, baud):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+
+    if os.isatty(fd):
+        tty.setraw(fd)
+        attr = termios.tcgetattr(fd)
+        speed = getattr(termios, "B%d" % baud, None)
+
+        if speed is None:
+            os.close(fd)
+            raise ValueError("%d baud is not supported by termios" % baud)
+
+        attr[4] = speed
+        attr[5] = speed
+        termios.tcsetattr(fd, termios.TCSANOW, attr)
+
+    return fd
+
+
+# @brief Captures records until the device closes or Ctrl-C is pressed
+def capture(args):
+    fd = open_port(args.device, args.baud)
+    decoder = Frame_decoder()
+    files = Column_files(args.output)
+    stats = Rolling_stats(args.window)
+    received = 0
+    last_report = time.monotonic()
+    last_frames = 0
+
+    try:
+        while True:
+            ready, _, _ = select.select([fd], [], [], 0.2)
+
+            if ready:
+                try:
+                    data = os.read(fd, 65536)
+                except OSError:
+                    data = b""      # EIO when the pty is closed
+
+                if not data:
+                    break
+
+                received += len(data)
+                records = decoder.feed(data)
+
+                if records:
+                    files.append(records)
+                    stats.append(records)
+
+            now = time.monotonic()
+
+            if now - last_report >= 1.0:
+                files.flush()
+
+                print("%6d rec/s %7d B/s  lost %d  bad %d  %s" % (
+                          (decoder.frames - last_frames) / (now - last_report),
+                          received / (now - last_report),
+                          decoder.lost_records, decoder.bad_frames,
+                          stats.summary()),
+                      file=sys.stderr)
+
+                last_report = now
+                last_frames = decoder.frames
+                received = 0
+    except KeyboardInterrupt:
+        pass
+    finally:
+        files.close()
+        os.close(fd)
+
+    print("%d records, %d lost, %d bad frames" % (
+              decoder.frames, decoder.lost_records, decoder.bad_frames),
+          file=sys.stderr)
+
+
+# @brief Sends generated records on a new pty until Ctrl-C is pressed
+def fake_device(args):
+    master, slave = pty.openpty()
+    tty.setraw(slave)
+    print(os.ttyname(slave), flush=True)
+
+    count = 0
+    temp = 25.0
+    period = 1.0 / args.rate
+    batch = max(1, int(args.rate / 100))
+    next_time = time.monotonic()
+
+    try:
+        while True:
+            frames = bytearray()
+
+            for _ in range(batch):
+                sequence = count & 0xFF
+                time_ms = int(count * 1000 / args.rate) & 0xFFFFFFFF
+                target = 150 + 100 * math.sin(time_ms / 60000)
+                duty = max(0, min(50, int(2 * (target - temp))))
+                temp += (duty - (temp - 25) * 0.05) * 0.02
+
+                payload = RECORD_FORMAT.pack(
+                    RECORD_CONTROL, sequence, time_ms,
+                    int(temp * 4), int(temp * 4), int(target * 65536),
+                    int((target - temp) * 2 * 65536), 0, 0,
+                    duty, 0, 1)
+                payload += struct.pack("<H", crc16(payload))
+
+                frames += b"\0" + cobs_encode(payload) + b"\0"
+
+                count += 1
+
+            if args.noise and (0 == count % 64):
+                frames += b"[Reverted to 9600 baud]\r\n"
+
+            os.write(master, frames)
+
+            next_time += batch * period
+            time.sleep(max(0, next_time - time.monotonic()))
+    except KeyboardInterrupt:
+        pass
+    finally:
+        os.close(master)
+        os.close(slave)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Captures the binary telemetry stream of the controller.")
+    parser.add_argument("device", nargs="?", help="tty or pty to read")
+    parser.add_argument("output", nargs="?", default="telemetry",
+                        help="directory for the column files")
+    parser.add_argument("--baud", type=int, default=9600)
+    parser.add_argument("--window", type=int, default=10 * STATS_WINDOW_SEC,
+                        help="records covered by the statistics")
+    parser.add_argument("--fake", action="store_true",
+                        help="send generated records on a new pty instead")
+    parser.add_argument("--rate", type=float, default=10,
+                        help="records per second sent by --fake")
+    parser.add_argument("--noise", action="store_true",
+                        help="mix terminal answers into the --fake stream")
+    args = parser.parse_args()
+
+    if args.fake:
+        fake_device(args)
+    elif args.device:
+        capture(args)
+    else:
+        parser.error("a device is needed unless --fake is used")
+
+
+if __name__ == "__main__":
+    main()
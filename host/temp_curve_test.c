@@ -0,0 +1,329 @@
+/*
+ * Host test of temp_curve_eval_window().
+ *
+ * A window evaluated by temp_curve_eval_window() is compared with n calls of
+ * temp_curve_eval_at() on a test profile with fractional temperatures, a one
+ * second segment and a segment of zero length:
+ *
+ * - Windows with whole second t0 and dt must give exactly the same values.
+ * - Windows with fractional t0 or dt must give values between the values at
+ *   the whole seconds around each time. Every accumulated step may add up to
+ *   1 LSB of error, so the k:th value may be off by at most k + 1 LSB.
+ *
+ * Windows start before the first point, cross segment boundaries and end
+ * past the last point. Outputs which are not large enough vectors must be
+ * refused.
+ *
+ * The profile is given by stubs of profile.h, so no flash is needed.
+ *
+ * Build and run with
+ *   make -C host test
+ */
+
+// =============================================================================
+// Include statements
+// =============================================================================
+
+#include "temp_curve.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fixed_point.h"
+#include "matrix.h"
+#include "profile.h"
+
+// =============================================================================
+// Private type definitions
+// =============================================================================
+
+// =============================================================================
+// Private constants
+// =============================================================================
+
+#define MAX_WINDOW          64
+#define RANDOM_WINDOWS      200000UL
+
+// Time after the last point used by the random windows
+#define TIME_AFTER_LAST     20
+
+static const temp_curve_calib_point_t TEST_POINTS[] =
+{
+    {DOUBLE_TO_Q16_16(25.5), 0},
+    {DOUBLE_TO_Q16_16(150.25), 60},
+    {DOUBLE_TO_Q16_16(151.0), 61},      // One second segment
+    {DOUBLE_TO_Q16_16(180.0), 61},      // Zero length segment
+    {DOUBLE_TO_Q16_16(183.75), 150},
+    {DOUBLE_TO_Q16_16(235.0), 200},
+    {DOUBLE_TO_Q16_16(100.5), 240}
+};
+
+#define NBR_OF_TEST_POINTS  (sizeof(TEST_POINTS) / sizeof(TEST_POINTS[0]))
+#define LAST_TIME           240
+
+// =============================================================================
+// Private variables
+// =============================================================================
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t nbr_of_windows = 0;
+static uint32_t nbr_of_failed = 0;
+
+// Largest deviation found, in LSB
+static q16_16_t max_deviation = 0;
+
+// =============================================================================
+// Private function declarations
+// =============================================================================
+
+/**
+ * @brief Gets a pseudo random number, xorshift64*.
+ * @return The random number.
+ */
+static uint32_t random_u32(void);
+
+/**
+ * @brief Evaluates a window and compares it with temp_curve_eval_at().
+ * @param t0 - Time of the first value in seconds.
+ * @param dt - Time between two values in seconds.
+ * @param n - Number of values, at most MAX_WINDOW.
+ */
+static void check_window(q16_16_t t0, q16_16_t dt, uint16_t n);
+
+/**
+ * @brief Evaluates the curve at a time with temp_curve_eval_at().
+ * @param time - Time in seconds, times before 0 give the value at 0.
+ * @return The temperature.
+ */
+static q16_16_t eval_at(int32_t time);
+
+/**
+ * @brief Reports a failed check.
+ * @param what - What failed.
+ * @param t0 - Time of the first value of the window.
+ * @param dt - Time between two values of the window.
+ * @param n - Number of values of the window.
+ */
+static void fail(const char * what, q16_16_t t0, q16_16_t dt, uint16_t n);
+
+/**
+ * @brief Checks that windows are refused for outputs which can not hold them.
+ */
+static void check_refused(void);
+
+// =============================================================================
+// Public function definitions
+// =============================================================================
+
+int main(void)
+{
+    uint32_t i;
+    uint16_t k;
+
+    temp_curve_init(TEMP_CURVE_LEAD);
+
+    // Whole seconds over the whole profile, one value per second
+    check_window(0, Q16_16_T_ONE, MAX_WINDOW);
+    check_window(INT_TO_Q16_16(59), Q16_16_T_ONE, 4);
+    check_window(INT_TO_Q16_16(LAST_TIME - 2), Q16_16_T_ONE, 8);
+    check_window(INT_TO_Q16_16(LAST_TIME + 5), INT_TO_Q16_16(3), 8);
+    check_window(INT_TO_Q16_16(-3), Q16_16_T_ONE, 8);
+    check_window(INT_TO_Q16_16(100), 0, 8);
+
+    // Fractional times crossing the one second and the zero length segment
+    check_window(DOUBLE_TO_Q16_16(59.5), DOUBLE_TO_Q16_16(0.25), 12);
+    check_window(DOUBLE_TO_Q16_16(60.1), DOUBLE_TO_Q16_16(0.3), 8);
+    check_window(DOUBLE_TO_Q16_16(-0.75), DOUBLE_TO_Q16_16(0.5), 8);
+    check_window(DOUBLE_TO_Q16_16(239.5), DOUBLE_TO_Q16_16(0.125), 16);
+
+    // Every whole second window
+    for (k = 0; k <= LAST_TIME + TIME_AFTER_LAST; k++)
+    {
+        check_window(INT_TO_Q16_16(k), INT_TO_Q16_16(1 + k % 5),
+                     1 + k % MAX_WINDOW);
+    }
+
+    // Random fractional windows, from before the first to after the last point
+    for (i = 0; i < RANDOM_WINDOWS; i++)
+    {
+        q16_16_t t0 = (q16_16_t)(random_u32() %
+                      ((uint32_t)(LAST_TIME + TIME_AFTER_LAST) << 16)) -
+                      INT_TO_Q16_16(2);
+        q16_16_t dt = (q16_16_t)(random_u32() % (4UL << 16));
+
+        check_window(t0, dt, (uint16_t)(1 + random_u32() % MAX_WINDOW));
+    }
+
+    check_refused();
+
+    printf("%lu windows, max deviation %ld LSB, %lu failed\n",
+           (unsigned long)nbr_of_windows, (long)max_deviation,
+           (unsigned long)nbr_of_failed);
+
+    return (0 == nbr_of_failed) ? 0 : 1;
+}
+
+//
+// Stubs of profile.h, the test profile is always loaded.
+//
+
+uint8_t profile_get_selected(temp_curve_variant_t variant)
+{
+    (void)variant;
+    return 0;
+}
+
+void profile_get_name(uint8_t index, char * name)
+{
+    (void)index;
+    strncpy(name, "test", PROFILE_NAME_LEN + 1);
+}
+
+uint8_t profile_load(uint8_t index,
+                     temp_curve_calib_point_t * points,
+                     uint8_t max_points,
+                     uint16_t * phase_start)
+{
+    uint8_t i;
+
+    (void)index;
+
+    for (i = 0; (i < NBR_OF_TEST_POINTS) && (i < max_points); i++)
+    {
+        points[i] = TEST_POINTS[i];
+    }
+
+    phase_start[TEMP_CURVE_PHASE_SOAK] = 60;
+    phase_start[TEMP_CURVE_PHASE_REFLOW] = 150;
+    phase_start[TEMP_CURVE_PHASE_COOL] = 200;
+
+    return i;
+}
+
+// =============================================================================
+// Private function definitions
+// =============================================================================
+
+static uint32_t random_u32(void)
+{
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+
+    return (uint32_t)((random_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static void check_window(q16_16_t t0, q16_16_t dt, uint16_t n)
+{
+    MATRIX_DECLARE(window, MAX_WINDOW, 1);
+    bool whole_seconds = (0 == ((t0 | dt) & 0xFFFF));
+    q16_16_t time = t0;
+    uint16_t k;
+
+    window.rows = MAX_WINDOW;
+    window.cols = 1;
+    window.m = window_mat;
+
+    nbr_of_windows++;
+
+    if (!temp_curve_eval_window(t0, dt, n, &window))
+    {
+        fail("refused", t0, dt, n);
+        return;
+    }
+
+    for (k = 0; k < n; k++, time += dt)
+    {
+        q16_16_t value = window.m[k];
+        q16_16_t low = eval_at(q16_16_floor(time) >> 16);
+        q16_16_t high = eval_at(q16_16_ceil(time) >> 16);
+        q16_16_t deviation = 0;
+
+        if (low > high)
+        {
+            q16_16_t tmp = low;
+
+            low = high;
+            high = tmp;
+        }
+
+        if (value < low)
+        {
+            deviation = low - value;
+        }
+        else if (value > high)
+        {
+            deviation = value - high;
+        }
+
+        if (deviation > max_deviation)
+        {
+            max_deviation = deviation;
+        }
+
+        if ((whole_seconds && (0 != deviation)) ||
+            (deviation > (q16_16_t)k + 1))
+        {
+            printf("  value %u at %.4f is %.6f, eval_at %.6f to %.6f\n", k,
+                   q16_16_to_double(time), q16_16_to_double(value),
+                   q16_16_to_double(low), q16_16_to_double(high));
+            fail("wrong value", t0, dt, n);
+            return;
+        }
+    }
+}
+
+static q16_16_t eval_at(int32_t time)
+{
+    if (time < 0)
+    {
+        time = 0;
+    }
+
+    return temp_curve_eval_at((uint16_t)time);
+}
+
+static void fail(const char * what, q16_16_t t0, q16_16_t dt, uint16_t n)
+{
+    nbr_of_failed++;
+    printf("FAILED: %s, t0 %.4f dt %.4f n %u\n", what,
+           q16_16_to_double(t0), q16_16_to_double(dt), n);
+}
+
+static void check_refused(void)
+{
+    MATRIX_DECLARE(square, 4, 4);
+    MATRIX_DECLARE(row, 1, 8);
+
+    square.rows = 4;
+    square.cols = 4;
+    square.m = square_mat;
+    row.rows = 1;
+    row.cols = 8;
+    row.m = row_mat;
+
+    nbr_of_windows += 4;
+
+    if (temp_curve_eval_window(0, Q16_16_T_ONE, 4, &square))
+    {
+        fail("accepted a 4x4 matrix", 0, Q16_16_T_ONE, 4);
+    }
+
+    if (temp_curve_eval_window(0, Q16_16_T_ONE, 9, &row))
+    {
+        fail("accepted a too short row vector", 0, Q16_16_T_ONE, 9);
+    }
+
+    if (temp_curve_eval_window(0, Q16_16_T_ONE, 0, &row))
+    {
+        fail("accepted an empty window", 0, Q16_16_T_ONE, 0);
+    }
+
+    if (!temp_curve_eval_window(0, Q16_16_T_ONE, 8, &row))
+    {
+        fail("refused a row vector", 0, Q16_16_T_ONE, 8);
+    }
+}
@@ -14,6 +14,8 @@
 #include "control.h"
 #include "fixed_point.h"
 #include "flash.h"
+#include "params.h"
+#include "recorder.h"
 #include "led.h"
 #include "temp_curve.h"
 #include "lcd.h"
@@ -61,6 +63,8 @@ void init(void)
     print_start_message(reset_reason);
 
     flash_init();
+    params_init();
+    recorder_init();
     
     buttons_init();
     max6675_init();
@@ -72,21 +76,15 @@ void init(void)
 
     if (LEAD_SWITCH_PIN)
     {
-        led_init(flash_read_word(FLASH_INDEX_LEAD_SOAK_START_SEC),
-                 flash_read_word(FLASH_INDEX_LEAD_REFLOW_START_SEC),
-                 flash_read_word(FLASH_INDEX_LEAD_COOL_START_SEC));
-        
         temp_curve_init(TEMP_CURVE_LEAD);
     }
     else
     {
-        led_init(flash_read_word(FLASH_INDEX_LEAD_FREE_SOAK_START_SEC),
-                 flash_read_word(FLASH_INDEX_LEAD_FREE_REFLOW_START_SEC),
-                 flash_read_word(FLASH_INDEX_LEAD_FREE_COOL_START_SEC));
-
         temp_curve_init(TEMP_CURVE_LEAD_FREE);
     }
 
+    led_init();
+
     while (timers_get_millis() < 50)
     {
         ;
@@ -6,6 +6,7 @@
 #include <stdint.h>
 
 #include "gpio.h"
+#include "status.h"
 
 // =============================================================================
 // Private type definitions
@@ -23,10 +24,6 @@
 // Private variables
 // =============================================================================
 
-static uint16_t end_of_preheat;
-static uint16_t end_of_soak;
-static uint16_t end_of_reflow;
-
 // =============================================================================
 // Private function declarations
 // =============================================================================
@@ -35,23 +32,20 @@ static uint16_t end_of_reflow;
 // Public function definitions
 // =============================================================================
 
-void led_init(uint16_t preheat, uint16_t soak, uint16_t reflow)
+void led_init(void)
 {
-    end_of_preheat = preheat;
-    end_of_soak    = soak;
-    end_of_reflow  = reflow;
-
     PREHEAT_LED_OFF;
     SOAK_LED_OFF;
     REFLOW_LED_OFF;
     COOL_LED_OFF;
 }
 
-void led_update(uint16_t reflow_time_sec, bool reflow_program_active)
+void led_update(status_reflow_state_t reflow_state,
+                bool reflow_program_active)
 {
     if (reflow_program_active)
     {
-        if (reflow_time_sec > end_of_reflow)
+        if (STATUS_REFLOW_STATE_COOL == reflow_state)
         {
             COOL_LED_ON;
             
@@ -59,7 +53,7 @@ void led_update(uint16_t reflow_time_sec, bool reflow_program_active)
             SOAK_LED_OFF;
             REFLOW_LED_OFF;
         }
-        else if (reflow_time_sec > end_of_soak)
+        else if (STATUS_REFLOW_STATE_REFLOW == reflow_state)
         {
             REFLOW_LED_ON;
 
@@ -67,7 +61,7 @@ void led_update(uint16_t reflow_time_sec, bool reflow_program_active)
             SOAK_LED_OFF;
             COOL_LED_OFF;
         }
-        else if (reflow_time_sec > end_of_preheat)
+        else if (STATUS_REFLOW_STATE_SOAK == reflow_state)
         {
             SOAK_LED_ON;
             
@@ -10,6 +10,8 @@ extern "C" {
 // =============================================================================
 #include <stdbool.h>
 #include <stdint.h>
+
+#include "status.h"
     
 // =============================================================================
 // Public type definitions
@@ -29,23 +31,16 @@ extern "C" {
 
 /**
  * @brief Initializes the control panel LEDs.
- * @param end_of_preheat - When the preheat period ends, in seconds since start
- *        of reflow program
- * @param end_of_soak - When the soak period ends, in seconds since start
- *        of reflow program
- * @param end_of_reflow - When the refow period ends, in seconds since start
- *        of reflow program
  */
-void led_init(uint16_t end_of_preheat, uint16_t end_of_soak,
-              uint16_t end_of_reflow);
+void led_init(void);
 
 /**
- * @brief Updates the LEDs according to the current time since the reflow
- *        program was started.
- * @param refow_time_sec - Time [s] since the reflow program was started.
+ * @brief Updates the LEDs according to the current reflow state.
+ * @param reflow_state - The current reflow state.
  * @param reflow_program_active - If the reflow program is currently active.
  */
-void led_update(uint16_t reflow_time_sec, bool reflow_program_active);
+void led_update(status_reflow_state_t reflow_state,
+                bool reflow_program_active);
 
 #ifdef	__cplusplus
 }
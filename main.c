@@ -23,6 +23,8 @@
 #include "flash.h"
 #include "fixed_point.h"
 #include "servo.h"
+#include "recorder.h"
+#include "telemetry.h"
 
 // =============================================================================
 // Private type definitions
@@ -38,6 +40,8 @@
 
 static const uint32_t MAX_TIME_BETWEEN_TEMP_READINGS_MS = 600;
 
+static const q16_16_t PID_INTERVAL_SEC = DOUBLE_TO_Q16_16(0.100);
+
 // =============================================================================
 // Private variables
 // =============================================================================
@@ -86,6 +90,11 @@ static inline void handle_uart_log_temp_event(void);
  */
 static inline void handle_uart_receive_event(void);
 
+/**
+ * @brief Handles the received command event.
+ */
+static inline void handle_command_event(void);
+
 /**
  * @brief Handles the start button pushed event.
  */
@@ -101,6 +110,40 @@ static inline void handle_switch_to_lead_profile(void);
  */
 static inline void handle_switch_to_lead_free_profile(void);
 
+/**
+ * @brief Handles the commit flash writes event.
+ */
+static inline void handle_flash_commit_event(void);
+
+/**
+ * @brief Handles the write recorded run or list event.
+ */
+static inline void handle_dump_event(void);
+
+/**
+ * @brief Restores the previous baud rate when a new one was not confirmed.
+ */
+static inline void handle_baud_timeout_event(void);
+
+/**
+ * @brief Switches the baud rate once the uart is idle.
+ */
+static inline void handle_baud_switch_event(void);
+
+/**
+ * @brief Collects the values recorded by the run recorder.
+ * @param sample - Where to store the values.
+ * @param target - The target temperature.
+ */
+static inline void get_recorder_sample(recorder_sample_t * sample,
+                                       q16_16_t target);
+
+/**
+ * @brief Sends a binary telemetry record of the last control tick.
+ * @param target - The target temperature.
+ */
+static inline void send_telemetry(q16_16_t target);
+
 
 // =============================================================================
 // Public function definitions
@@ -155,6 +198,11 @@ int main(void)
         else if (status_check(STATUS_UART_RECEIVE_FLAG))
             handle_uart_receive_event();
         //
+        // Execute received commands, one at a time
+        //
+        else if (terminal_is_command_pending())
+            handle_command_event();
+        //
         // Handle switch to lead reflow profile
         //
         else if (status_check(STATUS_SWITCH_TO_LEAD_FLAG))
@@ -170,12 +218,33 @@ int main(void)
         else if (status_check(STATUS_START_BUTTON_PUSHED_FLAG))
             handle_start_button_event();
         //
+        // Commit flash writes, never while the reflow program is running
+        //
+        else if (flash_is_commit_requested() &&
+                 !status_check(STATUS_REFLOW_PROGRAM_ACTIVE))
+            handle_flash_commit_event();
+        //
         // Detect stalls
         //
         else if (max6675_first_reading_done() &&
                 (timers_get_millis() - max6675_get_last_reading_time() >
                  MAX_TIME_BETWEEN_TEMP_READINGS_MS))
             status_set(STATUS_CRITICAL_ERROR_FLAG, CRIT_ERR_READ_TIMEOUT);
+        //
+        // Revert a baud rate change which was not confirmed
+        //
+        else if (terminal_is_baud_change_expired())
+            handle_baud_timeout_event();
+        //
+        // Switch the baud rate when everything has been sent at the old one
+        //
+        else if (terminal_is_baud_switch_ready())
+            handle_baud_switch_event();
+        //
+        // Write a recorded run or a list, a few lines at a time
+        //
+        else if (terminal_is_dump_active() && uart_is_write_buffer_empty())
+            handle_dump_event();
     }
 
     return EXIT_SUCCESS;
@@ -193,7 +262,9 @@ static inline void handle_stop_button_event(void)
     timers_deactivate_heater_control();
     HEATER_OFF;
 
-    uart_write_string("Stop button pushed\r\n");
+    recorder_stop_run();
+
+    uart_write_string_priority(UART_PRIORITY_HIGH, "Stop button pushed\r\n");
 }
 
 static inline void handle_critical_error_event(void)
@@ -203,8 +274,11 @@ static inline void handle_critical_error_event(void)
     timers_deactivate_heater_control();
     HEATER_OFF;
 
-    sprintf(msg, "Crit Error %d", status_check(STATUS_CRITICAL_ERROR_FLAG));
-    uart_write_string(msg);
+    // Keep the samples leading up to the error, nothing runs after this
+    recorder_stop_run();
+
+    sprintf(msg, "Crit Error %d\r\n", status_check(STATUS_CRITICAL_ERROR_FLAG));
+    uart_write_string_priority(UART_PRIORITY_HIGH, msg);
 
 
     DEBUG_1_LED_ON;
@@ -233,14 +307,31 @@ static inline void handle_pid_event(void)
 
     if (status_check(STATUS_REFLOW_PROGRAM_ACTIVE))
     {
+        recorder_sample_t sample;
         q16_16_t temp;
+        q16_16_t target;
 
         temp = int_to_q16_16(max6675_get_current_temp());
 
         control_enable_servo(
                 status_check(STATUS_REFLOW_STATE) == STATUS_REFLOW_STATE_COOL);
 
+        target = temp_curve_reference_step(PID_INTERVAL_SEC);
+        control_set_target_value(target);
         control_update_pid(temp >> 2);
+
+        if (TELEMETRY_MODE_BINARY == telemetry_get_mode())
+        {
+            send_telemetry(target);
+        }
+
+        //
+        // Record after the outputs are updated, the flash write stalls the
+        // CPU for a few ms at most.
+        //
+        get_recorder_sample(&sample, target);
+        recorder_add_sample(&sample);
+        recorder_service();
     }
 }
 
@@ -267,54 +358,22 @@ static inline void handle_reflow_time_update_event(void)
 
         timers_deactivate_heater_control();
         HEATER_OFF;
-    }
 
-    
-    led_update(time, prog_active);
+        recorder_stop_run();
+    }
 
     if (prog_active)
     {
-        control_set_target_value(temp_curve_eval(time));
+        //
+        // The target value is updated by handle_pid_event(), keep the
+        // reference generator in sync with the reflow time.
+        //
+        temp_curve_reference_reset(time);
 
-        if (buttons_is_profile_switch_lead())
-        {
-            if (time < flash_read_word(FLASH_INDEX_LEAD_SOAK_START_SEC))
-            {
-                status_set(STATUS_REFLOW_STATE, STATUS_REFLOW_STATE_PREHEAT);
-            }
-            else if (time < flash_read_word(FLASH_INDEX_LEAD_REFLOW_START_SEC))
-            {
-                status_set(STATUS_REFLOW_STATE, STATUS_REFLOW_STATE_SOAK);
-            }
-            else if (time < flash_read_word(FLASH_INDEX_LEAD_COOL_START_SEC))
-            {
-                status_set(STATUS_REFLOW_STATE, STATUS_REFLOW_STATE_REFLOW);
-            }
-            else
-            {
-                status_set(STATUS_REFLOW_STATE, STATUS_REFLOW_STATE_COOL);
-            }
-        }
-        else
-        {
-            if (time < flash_read_word(FLASH_INDEX_LEAD_FREE_SOAK_START_SEC))
-            {
-                status_set(STATUS_REFLOW_STATE, STATUS_REFLOW_STATE_PREHEAT);
-            }
-            else if (time < flash_read_word(FLASH_INDEX_LEAD_FREE_REFLOW_START_SEC))
-            {
-                status_set(STATUS_REFLOW_STATE, STATUS_REFLOW_STATE_SOAK);
-            }
-            else if (time < flash_read_word(FLASH_INDEX_LEAD_FREE_COOL_START_SEC))
-            {
-                status_set(STATUS_REFLOW_STATE, STATUS_REFLOW_STATE_REFLOW);
-            }
-            else
-            {
-                status_set(STATUS_REFLOW_STATE, STATUS_REFLOW_STATE_COOL);
-            }
-        }
+        status_set(STATUS_REFLOW_STATE, temp_curve_get_reflow_state(time));
     }
+
+    led_update(status_check(STATUS_REFLOW_STATE), prog_active);
 }
 
 static inline void handle_lcd_refresh_event(void)
@@ -327,7 +386,6 @@ static inline void handle_lcd_refresh_event(void)
         uint8_t temp_decimals;
         uint8_t minutes = 0;
         uint8_t seconds = 0;
-        char reflow_profile[12];
 
         temp = max6675_get_current_temp();
 
@@ -368,15 +426,6 @@ static inline void handle_lcd_refresh_event(void)
         sprintf(upper_line, "%03u.%02u C   %02u:%02u ",
                 temp, temp_decimals, minutes, seconds);
 
-        if (buttons_is_profile_switch_lead())
-        {
-            sprintf(reflow_profile, "    Pb-free");
-        }
-        else
-        {
-            sprintf(reflow_profile, "60/40 Sn-Pb");
-        }
-
         if (status_check(STATUS_REFLOW_PROGRAM_ACTIVE))
         {
             switch (status_check(STATUS_REFLOW_STATE))
@@ -400,7 +449,7 @@ static inline void handle_lcd_refresh_event(void)
         }
         else
         {
-            sprintf(lower_line, "Idle %s", reflow_profile);
+            sprintf(lower_line, "Idle %11s", temp_curve_get_profile_name());
         }
 
         lcd_set_text(upper_line, lower_line);
@@ -409,7 +458,8 @@ static inline void handle_lcd_refresh_event(void)
 
 static inline void handle_uart_log_temp_event(void)
 {
-    char print[32];
+    char print[40];
+    uint8_t len;
     uint16_t temp;
     uint8_t temp_decimals;
     static bool not_first_time;
@@ -417,7 +467,8 @@ static inline void handle_uart_log_temp_event(void)
 
     status_clear(STATUS_UART_LOG_TEMP_FLAG);
 
-    if (status_check(STATUS_REFLOW_PROGRAM_ACTIVE))
+    if (status_check(STATUS_REFLOW_PROGRAM_ACTIVE) &&
+        (TELEMETRY_MODE_ASCII == telemetry_get_mode()))
     {
         temp = max6675_get_current_temp();
 
@@ -447,12 +498,26 @@ static inline void handle_uart_log_temp_event(void)
 
         current_time = timers_get_reflow_time();
 
-        sprintf(print, "%03u.%02u;%04u;%02u;%03u;%lf\r\n",
-                temp, temp_decimals,
-                current_time,
-                timers_get_heater_duty(),
-                servo_get_pos(),
-                q16_16_to_double(temp_curve_eval(current_time)));
+        //
+        // Same format as "%03u.%02u;%04u;%02u;%03u;%.2f\r\n", but built
+        // without printf since the target temperature would otherwise need
+        // soft float formatting.
+        //
+        len = uint16_to_str(print, temp, 3);
+        print[len++] = '.';
+        len += uint16_to_str(print + len, temp_decimals, 2);
+        print[len++] = ';';
+        len += uint16_to_str(print + len, current_time, 4);
+        print[len++] = ';';
+        len += uint16_to_str(print + len, timers_get_heater_duty(), 2);
+        print[len++] = ';';
+        len += uint16_to_str(print + len, servo_get_pos(), 3);
+        print[len++] = ';';
+        len += q16_16_to_str(print + len, temp_curve_eval(current_time), 2);
+        print[len++] = '\r';
+        print[len++] = '\n';
+        print[len] = '\0';
+
         uart_write_string(print);
     }
 }
@@ -461,27 +526,37 @@ static inline void handle_uart_receive_event(void)
 {
     status_clear(STATUS_UART_RECEIVE_FLAG);
     terminal_handle_uart_event();
+}
+
+static inline void handle_command_event(void)
+{
+    terminal_handle_command_event();
     DEBUG_1_LED_PIN = !DEBUG_1_LED_PIN;
 }
 
 static inline void handle_start_button_event(void)
 {
+    recorder_sample_t sample;
+
     status_clear(STATUS_START_BUTTON_PUSHED_FLAG);
     timers_reset_reflow_time();
+    temp_curve_reference_reset(0);
+    control_set_target_value(temp_curve_eval_at(0));
+    status_set(STATUS_REFLOW_STATE, temp_curve_get_reflow_state(0));
+
+    get_recorder_sample(&sample, temp_curve_eval_at(0));
+    recorder_start_run(temp_curve_get_profile(), &sample);
+
     timers_activate_heater_control();
     status_set(STATUS_REFLOW_PROGRAM_ACTIVE, true);
 
-    uart_write_string("Start button pushed\r\n");
+    uart_write_string_priority(UART_PRIORITY_HIGH, "Start button pushed\r\n");
 }
 
 static inline void handle_switch_to_lead_profile(void)
 {
     status_clear(STATUS_SWITCH_TO_LEAD_FLAG);
 
-    led_init(flash_read_word(FLASH_INDEX_LEAD_SOAK_START_SEC),
-             flash_read_word(FLASH_INDEX_LEAD_REFLOW_START_SEC),
-             flash_read_word(FLASH_INDEX_LEAD_COOL_START_SEC));
-
     temp_curve_init(TEMP_CURVE_LEAD);
 
     uart_write_string("Switch to lead profile\r\n");
@@ -491,11 +566,57 @@ static inline void handle_switch_to_lead_free_profile(void)
 {
     status_clear(STATUS_SWITCH_TO_LEAD_FREE_FLAG);
 
-    led_init(flash_read_word(FLASH_INDEX_LEAD_FREE_SOAK_START_SEC),
-             flash_read_word(FLASH_INDEX_LEAD_FREE_REFLOW_START_SEC),
-             flash_read_word(FLASH_INDEX_LEAD_FREE_COOL_START_SEC));
-
     temp_curve_init(TEMP_CURVE_LEAD_FREE);
 
     uart_write_string("Switch to lead free profile\r\n");
-}
\ No newline at end of file
+}
+
+static inline void handle_flash_commit_event(void)
+{
+    flash_write_buffer_to_flash();
+}
+
+static inline void handle_dump_event(void)
+{
+    terminal_handle_dump_event();
+}
+
+static inline void handle_baud_timeout_event(void)
+{
+    terminal_handle_baud_timeout();
+}
+
+static inline void handle_baud_switch_event(void)
+{
+    terminal_handle_baud_switch();
+}
+
+static inline void get_recorder_sample(recorder_sample_t * sample,
+                                       q16_16_t target)
+{
+    sample->temp = max6675_get_current_temp();
+    sample->target = (target > 0) ? (uint16_t)(target >> 14) : 0;
+    sample->duty = timers_get_heater_duty();
+    sample->servo = servo_get_pos();
+}
+
+static inline void send_telemetry(q16_16_t target)
+{
+    telemetry_record_t record;
+    control_terms_t terms;
+
+    control_get_terms(&terms);
+
+    record.time = timers_get_millis();
+    record.raw_temp = max6675_get_raw_temp();
+    record.temp = max6675_get_current_temp();
+    record.target = target;
+    record.p = terms.p;
+    record.i = terms.i;
+    record.d = terms.d;
+    record.duty = timers_get_heater_duty();
+    record.servo = servo_get_pos();
+    record.phase = status_check(STATUS_REFLOW_STATE);
+
+    telemetry_send(&record);
+}
@@ -378,6 +378,108 @@ matrix_t * matrix_copy(const matrix_t * src, matrix_t * dst)
     return dst;
 }
 
+void matrix_q2_14_create(matrix_q2_14_t * m,
+                         uint16_t rows,
+                         uint16_t cols,
+                         q2_14_t * array)
+{
+    m->rows = rows;
+    m->cols = cols;
+    m->m = array;
+}
+
+matrix_q2_14_t * matrix_to_q2_14(const matrix_t * src, matrix_q2_14_t * dst)
+{
+    const uint16_t nbr_of_elements = MATRIX_ELEMENTS(src->rows, src->cols);
+    uint16_t i;
+    q16_16_t * p_src = src->m;
+    q2_14_t * p_dst = dst->m;
+
+    if ((src->rows != dst->rows) || (src->cols != dst->cols))
+    {
+        matrix_op_err(__func__);
+        return NULL;
+    }
+
+    for (i = 0; i != nbr_of_elements; ++i)
+    {
+        *p_dst++ = q16_16_to_q2_14(*p_src++);
+    }
+
+    return dst;
+}
+
+matrix_t * matrix_q2_14_mult(const matrix_q2_14_t * a, const matrix_t * b,
+        matrix_t * prod)
+{
+    const uint16_t r_max = prod->rows;
+    const uint16_t c_max = prod->cols;
+    const uint16_t e_max = a->cols;
+    uint16_t r;
+    uint16_t c;
+    uint16_t e;
+
+    q2_14_t * a_mat = a->m;
+    q16_16_t * b_mat = b->m;
+    q16_16_t * prod_mat = prod->m;
+
+    uint16_t row_offset = 0;
+    uint16_t a_row_offset = 0;
+
+    if ((a->cols != b->rows) ||
+        (a->rows != prod->rows) || (b->cols != prod->cols))
+    {
+        matrix_op_err(__func__);
+        return  NULL;
+    }
+
+    for (r = 0; r != r_max; ++r)
+    {
+        for (c = 0; c != c_max; ++c)
+        {
+            uint16_t e_times_c_max = 0;
+            q16_16_t sum = 0;
+
+            for (e = 0; e != e_max; ++e)
+            {
+                sum += q16_16_multiply_q2_14(*(b_mat + e_times_c_max + c),
+                                             *(a_mat + a_row_offset + e));
+
+                e_times_c_max += c_max;
+            }
+
+            *(prod_mat + row_offset + c) = sum;
+        }
+
+        row_offset += c_max;
+        a_row_offset += e_max;
+    }
+
+    return prod;
+}
+
+matrix_t * matrix_q2_14_mult_elements(const matrix_q2_14_t * m,
+        q16_16_t factor, matrix_t * result)
+{
+    const uint16_t nbr_of_elements = MATRIX_ELEMENTS(m->rows, m->cols);
+    uint16_t i;
+    q2_14_t * p_m = m->m;
+    q16_16_t * p_result = result->m;
+
+    if ((m->rows != result->rows) || (m->cols != result->cols))
+    {
+        matrix_op_err(__func__);
+        return NULL;
+    }
+
+    for (i = 0; i != nbr_of_elements; ++i)
+    {
+        *p_result++ = q16_16_multiply_q2_14(factor, *p_m++);
+    }
+
+    return result;
+}
+
 bool matrix_is_same_dimension(const matrix_t * a, const matrix_t * b)
 {
     return ((a->cols == b->cols) && (a->rows == b->rows));
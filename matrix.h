@@ -26,6 +26,16 @@ typedef struct matrix_t
     q16_16_t * m;
 } matrix_t;
 
+// Matrix of q2_14_t coefficients, for constant matrices whose elements are
+// known to be in [-2, 2). Multiplying it with a q16_16_t matrix only needs
+// 16x16 bit hardware multiplications.
+typedef struct matrix_q2_14_t
+{
+    uint16_t rows;
+    uint16_t cols;
+    q2_14_t * m;
+} matrix_q2_14_t;
+
 // =============================================================================
 // Global variable declarations
 // =============================================================================
@@ -77,6 +87,23 @@ typedef struct matrix_t
     q16_16_t name ## _mat[(r)*(c)]; \
     matrix_create(& name, (r), (c), (q16_16_t*)name ## _mat);
 
+/*
+ * Creates a static q2_14_t matrix declaration.
+ * For example MATRIX_Q2_14_DECLARE_STATIC(a, 2, 3) expands to:
+ * static matrix_q2_14_t a;
+ * static q2_14_t a_mat[2*3];
+ */
+#define MATRIX_Q2_14_DECLARE_STATIC(name, r, c) static matrix_q2_14_t name; \
+    static q2_14_t name ## _mat[(r)*(c)];
+
+/*
+ * Creates a previously declared q2_14_t matrix.
+ * For example MATRIX_Q2_14_CREATE(a, 2, 3) expands to:
+ * matrix_q2_14_create(&a, 2, 3, (q2_14_t*)a_mat);
+ */
+#define MATRIX_Q2_14_CREATE(name, r, c) matrix_q2_14_create(& name, (r), (c), \
+    (q2_14_t*)name ## _mat);
+
 /**
  * @brief Gets a pointer to the element at row r, column c of matrix m.
  * @param m - Matrix to find element in.
@@ -187,6 +214,47 @@ matrix_t * matrix_mult_elements(const matrix_t * m, q16_16_t factor,
  */
 matrix_t * matrix_copy(const matrix_t * src, matrix_t * dst);
 
+/**
+ * @brief Fills in the matrix_q2_14_t struct.
+ * @param m - Struct to fill.
+ * @param rows - Number of rows.
+ * @param cols - Number of columns.
+ * @param array - Array to store matrix in.
+ */
+void matrix_q2_14_create(matrix_q2_14_t * m,
+                         uint16_t rows,
+                         uint16_t cols,
+                         q2_14_t * array);
+
+/**
+ * @brief Converts a q16_16_t matrix to a q2_14_t matrix.
+ * @details Elements are rounded to nearest and saturated to [-2, 2).
+ * @param src - Matrix to convert.
+ * @param dst - Converted matrix.
+ * @return Pointer to the destination.
+ */
+matrix_q2_14_t * matrix_to_q2_14(const matrix_t * src, matrix_q2_14_t * dst);
+
+/**
+ * @brief Multiplies a coefficient matrix with a matrix, prod = a * b.
+ * @param a - Coefficient factor.
+ * @param b - Second factor.
+ * @param prod - Product of a and b.
+ * @return Pointer to the result.
+ */
+matrix_t * matrix_q2_14_mult(const matrix_q2_14_t * a, const matrix_t * b,
+        matrix_t * prod);
+
+/**
+ * @brief Multiplies all elements in a coefficient matrix by a scalar factor.
+ * @param m - Coefficient matrix factor.
+ * @param factor - Scalar factor.
+ * @param result - result of the multiplication.
+ * @return Pointer to the result.
+ */
+matrix_t * matrix_q2_14_mult_elements(const matrix_q2_14_t * m,
+        q16_16_t factor, matrix_t * result);
+
 /**
  * @brief Checks is two matricies have the same dimension.
  * @param a
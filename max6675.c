@@ -13,7 +13,7 @@
 #include "gpio.h"
 #include "status.h"
 #include "timers.h"
-#include "flash.h"
+#include "params.h"
 
 // =============================================================================
 // Private type definitions
@@ -63,7 +63,11 @@ static volatile uint16_t ic2_reading;
 static volatile filter_buffer_t filter_buffer;
 static uint16_t filter_len = 16;
 
+// Generation of the parameters filter_len was read from, see params.h
+static uint16_t params_generation = 0;
+
 static volatile uint32_t last_reading_timestamp;
+static volatile uint16_t last_raw_reading;
 static volatile bool first_reading_complete = false;
 
 // =============================================================================
@@ -76,6 +80,12 @@ static volatile bool first_reading_complete = false;
  */
 static void add_reading(uint16_t temp);
 
+/**
+ * @brief Reads the filter length from the parameters, limited to the filter
+ * buffer, and restarts the filter if the length changed.
+ */
+static void update_filter_len(void);
+
 // =============================================================================
 // Public function definitions
 // =============================================================================
@@ -112,14 +122,7 @@ void max6675_init(void)
     first_reading_complete = false;
     last_reading_timestamp = 0;
 
-    filter_len = flash_read_dword(FLASH_INDEX_FILTER_LEN);
-
-    if (filter_len > FILTER_BUFFER_SIZE)
-    {
-        flash_init_write_buffer();
-        flash_write_dword_to_buffer(FLASH_INDEX_FILTER_LEN, FILTER_BUFFER_SIZE);
-        flash_write_buffer_to_flash();
-    }
+    update_filter_len();
 
     IFS0bits.SPI1IF = 0;
     IEC0bits.SPI1IE = 1;
@@ -158,6 +161,14 @@ void max6675_init(void)
 
 void max6675_start_temp_reading(void)
 {
+    if (params_get_generation() != params_generation)
+    {
+        // Read and restart the filter before the next reading is added
+        IEC0bits.SPI1IE = 0;
+        update_filter_len();
+        IEC0bits.SPI1IE = 1;
+    }
+
     read_state = READ_STATE_READING_IC_1;
 
     MAX6675_1_CS_ON;
@@ -169,6 +180,11 @@ uint16_t max6675_get_current_temp(void)
     return filter_buffer.mean;
 }
 
+uint16_t max6675_get_raw_temp(void)
+{
+    return last_raw_reading;
+}
+
 uint32_t max6675_get_last_reading_time(void)
 {
     volatile uint32_t t1;
@@ -256,6 +272,7 @@ static void add_reading(uint16_t temp)
         filter_buffer.mean = filter_buffer.sum / filter_buffer.size;
     }
 
+    last_raw_reading = temp;
     last_reading_timestamp = timers_get_millis();
     first_reading_complete = true;
 
@@ -265,6 +282,34 @@ static void add_reading(uint16_t temp)
     }
 }
 
+static void update_filter_len(void)
+{
+    uint16_t len = params_get()->filter_len;
+
+    if (len > FILTER_BUFFER_SIZE)
+    {
+        params_set_filter_len(FILTER_BUFFER_SIZE);
+    }
+    else if (0 == len)
+    {
+        params_set_filter_len(1);
+    }
+
+    params_generation = params_get_generation();
+    len = params_get()->filter_len;
+
+    // Other parameters change the generation too, keep the filter then so
+    // the temperature does not step during a reflow
+    if (len != filter_len)
+    {
+        filter_len = len;
+
+        // The next reading refills the filter from scratch, the mean is
+        // kept until then
+        filter_buffer.size = 0;
+    }
+}
+
 void __attribute__((interrupt, no_auto_psv)) _SPI1Interrupt(void)
 {
     bool parse_read_values = false;
@@ -45,6 +45,12 @@ void max6675_start_temp_reading(void);
  */
 uint16_t max6675_get_current_temp(void);
 
+/**
+ * @brief The last temperature reading, before filtering.
+ * @return last temperature reading in degrees celcius * 4.
+ */
+uint16_t max6675_get_raw_temp(void);
+
 /**
  * @brief Gets the timestamp of when the last reading was completed.
  * @return timestamp of last reading completion timestamp.
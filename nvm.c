@@ -0,0 +1,271 @@
+/*
+ * This file implements the program memory operations of nvm.h with the table
+ * instructions of the PIC24F.
+ *
+ * The 16 bit words passed to tblwtl/tblrdl are the 16 LSB of an instruction,
+ * the 8 MSB are accessed with tblwth/tblrdh. Two program memory addresses are
+ * used per instruction.
+ *
+ * References:
+ * Document number: DS30009715C, PIC24F Flash Program Memory
+ * Document number: DS39715A, Section 4. Program Memory
+ * Document number: DS39747D, PIC24FJ128GA010 Family Data Sheet
+ */
+
+// =============================================================================
+// Include statements
+// =============================================================================
+
+#include "nvm.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <xc.h>
+
+// =============================================================================
+// Private type definitions
+// =============================================================================
+
+// =============================================================================
+// Global variables
+// =============================================================================
+
+// =============================================================================
+// Private constants
+// =============================================================================
+
+// Program memory addresses per erase block, two for each instruction
+#define WORDS_PER_ERASE_BLOCK           (NVM_INSTRUCTIONS_PER_ERASE_BLOCK * 2)
+
+//
+// NVMCON operations, reference: DS39747D-page 48
+//
+#define NVMOP_WORD_PROGRAM              0x3
+#define NVMOP_ROW_PROGRAM               0x1
+#define NVMOP_BLOCK_ERASE               0x2
+
+// =============================================================================
+// Private variables
+// =============================================================================
+
+// Each element of a space(prog) array takes one instruction, so the arrays
+// are sized in instructions while the alignment is in program memory
+// addresses. The log and the recorder are left erased when the device is
+// programmed.
+const uint16_t flash_log[NVM_LOG_BLOCKS * NVM_INSTRUCTIONS_PER_ERASE_BLOCK] __attribute__((space(prog),noload,aligned(WORDS_PER_ERASE_BLOCK)));
+
+const uint16_t flash_record[NVM_RECORD_BLOCKS * NVM_INSTRUCTIONS_PER_ERASE_BLOCK] __attribute__((space(prog),noload,aligned(WORDS_PER_ERASE_BLOCK)));
+
+const uint16_t flash_data[NVM_DATA_BLOCKS * NVM_INSTRUCTIONS_PER_ERASE_BLOCK] __attribute__((space(prog),aligned(WORDS_PER_ERASE_BLOCK))) =
+{
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0000
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0008
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0010
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0018
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0020
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0028
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0030
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0038
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0040
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0048
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0050
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0058
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0060
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0068
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0070
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0078
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0080
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0088
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0090
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x0098
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00A0
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00A8
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00B0
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00B8
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00C0
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00C8
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00D0
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00D8
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00E0
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00E8
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,    // 0x00F0
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000     // 0x00F8
+};
+
+// =============================================================================
+// Private function declarations
+// =============================================================================
+
+/**
+ * @brief Sets TBLPAG and gets the table offset of an instruction.
+ * @param region - The region.
+ * @param instr - Index of the instruction within the region.
+ * @return Table offset of the instruction.
+ */
+static uint16_t set_address(nvm_region_t region, uint16_t instr);
+
+/**
+ * @brief Starts the NVM operation set up in NVMCON and waits for it to
+ * finish.
+ */
+static void write_nvm(void);
+
+// =============================================================================
+// Public function definitions
+// =============================================================================
+
+uint16_t nvm_read_low(nvm_region_t region, uint16_t instr)
+{
+    uint16_t read_word;
+    uint16_t addr_offset = set_address(region, instr);
+
+    asm("tblrdl.w [%1], %0" : "=r"(read_word) : "r"(addr_offset));
+
+    return read_word;
+}
+
+uint8_t nvm_read_high(nvm_region_t region, uint16_t instr)
+{
+    uint16_t addr_offset = set_address(region, instr);
+
+    return (uint8_t)__builtin_tblrdh(addr_offset);
+}
+
+/**
+ * Reference: DS30009715C-page 16
+ */
+void nvm_erase_block(nvm_region_t region, uint16_t block)
+{
+    uint16_t offset;
+
+    NVMCONbits.NVMOP = NVMOP_BLOCK_ERASE;
+
+    // Perform the erase operation specified by NVMOP3:NVMOP0 on the next WR command
+    NVMCONbits.ERASE = 1;
+
+    // Enable Flash program/erase operations
+    NVMCONbits.WREN = 1;
+
+    // Set up the address
+    offset = set_address(region, block * (uint16_t)NVM_INSTRUCTIONS_PER_ERASE_BLOCK);
+    __builtin_tblwtl(offset, 0); // Dummy TBLWT to load address
+
+    write_nvm();
+}
+
+/*
+ * From DS39715A-page 4-17:
+ *
+
+The user can program one row of program Flash memory at a time. To do this, it is necessary to
+erase the 8-row erase block containing the desired row. The general process is:
+1. Read eight rows of program memory (512 instructions) and store in data RAM.
+2. Update the program data in RAM with the desired new data.
+3. Erase the block:
+a) Set the NVMOP bits (NVMCOM<3:0>) to ?0010? to configure for block erase. Set the
+ERASE (NVMCOM<6>) and WREN (NVMCOM<14>) bits.
+b) Write the starting address of the block to be erased into the TBLPAG and W registers.
+c) Write 55h to NVMKEY.
+d) Write AAh to NVMKEY.
+e) Set the WR bit (NVMCOM<15>). The erase cycle begins and the CPU stalls for the
+duration of the erase cycle. When the erase is done, the WR bit is cleared automatically.
+4. Write the first 64 instructions from data RAM into the program memory buffers (see Section 4.5
+?Program Memory Writes?).
+5. Write the program block to Flash memory:
+a) Set the NVMOP bits to ?0001? to configure for row programming. Clear the ERASE
+bit and set the WREN bit.
+b) Write 55h to NVMKEY.
+c) Write AAh to NVMKEY.
+d) Set the WR bit. The programming cycle begins and the CPU stalls for the duration of the
+write cycle. When the write to Flash memory is done, the WR bit is cleared automatically.
+6. Repeat steps 4 and 5, using the next available 64 instructions from the block in data RAM
+by incrementing the value in TBLPAG, until all 512 instructions are written back to Flash
+memory.
+For protection against accidental operations, the write initiate sequence for NVMKEY must be
+used to allow any erase or program operation to proceed. After the programming command has
+been executed, the user must wait for the programming time until programming is complete. The
+two instructions following the start of the programming sequence should be NOPs, as shown in
+Section 4.6.4.2 ?NVMKEY Register?.
+
+ */
+void nvm_program_row(nvm_region_t region,
+                     uint16_t row,
+                     const uint16_t * data,
+                     const uint8_t * high)
+{
+    uint16_t instr;
+    uint16_t offset;
+
+    // Memory row program operation (ERASE = 0) or no operation (ERASE = 1)
+    NVMCONbits.NVMOP = NVMOP_ROW_PROGRAM;
+    NVMCONbits.ERASE = 0;
+    NVMCONbits.WREN = 1;
+
+    offset = set_address(region, row * (uint16_t)NVM_INSTRUCTIONS_PER_ROW);
+
+    for (instr = 0; instr != NVM_INSTRUCTIONS_PER_ROW; ++instr)
+    {
+        uint8_t high_data = (NULL != high) ? high[instr] : 0x00;
+        uint16_t addr = offset + (instr * 2);
+
+        __builtin_tblwtl(addr, data[instr]);
+        __builtin_tblwth(addr, high_data);
+    }
+
+    write_nvm();
+}
+
+void nvm_program_word(nvm_region_t region,
+                      uint16_t instr,
+                      uint16_t low,
+                      uint8_t high)
+{
+    uint16_t offset;
+
+    // Memory word program operation (ERASE = 0)
+    NVMCONbits.NVMOP = NVMOP_WORD_PROGRAM;
+    NVMCONbits.ERASE = 0;
+    NVMCONbits.WREN = 1;
+
+    offset = set_address(region, instr);
+
+    __builtin_tblwtl(offset, low);
+    __builtin_tblwth(offset, high);
+
+    write_nvm();
+}
+
+// =============================================================================
+// Private function definitions
+// =============================================================================
+
+static uint16_t set_address(nvm_region_t region, uint16_t instr)
+{
+    if (NVM_REGION_LOG == region)
+    {
+        TBLPAG = __builtin_tblpage(flash_log);
+        return __builtin_tbloffset(flash_log) + 2 * instr;
+    }
+
+    if (NVM_REGION_RECORD == region)
+    {
+        TBLPAG = __builtin_tblpage(flash_record);
+        return __builtin_tbloffset(flash_record) + 2 * instr;
+    }
+
+    TBLPAG = __builtin_tblpage(flash_data);
+    return __builtin_tbloffset(flash_data) + 2 * instr;
+}
+
+static void write_nvm(void)
+{
+    // Start sequence accoding to doc: DS39715A-page 4-16
+    __builtin_disi(5);
+    __builtin_write_NVM();
+
+    while (NVMCONbits.WR)
+    {
+        ;
+    }
+}
@@ -0,0 +1,115 @@
+/*
+ * This file contains the low level program memory operations used by flash.c.
+ *
+ * The program memory used for data storage is divided into regions, each
+ * made up of whole erase blocks. Instructions are addressed by their index
+ * within the region. An erase block holds NVM_ROWS_PER_ERASE_BLOCK rows of
+ * NVM_INSTRUCTIONS_PER_ROW instructions. An erased instruction reads as
+ * 0xFFFFFF, and programming can only clear bits.
+ *
+ * nvm.c implements the operations with table instructions on the device.
+ * host/nvm_host.c implements them on a file for host builds.
+ */
+
+#ifndef NVM_H
+#define	NVM_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+// =============================================================================
+// Include statements
+// =============================================================================
+
+#include <stdint.h>
+
+// =============================================================================
+// Public type definitions
+// =============================================================================
+
+typedef enum
+{
+    NVM_REGION_DATA = 0,    // Data blocks, see flash.c
+    NVM_REGION_LOG,         // Parameter log, see flash.c
+    NVM_REGION_RECORD,      // Reflow run recorder, see recorder.c
+    NVM_NBR_OF_REGIONS
+} nvm_region_t;
+
+// =============================================================================
+// Global variable declarations
+// =============================================================================
+
+// =============================================================================
+// Global constatants
+// =============================================================================
+
+#define NVM_INSTRUCTIONS_PER_ROW            64
+#define NVM_ROWS_PER_ERASE_BLOCK            8
+#define NVM_INSTRUCTIONS_PER_ERASE_BLOCK    (NVM_INSTRUCTIONS_PER_ROW *        \
+                                             NVM_ROWS_PER_ERASE_BLOCK)
+
+// Number of erase blocks in each region
+#define NVM_DATA_BLOCKS                     2
+#define NVM_LOG_BLOCKS                      2
+#define NVM_RECORD_BLOCKS                   8
+
+// =============================================================================
+// Public function declarations
+// =============================================================================
+
+/**
+ * @brief Reads the 16 LSB of one instruction.
+ * @param region - The region.
+ * @param instr - Index of the instruction within the region.
+ * @return BIT0 - BIT15 of the instruction.
+ */
+uint16_t nvm_read_low(nvm_region_t region, uint16_t instr);
+
+/**
+ * @brief Reads the 8 MSB of one instruction.
+ * @param region - The region.
+ * @param instr - Index of the instruction within the region.
+ * @return BIT16 - BIT23 of the instruction.
+ */
+uint8_t nvm_read_high(nvm_region_t region, uint16_t instr);
+
+/**
+ * @brief Erases one erase block. Stalls the CPU until done.
+ * @param region - The region.
+ * @param block - Index of the erase block within the region.
+ */
+void nvm_erase_block(nvm_region_t region, uint16_t block);
+
+/**
+ * @brief Programs one row of an erased block. Stalls the CPU until done.
+ * @param region - The region.
+ * @param row - Index of the row within the region.
+ * @param data - NVM_INSTRUCTIONS_PER_ROW words for the 16 LSB of each
+ * instruction.
+ * @param high - NVM_INSTRUCTIONS_PER_ROW bytes for the 8 MSB of each
+ * instruction, or NULL to program them to 0.
+ */
+void nvm_program_row(nvm_region_t region,
+                     uint16_t row,
+                     const uint16_t * data,
+                     const uint8_t * high);
+
+/**
+ * @brief Programs one erased instruction. Stalls the CPU until done.
+ * @param region - The region.
+ * @param instr - Index of the instruction within the region.
+ * @param low - BIT0 - BIT15 of the instruction.
+ * @param high - BIT16 - BIT23 of the instruction.
+ */
+void nvm_program_word(nvm_region_t region,
+                      uint16_t instr,
+                      uint16_t low,
+                      uint8_t high);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* NVM_H */
+
@@ -0,0 +1,123 @@
+// =============================================================================
+// Include statements
+// =============================================================================
+
+#include "params.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fixed_point.h"
+#include "flash.h"
+
+// =============================================================================
+// Private type definitions
+// =============================================================================
+
+// =============================================================================
+// Global variables
+// =============================================================================
+
+// =============================================================================
+// Private constants
+// =============================================================================
+
+// =============================================================================
+// Private variables
+// =============================================================================
+
+static params_t params;
+static uint16_t generation = 0;
+
+// =============================================================================
+// Private function declarations
+// =============================================================================
+
+/**
+ * @brief Updates one cached parameter and writes it to flash, if it changed.
+ * @param param - The cached parameter.
+ * @param index - Where the parameter is stored in flash.
+ * @param value - The new value.
+ */
+static void set_param(q16_16_t * param, flash_index_t index, q16_16_t value);
+
+// =============================================================================
+// Public function definitions
+// =============================================================================
+
+void params_init(void)
+{
+    params.k            = (q16_16_t)flash_read_dword(FLASH_INDEX_K);
+    params.ti           = (q16_16_t)flash_read_dword(FLASH_INDEX_TI);
+    params.td           = (q16_16_t)flash_read_dword(FLASH_INDEX_TD);
+    params.ttr          = (q16_16_t)flash_read_dword(FLASH_INDEX_TTR);
+    params.d_max_gain   = (q16_16_t)flash_read_dword(FLASH_INDEX_D_MAX_GAIN);
+    params.servo_factor = (q16_16_t)flash_read_dword(FLASH_INDEX_SERVO_FACTOR);
+    params.filter_len   = (uint16_t)flash_read_dword(FLASH_INDEX_FILTER_LEN);
+
+    ++generation;
+}
+
+const params_t * params_get(void)
+{
+    return &params;
+}
+
+uint16_t params_get_generation(void)
+{
+    return generation;
+}
+
+void params_set_k(q16_16_t k)
+{
+    set_param(&params.k, FLASH_INDEX_K, k);
+}
+
+void params_set_ti(q16_16_t ti)
+{
+    set_param(&params.ti, FLASH_INDEX_TI, ti);
+}
+
+void params_set_td(q16_16_t td)
+{
+    set_param(&params.td, FLASH_INDEX_TD, td);
+}
+
+void params_set_ttr(q16_16_t ttr)
+{
+    set_param(&params.ttr, FLASH_INDEX_TTR, ttr);
+}
+
+void params_set_d_max_gain(q16_16_t d_max_gain)
+{
+    set_param(&params.d_max_gain, FLASH_INDEX_D_MAX_GAIN, d_max_gain);
+}
+
+void params_set_servo_factor(q16_16_t servo_factor)
+{
+    set_param(&params.servo_factor, FLASH_INDEX_SERVO_FACTOR, servo_factor);
+}
+
+void params_set_filter_len(uint16_t filter_len)
+{
+    if (params.filter_len != filter_len)
+    {
+        params.filter_len = filter_len;
+        flash_write_dword(FLASH_INDEX_FILTER_LEN, filter_len);
+        ++generation;
+    }
+}
+
+// =============================================================================
+// Private function definitions
+// =============================================================================
+
+static void set_param(q16_16_t * param, flash_index_t index, q16_16_t value)
+{
+    if (*param != value)
+    {
+        *param = value;
+        flash_write_dword(index, (uint32_t)value);
+        ++generation;
+    }
+}
@@ -0,0 +1,122 @@
+/**
+ * This unit contains a RAM cache of the parameters stored in the flash data
+ * memory.
+ *
+ * The parameters are read from flash at boot, and again when the flash data
+ * memory buffer is reloaded or written directly. Setting a parameter
+ * updates the cache, writes it to flash and increments the generation
+ * counter, so consumers can check if they need to recompute anything derived
+ * from the parameters.
+ */
+
+#ifndef PARAMS_H
+#define	PARAMS_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+// =============================================================================
+// Include statements
+// =============================================================================
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fixed_point.h"
+
+// =============================================================================
+// Public type definitions
+// =============================================================================
+
+typedef struct params_t
+{
+    q16_16_t k;             // PID gain
+    q16_16_t ti;            // PID integral time constant
+    q16_16_t td;            // PID derivative time constant
+    q16_16_t ttr;           // PID integral tracking time constant
+    q16_16_t d_max_gain;    // Max gain of the PID derivative term
+    q16_16_t servo_factor;  // Scaling between heater and servo output
+    uint16_t filter_len;    // Length of the temperature filter
+} params_t;
+
+// =============================================================================
+// Global variable declarations
+// =============================================================================
+
+// =============================================================================
+// Global constatants
+// =============================================================================
+
+// =============================================================================
+// Public function declarations
+// =============================================================================
+
+/**
+ * @brief Loads the parameters from the flash data memory and increments the
+ * generation.
+ * @details Must be called after flash_init(), and after anything else than
+ * the setters below changes the parameter area of the flash data memory.
+ */
+void params_init(void);
+
+/**
+ * @brief Gets the cached parameters.
+ * @return The parameters, use the setters below to change them.
+ */
+const params_t * params_get(void);
+
+/**
+ * @brief Gets the generation of the parameters.
+ * @details The generation is incremented every time a parameter changes.
+ * @return The generation.
+ */
+uint16_t params_get_generation(void);
+
+/**
+ * @brief Sets the PID gain.
+ * @param k - The gain.
+ */
+void params_set_k(q16_16_t k);
+
+/**
+ * @brief Sets the PID integral time constant.
+ * @param ti - The time constant in seconds.
+ */
+void params_set_ti(q16_16_t ti);
+
+/**
+ * @brief Sets the PID derivative time constant.
+ * @param td - The time constant in seconds.
+ */
+void params_set_td(q16_16_t td);
+
+/**
+ * @brief Sets the PID integral tracking time constant.
+ * @param ttr - The time constant in seconds.
+ */
+void params_set_ttr(q16_16_t ttr);
+
+/**
+ * @brief Sets the max gain of the PID derivative term.
+ * @param d_max_gain - The max gain.
+ */
+void params_set_d_max_gain(q16_16_t d_max_gain);
+
+/**
+ * @brief Sets the servo output scaling factor.
+ * @param servo_factor - The scaling factor, stored as given.
+ */
+void params_set_servo_factor(q16_16_t servo_factor);
+
+/**
+ * @brief Sets the length of the moving average temperature filter.
+ * @param filter_len - The length.
+ */
+void params_set_filter_len(uint16_t filter_len);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* PARAMS_H */
@@ -0,0 +1,611 @@
+/*
+ * This file manages the library of reflow profiles stored in the flash data
+ * memory, see profile.h for a description of the storage format.
+ *
+ * Profiles are accessed through the directory, so selecting and loading a
+ * profile never has to scan through the other profiles.
+ */
+
+// =============================================================================
+// Include statements
+// =============================================================================
+
+#include "profile.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fixed_point.h"
+#include "flash.h"
+
+// =============================================================================
+// Private type definitions
+// =============================================================================
+
+typedef struct default_profile_t
+{
+    const char * name;
+    int16_t start_temp;
+    uint16_t soak_start;
+    uint16_t reflow_start;
+    uint16_t cool_start;
+    const uint16_t * points;
+    uint8_t nbr_of_points;
+} default_profile_t;
+
+// =============================================================================
+// Global variables
+// =============================================================================
+
+// =============================================================================
+// Private constants
+// =============================================================================
+
+//
+// Offsets within a directory entry
+//
+#define ENTRY_NAME              0
+#define ENTRY_FIRST_POINT       6
+#define ENTRY_NBR_OF_POINTS     7
+#define ENTRY_START_TEMP        8
+#define ENTRY_PHASE_START       10
+
+// Number of points which fit in the point pool
+#define POINT_POOL_SIZE ((FLASH_INDEX_PROFILE_POINTS_END -                     \
+                          FLASH_INDEX_PROFILE_POINTS_START + 1) / 2)
+
+//
+// Default profiles, written when the flash data memory is empty
+//
+static const uint16_t DEFAULT_LEAD_FREE_POINTS[] =
+{
+    PROFILE_POINT(30, 75),      // 100 C at 30 s
+    PROFILE_POINT(30, 50),      // 150 C at 60 s
+    PROFILE_POINT(30, 20),      // 170 C at 90 s
+    PROFILE_POINT(30, 30),      // 200 C at 120 s
+    PROFILE_POINT(30, 40),      // 240 C at 150 s
+    PROFILE_POINT(10, 10),      // 250 C at 160 s
+    PROFILE_POINT(30, 0),       // 250 C at 190 s
+    PROFILE_POINT(25, -88),     // 162 C at 215 s
+    PROFILE_POINT(25, -87)      // 75 C at 240 s
+};
+
+static const uint16_t DEFAULT_LEAD_POINTS[] =
+{
+    PROFILE_POINT(90, 125),     // 150 C at 90 s
+    PROFILE_POINT(90, 30),      // 180 C at 180 s
+    PROFILE_POINT(30, 40),      // 220 C at 210 s
+    PROFILE_POINT(30, 0),       // 220 C at 240 s
+    PROFILE_POINT(60, -60),     // 160 C at 300 s
+    PROFILE_POINT(70, -85)      // 75 C at 370 s
+};
+
+static const default_profile_t DEFAULT_PROFILES[] =
+{
+    {
+        "PbFree", 25, 60, 140, 200,
+        DEFAULT_LEAD_FREE_POINTS,
+        sizeof(DEFAULT_LEAD_FREE_POINTS) / sizeof(uint16_t)
+    },
+    {
+        "SnPb", 25, 90, 190, 270,
+        DEFAULT_LEAD_POINTS,
+        sizeof(DEFAULT_LEAD_POINTS) / sizeof(uint16_t)
+    }
+};
+
+#define NBR_OF_DEFAULT_PROFILES                                                \
+    (sizeof(DEFAULT_PROFILES) / sizeof(default_profile_t))
+
+#define DEFAULT_PROFILE_LEAD_FREE   0
+#define DEFAULT_PROFILE_LEAD        1
+
+// =============================================================================
+// Private variables
+// =============================================================================
+
+// =============================================================================
+// Private function declarations
+// =============================================================================
+
+/**
+ * @brief Gets the flash index of a directory entry.
+ * @param index - Index of the profile.
+ * @return Flash index of the first byte in the directory entry.
+ */
+static uint16_t entry_index(uint8_t index);
+
+/**
+ * @brief Gets the flash index of the selected profile for a switch position.
+ * @param variant - Position of the profile switch.
+ * @return Flash index of the byte holding the selected profile.
+ */
+static uint16_t selected_index(temp_curve_variant_t variant);
+
+/**
+ * @brief Writes the name of a profile to the flash write buffer.
+ * @param entry - Flash index of the directory entry.
+ * @param name - The name, padded with '\0' to PROFILE_NAME_LEN chars.
+ */
+static void write_name_to_buffer(uint16_t entry, const char * name);
+
+/**
+ * @brief Gets how many words a profile uses in the point pool.
+ * @param index - Index of the profile.
+ * @return Number of words.
+ */
+static uint16_t pool_words(uint8_t index);
+
+/**
+ * @brief Moves the points of all profiles but one to the start of the point
+ * pool, without gaps, and updates their directory entries.
+ * @param skip - Index of the profile which is left out, its points are
+ * overwritten.
+ * @return Index of the first free point after the moved profiles.
+ */
+static uint16_t compact_pool(uint8_t skip);
+
+/**
+ * @brief Expands a segment program to points.
+ * @param entry - Flash index of the directory entry.
+ * @param points - Where to store the points, or NULL to only count them.
+ * @param max_points - Max number of points to expand to, at least 1.
+ * @param phase_start - Start of the phases which are started by a segment
+ * are stored here, unless NULL.
+ * @return Number of points, including the start point.
+ */
+static uint8_t expand_program(uint16_t entry,
+                              temp_curve_calib_point_t * points,
+                              uint8_t max_points,
+                              uint16_t * phase_start);
+
+// =============================================================================
+// Public function definitions
+// =============================================================================
+
+void profile_write_defaults_to_buffer(void)
+{
+    uint8_t first_point = 0;
+    uint8_t i;
+
+    for (i = 0; i != NBR_OF_DEFAULT_PROFILES; ++i)
+    {
+        const default_profile_t * profile = &DEFAULT_PROFILES[i];
+        uint16_t entry = entry_index(i);
+        uint8_t j;
+
+        write_name_to_buffer(entry, profile->name);
+        flash_write_byte_to_buffer(entry + ENTRY_FIRST_POINT, first_point);
+        flash_write_byte_to_buffer(entry + ENTRY_NBR_OF_POINTS,
+                                   profile->nbr_of_points);
+        flash_write_word_to_buffer(entry + ENTRY_START_TEMP,
+                                   (uint16_t)profile->start_temp);
+        flash_write_word_to_buffer(entry + ENTRY_PHASE_START,
+                                   profile->soak_start);
+        flash_write_word_to_buffer(entry + ENTRY_PHASE_START + 2,
+                                   profile->reflow_start);
+        flash_write_word_to_buffer(entry + ENTRY_PHASE_START + 4,
+                                   profile->cool_start);
+
+        for (j = 0; j != profile->nbr_of_points; ++j)
+        {
+            flash_write_word_to_buffer(FLASH_INDEX_PROFILE_POINTS_START +
+                                       2 * (uint16_t)(first_point + j),
+                                       profile->points[j]);
+        }
+
+        first_point += profile->nbr_of_points;
+    }
+
+    flash_write_byte_to_buffer(FLASH_INDEX_PROFILE_COUNT,
+                               NBR_OF_DEFAULT_PROFILES);
+    flash_write_byte_to_buffer(FLASH_INDEX_PROFILE_SELECTED_LEAD_FREE,
+                               DEFAULT_PROFILE_LEAD_FREE);
+    flash_write_byte_to_buffer(FLASH_INDEX_PROFILE_SELECTED_LEAD,
+                               DEFAULT_PROFILE_LEAD);
+}
+
+uint8_t profile_get_count(void)
+{
+    uint8_t count = flash_read_byte(FLASH_INDEX_PROFILE_COUNT);
+
+    if (count > PROFILE_MAX_COUNT)
+    {
+        count = PROFILE_MAX_COUNT;
+    }
+
+    return count;
+}
+
+void profile_get_name(uint8_t index, char * name)
+{
+    uint16_t entry = entry_index(index);
+    uint8_t i;
+
+    for (i = 0; i != PROFILE_NAME_LEN; ++i)
+    {
+        name[i] = (char)flash_read_byte(entry + ENTRY_NAME + i);
+    }
+
+    name[PROFILE_NAME_LEN] = '\0';
+}
+
+uint8_t profile_get_nbr_of_points(uint8_t index)
+{
+    uint16_t entry = entry_index(index);
+    uint8_t nbr_of_points = flash_read_byte(entry + ENTRY_NBR_OF_POINTS);
+
+    if (nbr_of_points & PROFILE_PROGRAM_FLAG)
+    {
+        return expand_program(entry, NULL, PROFILE_MAX_POINTS + 1, NULL);
+    }
+
+    return nbr_of_points + 1;
+}
+
+uint8_t profile_get_selected(temp_curve_variant_t variant)
+{
+    uint8_t index = flash_read_byte(selected_index(variant));
+
+    if (index >= profile_get_count())
+    {
+        index = 0;
+    }
+
+    return index;
+}
+
+bool profile_select(temp_curve_variant_t variant, uint8_t index)
+{
+    if (index >= profile_get_count())
+    {
+        return false;
+    }
+
+    flash_write_byte(selected_index(variant), index);
+
+    return true;
+}
+
+uint16_t profile_get_phase_start(uint8_t index, temp_curve_phase_t phase)
+{
+    return flash_read_word(entry_index(index) + ENTRY_PHASE_START +
+                           2 * (uint16_t)phase);
+}
+
+void profile_set_phase_start(uint8_t index,
+                             temp_curve_phase_t phase,
+                             uint16_t time)
+{
+    flash_write_word(entry_index(index) + ENTRY_PHASE_START +
+                     2 * (uint16_t)phase,
+                     time);
+}
+
+bool profile_write_program(uint8_t index,
+                           const char * name,
+                           int16_t start_temp,
+                           const profile_segment_t * segments,
+                           uint8_t nbr_of_segments)
+{
+    uint8_t count = profile_get_count();
+    uint16_t words = 2 * (uint16_t)nbr_of_segments;
+    uint16_t first_point = 0;
+    uint16_t entry = entry_index(index);
+    uint8_t i;
+
+    if ((index > count) || (index >= PROFILE_MAX_COUNT) ||
+        (nbr_of_segments > PROFILE_MAX_SEGMENTS))
+    {
+        return false;
+    }
+
+    if ((index < count) && (words <= pool_words(index)))
+    {
+        first_point = flash_read_byte(entry + ENTRY_FIRST_POINT);
+    }
+    else
+    {
+        // Reclaim the old space and any gaps, then place the segments after
+        // the other profiles
+        first_point = compact_pool(index);
+    }
+
+    if ((first_point > UINT8_MAX) || (first_point + words > POINT_POOL_SIZE))
+    {
+        return false;
+    }
+
+    write_name_to_buffer(entry, name);
+    flash_write_byte_to_buffer(entry + ENTRY_FIRST_POINT, (uint8_t)first_point);
+    flash_write_byte_to_buffer(entry + ENTRY_NBR_OF_POINTS,
+                               PROFILE_PROGRAM_FLAG | nbr_of_segments);
+    flash_write_word_to_buffer(entry + ENTRY_START_TEMP, (uint16_t)start_temp);
+
+    for (i = 0; i != TEMP_CURVE_NBR_OF_PHASES; ++i)
+    {
+        flash_write_word_to_buffer(entry + ENTRY_PHASE_START + 2 * i,
+                                   UINT16_MAX);
+    }
+
+    for (i = 0; i != nbr_of_segments; ++i)
+    {
+        const profile_segment_t * segment = &segments[i];
+        uint16_t flash_index = FLASH_INDEX_PROFILE_POINTS_START +
+                               2 * (first_point + 2 * i);
+
+        flash_write_word_to_buffer(flash_index,
+                                   ((uint16_t)segment->phase << 14) |
+                                   (segment->target & PROFILE_MAX_TARGET));
+        flash_write_word_to_buffer(flash_index + 2,
+                                   ((uint16_t)segment->rate << 8) |
+                                   segment->hold);
+    }
+
+    if (index == count)
+    {
+        flash_write_byte_to_buffer(FLASH_INDEX_PROFILE_COUNT, count + 1);
+    }
+
+    flash_request_commit();
+
+    return true;
+}
+
+uint8_t profile_load(uint8_t index,
+                     temp_curve_calib_point_t * points,
+                     uint8_t max_points,
+                     uint16_t * phase_start)
+{
+    uint16_t entry = entry_index(index);
+    uint16_t flash_index;
+    uint16_t first_point;
+    uint8_t nbr_of_points;
+    int16_t temp;
+    uint16_t time = 0;
+    uint8_t i;
+
+    if ((index >= profile_get_count()) || (0 == max_points))
+    {
+        return 0;
+    }
+
+    for (i = 0; i != TEMP_CURVE_NBR_OF_PHASES; ++i)
+    {
+        phase_start[i] = flash_read_word(entry + ENTRY_PHASE_START + 2 * i);
+    }
+
+    if (flash_read_byte(entry + ENTRY_NBR_OF_POINTS) & PROFILE_PROGRAM_FLAG)
+    {
+        return expand_program(entry, points, max_points, phase_start);
+    }
+
+    first_point = flash_read_byte(entry + ENTRY_FIRST_POINT);
+    nbr_of_points = flash_read_byte(entry + ENTRY_NBR_OF_POINTS);
+    temp = (int16_t)flash_read_word(entry + ENTRY_START_TEMP);
+
+    if (nbr_of_points > max_points - 1)
+    {
+        nbr_of_points = max_points - 1;
+    }
+
+    if (first_point + nbr_of_points > POINT_POOL_SIZE)
+    {
+        nbr_of_points = POINT_POOL_SIZE - first_point;
+    }
+
+    points[0].temp = int_to_q16_16(temp);
+    points[0].time = 0;
+
+    flash_index = FLASH_INDEX_PROFILE_POINTS_START + 2 * first_point;
+
+    for (i = 1; i <= nbr_of_points; ++i)
+    {
+        uint16_t point = flash_read_word(flash_index);
+
+        time += point >> 8;
+        temp += (int8_t)(point & 0xFF);
+
+        points[i].temp = int_to_q16_16(temp);
+        points[i].time = time;
+
+        flash_index += 2;
+    }
+
+    return nbr_of_points + 1;
+}
+
+// =============================================================================
+// Private function definitions
+// =============================================================================
+
+static uint16_t entry_index(uint8_t index)
+{
+    return FLASH_INDEX_PROFILE_DIR_START +
+           (uint16_t)index * PROFILE_DIR_ENTRY_SIZE;
+}
+
+static uint16_t selected_index(temp_curve_variant_t variant)
+{
+    if (TEMP_CURVE_LEAD == variant)
+    {
+        return FLASH_INDEX_PROFILE_SELECTED_LEAD;
+    }
+    else
+    {
+        return FLASH_INDEX_PROFILE_SELECTED_LEAD_FREE;
+    }
+}
+
+static void write_name_to_buffer(uint16_t entry, const char * name)
+{
+    uint8_t i;
+
+    for (i = 0; i != PROFILE_NAME_LEN; ++i)
+    {
+        char c = name[i];
+
+        flash_write_byte_to_buffer(entry + ENTRY_NAME + i, c);
+
+        if ('\0' == c)
+        {
+            break;
+        }
+    }
+
+    for (; i != PROFILE_NAME_LEN; ++i)
+    {
+        flash_write_byte_to_buffer(entry + ENTRY_NAME + i, '\0');
+    }
+}
+
+static uint16_t pool_words(uint8_t index)
+{
+    uint8_t nbr_of_points = flash_read_byte(entry_index(index) +
+                                            ENTRY_NBR_OF_POINTS);
+
+    if (nbr_of_points & PROFILE_PROGRAM_FLAG)
+    {
+        return 2 * (uint16_t)(nbr_of_points & ~PROFILE_PROGRAM_FLAG);
+    }
+
+    return nbr_of_points;
+}
+
+static uint16_t compact_pool(uint8_t skip)
+{
+    uint8_t count = profile_get_count();
+    uint16_t moved = 0;     // Bit i set when profile i has been moved
+    uint16_t next_point = 0;
+    uint8_t i;
+
+    // Move the profiles in the order they are stored, so each one moves
+    // down and the pool can be copied in place
+    for (;;)
+    {
+        uint8_t lowest = PROFILE_MAX_COUNT;
+        uint16_t lowest_first = 0;
+        uint16_t first;
+        uint16_t words;
+        uint16_t j;
+
+        for (i = 0; i != count; ++i)
+        {
+            first = flash_read_byte(entry_index(i) + ENTRY_FIRST_POINT);
+
+            if ((i != skip) && !(moved & (1 << i)) &&
+                ((PROFILE_MAX_COUNT == lowest) || (first < lowest_first)))
+            {
+                lowest = i;
+                lowest_first = first;
+            }
+        }
+
+        if (PROFILE_MAX_COUNT == lowest)
+        {
+            return next_point;
+        }
+
+        moved |= 1 << lowest;
+        words = pool_words(lowest);
+
+        if (lowest_first + words > POINT_POOL_SIZE)
+        {
+            words = POINT_POOL_SIZE - lowest_first;
+        }
+
+        for (j = 0; j != words; ++j)
+        {
+            flash_write_word_to_buffer(
+                    FLASH_INDEX_PROFILE_POINTS_START + 2 * (next_point + j),
+                    flash_read_word(FLASH_INDEX_PROFILE_POINTS_START +
+                                    2 * (lowest_first + j)));
+        }
+
+        flash_write_byte_to_buffer(entry_index(lowest) + ENTRY_FIRST_POINT,
+                                   (uint8_t)next_point);
+        next_point += words;
+    }
+}
+
+static uint8_t expand_program(uint16_t entry,
+                              temp_curve_calib_point_t * points,
+                              uint8_t max_points,
+                              uint16_t * phase_start)
+{
+    uint16_t first_point = flash_read_byte(entry + ENTRY_FIRST_POINT);
+    uint8_t nbr_of_segments = flash_read_byte(entry + ENTRY_NBR_OF_POINTS) &
+                              ~PROFILE_PROGRAM_FLAG;
+    uint16_t flash_index;
+    int16_t temp = (int16_t)flash_read_word(entry + ENTRY_START_TEMP);
+    uint16_t time = 0;
+    uint8_t n = 1;
+    uint8_t i;
+
+    if (first_point + 2 * (uint16_t)nbr_of_segments > POINT_POOL_SIZE)
+    {
+        nbr_of_segments = (POINT_POOL_SIZE - first_point) / 2;
+    }
+
+    if (NULL != points)
+    {
+        points[0].temp = int_to_q16_16(temp);
+        points[0].time = 0;
+    }
+
+    flash_index = FLASH_INDEX_PROFILE_POINTS_START + 2 * first_point;
+
+    for (i = 0; i != nbr_of_segments; ++i)
+    {
+        uint16_t target_word = flash_read_word(flash_index);
+        uint16_t ramp_word = flash_read_word(flash_index + 2);
+        int16_t target = (int16_t)(target_word & PROFILE_MAX_TARGET);
+        uint8_t phase = target_word >> 14;
+        uint8_t rate = ramp_word >> 8;
+        uint8_t hold = ramp_word & 0xFF;
+
+        flash_index += 4;
+
+        if ((PROFILE_NO_PHASE != phase) && (NULL != phase_start))
+        {
+            phase_start[phase] = time;
+        }
+
+        if ((target != temp) && (n != max_points))
+        {
+            uint16_t diff = (target > temp) ? target - temp : temp - target;
+
+            // Round the ramp to whole seconds, a step if the rate is 0
+            if (0 != rate)
+            {
+                time += (uint16_t)((10 * (uint32_t)diff + rate / 2) / rate);
+            }
+
+            temp = target;
+
+            if (NULL != points)
+            {
+                points[n].temp = int_to_q16_16(temp);
+                points[n].time = time;
+            }
+
+            ++n;
+        }
+
+        if ((0 != hold) && (n != max_points))
+        {
+            time += hold;
+
+            if (NULL != points)
+            {
+                points[n].temp = int_to_q16_16(temp);
+                points[n].time = time;
+            }
+
+            ++n;
+        }
+    }
+
+    return n;
+}
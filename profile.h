@@ -0,0 +1,212 @@
+/*
+ * This file manages the library of reflow profiles stored in the flash data
+ * memory.
+ *
+ * The library consists of a directory with up to PROFILE_MAX_COUNT named
+ * profiles and a shared pool of delta encoded points. Each position of the
+ * reflow profile switch has a selected profile, which can be changed from
+ * the terminal.
+ *
+ * Directory entry, 16 bytes:
+ *
+ *  Offset | Size | Content
+ *  -------+------+-------------------------------------------------------
+ *  0      | 6    | Name, padded with '\0'
+ *  6      | 1    | Index of the first point in the point pool
+ *  7      | 1    | Number of points, excluding the start point
+ *  8      | 2    | Start temperature in C, at time 0
+ *  10     | 2    | Start of soak in seconds
+ *  12     | 2    | Start of reflow in seconds
+ *  14     | 2    | Start of cooling in seconds
+ *
+ * Point, 2 bytes:
+ *
+ *  ---------------------------------------------------------------------
+ * |  Time since previous point, uint8 s  |  Temperature change, int8 C  |
+ *  ---------------------------------------------------------------------
+ *             BIT8    -    BIT15                 BIT0 -  BIT7
+ *
+ * Segments which are longer than 255 s, or change more than 127 C, are
+ * stored as several points on the same line.
+ *
+ * A profile can also be stored as a segment program, marked by
+ * PROFILE_PROGRAM_FLAG in the number of points byte. The points are then
+ * segments of two words each, which are expanded to points when the profile
+ * is loaded:
+ *
+ *  ---------------------------------------------------------------------
+ * | Starts phase |  Unused  |           Target temperature, C           |
+ *  ---------------------------------------------------------------------
+ *    BIT14-BIT15  BIT12-BIT13              BIT0 - BIT11
+ *
+ *  ---------------------------------------------------------------------
+ * |      Ramp rate, 0.1 C/s, uint8       |     Hold time, uint8 s       |
+ *  ---------------------------------------------------------------------
+ *             BIT8    -    BIT15                 BIT0 -  BIT7
+ *
+ * The start of a phase is taken from the first segment which starts it, and
+ * from the directory entry for phases which no segment starts.
+ */
+
+#ifndef PROFILE_H
+#define	PROFILE_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+// =============================================================================
+// Include statements
+// =============================================================================
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "temp_curve.h"
+
+// =============================================================================
+// Public type definitions
+// =============================================================================
+
+typedef struct profile_segment_t
+{
+    uint16_t target;    // Temperature to ramp to in C
+    uint8_t rate;       // Ramp rate in 0.1 C/s, 0 for a step
+    uint8_t hold;       // Time to hold the target in seconds
+    uint8_t phase;      // Phase started by the segment or PROFILE_NO_PHASE
+} profile_segment_t;
+
+// =============================================================================
+// Global variable declarations
+// =============================================================================
+
+// =============================================================================
+// Global constatants
+// =============================================================================
+
+#define PROFILE_MAX_COUNT       12
+#define PROFILE_NAME_LEN        6
+#define PROFILE_DIR_ENTRY_SIZE  16
+
+// Max number of delta encoded points in one profile
+#define PROFILE_MAX_POINTS      40
+
+// Max number of segments in one segment program, each gives at most 2 points
+#define PROFILE_MAX_SEGMENTS    (PROFILE_MAX_POINTS / 2)
+
+#define PROFILE_PROGRAM_FLAG    0x80
+#define PROFILE_NO_PHASE        3
+#define PROFILE_MAX_TARGET      0x0FFF
+
+// Encodes one point, see the description of the point format above
+#define PROFILE_POINT(dt, dtemp)                                               \
+    ((uint16_t)(((uint16_t)(dt) << 8) | (uint8_t)(int8_t)(dtemp)))
+
+// =============================================================================
+// Public function declarations
+// =============================================================================
+
+/**
+ * @brief Writes the default profile library to the flash write buffer.
+ * @details Used by flash_init() when the flash data memory is empty.
+ */
+void profile_write_defaults_to_buffer(void);
+
+/**
+ * @brief Gets the number of profiles in the library.
+ * @return Number of profiles.
+ */
+uint8_t profile_get_count(void);
+
+/**
+ * @brief Gets the name of a profile.
+ * @param index - Index of the profile.
+ * @param name - Buffer of at least PROFILE_NAME_LEN + 1 chars.
+ */
+void profile_get_name(uint8_t index, char * name);
+
+/**
+ * @brief Gets the number of points in a profile.
+ * @param index - Index of the profile.
+ * @return Number of points, including the start point.
+ */
+uint8_t profile_get_nbr_of_points(uint8_t index);
+
+/**
+ * @brief Gets the profile selected for a position of the profile switch.
+ * @param variant - Position of the profile switch.
+ * @return Index of the selected profile, 0 if the stored index is invalid.
+ */
+uint8_t profile_get_selected(temp_curve_variant_t variant);
+
+/**
+ * @brief Selects which profile to use for a position of the profile switch.
+ * @details The change is committed to flash by the main loop.
+ * @param variant - Position of the profile switch.
+ * @param index - Index of the profile.
+ * @return False if there is no profile with the given index.
+ */
+bool profile_select(temp_curve_variant_t variant, uint8_t index);
+
+/**
+ * @brief Gets when a phase of a profile starts.
+ * @param index - Index of the profile.
+ * @param phase - The phase.
+ * @return Start of the phase in seconds since the start of the reflow program.
+ */
+uint16_t profile_get_phase_start(uint8_t index, temp_curve_phase_t phase);
+
+/**
+ * @brief Sets when a phase of a profile starts.
+ * @details The change is committed to flash by the main loop.
+ * @param index - Index of the profile.
+ * @param phase - The phase.
+ * @param time - Start of the phase in seconds.
+ */
+void profile_set_phase_start(uint8_t index,
+                             temp_curve_phase_t phase,
+                             uint16_t time);
+
+/**
+ * @brief Stores a segment program as a profile.
+ * @details The change is committed to flash by the main loop. The segments
+ * are placed in the space of the replaced profile if they fit. Otherwise the
+ * other profiles are moved to the start of the point pool, which reclaims
+ * the old space, and the segments are placed after them.
+ * @param index - Index of the profile, equal to profile_get_count() to add
+ * a new profile.
+ * @param name - Name of the profile, at most PROFILE_NAME_LEN chars are used.
+ * @param start_temp - Temperature at time 0 in C.
+ * @param segments - The segments.
+ * @param nbr_of_segments - Number of segments, at most PROFILE_MAX_SEGMENTS.
+ * @return False if the index is invalid or there is no room for the
+ * segments.
+ */
+bool profile_write_program(uint8_t index,
+                           const char * name,
+                           int16_t start_temp,
+                           const profile_segment_t * segments,
+                           uint8_t nbr_of_segments);
+
+/**
+ * @brief Decodes the points of a profile, segment programs are expanded.
+ * @param index - Index of the profile.
+ * @param points - Where to store the decoded points, including the start
+ * point at time 0.
+ * @param max_points - Size of points, should be at least
+ * PROFILE_MAX_POINTS + 1.
+ * @param phase_start - Where to store the start of each phase in seconds,
+ * TEMP_CURVE_NBR_OF_PHASES values.
+ * @return Number of decoded points, 0 if there is no such profile.
+ */
+uint8_t profile_load(uint8_t index,
+                     temp_curve_calib_point_t * points,
+                     uint8_t max_points,
+                     uint16_t * phase_start);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* PROFILE_H */
+
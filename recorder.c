@@ -0,0 +1,559 @@
+// =============================================================================
+// Include statements
+// =============================================================================
+
+#include "recorder.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nvm.h"
+
+// =============================================================================
+// Private type definitions
+// =============================================================================
+
+// =============================================================================
+// Global variables
+// =============================================================================
+
+// =============================================================================
+// Private constants
+// =============================================================================
+
+#define INSTRUCTIONS_PER_BLOCK  NVM_INSTRUCTIONS_PER_ERASE_BLOCK
+#define ROWS_PER_REGION         (NVM_RECORD_BLOCKS * NVM_ROWS_PER_ERASE_BLOCK)
+
+//
+// Block types, in BIT16 - BIT23 of the first instruction of a block. Runs
+// recorded with the older sample layout, 0xA0 and 0xA1, are not read.
+//
+#define BLOCK_RUN_START         0xA2
+#define BLOCK_RUN_CONTINUED     0xA3
+
+// Header instructions before the first sample of a block
+#define START_HEADER_SIZE       3
+#define CONTINUED_HEADER_SIZE   1
+
+// BIT16 - BIT23 of an erased instruction, ends a run
+#define ERASED_HIGH             0xFF
+#define ERASED_LOW              0xFFFF
+
+//
+// Sample layout, see recorder.h. The duty never reaches 0xF, so a sample
+// can never read as erased.
+//
+#define DUTY_MAX                0x0D
+#define DUTY_MASK               0x0F
+#define SERVO_MAX               0x7F
+#define SERVO_LOW_BITS          3
+#define SERVO_LOW_MASK          0x07
+#define SERVO_LOW_SHIFT         5
+#define SERVO_HIGH_SHIFT        4
+#define TARGET_CHANGE_MIN       (-16)
+#define TARGET_CHANGE_MAX       15
+#define TARGET_CHANGE_MASK      0x1F
+
+// =============================================================================
+// Private variables
+// =============================================================================
+
+// Type and run number of each block, read at init and kept up to date
+static uint8_t block_type[NVM_RECORD_BLOCKS];
+static uint16_t block_run[NVM_RECORD_BLOCKS];
+
+// Where the next run starts, and its number
+static uint8_t next_block = 0;
+static uint16_t next_run = 0;
+
+//
+// The run being recorded
+//
+static bool recording = false;
+static uint16_t run_number;
+static uint8_t run_first_block;
+static uint8_t write_block;
+static bool erase_pending = false;
+
+// The row being filled, as an index in the region
+static uint16_t row;
+static uint16_t row_low[NVM_INSTRUCTIONS_PER_ROW];
+static uint8_t row_high[NVM_INSTRUCTIONS_PER_ROW];
+static uint8_t row_fill = 0;
+
+static uint16_t last_temp;
+static uint16_t last_target;
+
+//
+// The run opened by recorder_open_run()
+//
+static uint16_t read_run;
+static uint8_t read_block;
+static uint16_t read_instr;
+static uint8_t read_blocks_left;
+static bool read_done = true;
+static uint16_t read_temp;
+static uint16_t read_target;
+
+// =============================================================================
+// Private function declarations
+// =============================================================================
+
+/**
+ * @brief Adds one instruction to the row buffer.
+ * @param low - BIT0 - BIT15 of the instruction.
+ * @param high - BIT16 - BIT23 of the instruction.
+ */
+static void add_to_row(uint16_t low, uint8_t high);
+
+/**
+ * @brief Programs the row buffer, padded with erased instructions, and
+ * moves on to the next row.
+ */
+static void program_row(void);
+
+/**
+ * @brief Continues the run in the next block, or stops recording if that
+ * is the first block of the run.
+ */
+static void continue_in_next_block(void);
+
+/**
+ * @brief Delta encodes one value. Changes which do not fit are clamped, and
+ * the remainder is included in the following changes.
+ * @param value - The value.
+ * @param last - The value as decoded so far, updated.
+ * @param min - Smallest change which fits.
+ * @param max - Largest change which fits.
+ * @return The change.
+ */
+static int8_t encode_change(uint16_t value, uint16_t * last, int8_t min,
+                            int8_t max);
+
+/**
+ * @brief Checks if a block continues a run in the previous block.
+ * @param block - The block.
+ * @param number - Number of the run.
+ * @return True if the block continues the run.
+ */
+static bool is_continued(uint8_t block, uint16_t number);
+
+/**
+ * @brief Counts the samples in one block.
+ * @param block - The block.
+ * @return Number of samples.
+ */
+static uint16_t count_samples(uint8_t block);
+
+/**
+ * @brief Gets the block after another block in the ring.
+ * @param block - The block.
+ * @return The next block.
+ */
+static uint8_t next_in_ring(uint8_t block);
+
+// =============================================================================
+// Public function definitions
+// =============================================================================
+
+void recorder_init(void)
+{
+    bool found = false;
+    uint16_t newest = 0;
+    uint8_t block;
+
+    recording = false;
+    erase_pending = false;
+    read_done = true;
+
+    for (block = 0; block != NVM_RECORD_BLOCKS; ++block)
+    {
+        uint16_t instr = block * (uint16_t)INSTRUCTIONS_PER_BLOCK;
+
+        block_type[block] = nvm_read_high(NVM_REGION_RECORD, instr);
+        block_run[block] = nvm_read_low(NVM_REGION_RECORD, instr);
+
+        if ((BLOCK_RUN_START == block_type[block]) ||
+            (BLOCK_RUN_CONTINUED == block_type[block]))
+        {
+            if (!found || ((int16_t)(block_run[block] - newest) > 0))
+            {
+                newest = block_run[block];
+            }
+
+            found = true;
+        }
+    }
+
+    next_block = 0;
+    next_run = 0;
+
+    if (found)
+    {
+        next_run = newest + 1;
+
+        // The next run starts after the last block of the newest run
+        for (block = 0; block != NVM_RECORD_BLOCKS; ++block)
+        {
+            if (((BLOCK_RUN_START == block_type[block]) ||
+                 (BLOCK_RUN_CONTINUED == block_type[block])) &&
+                (newest == block_run[block]) &&
+                !is_continued(next_in_ring(block), newest))
+            {
+                next_block = next_in_ring(block);
+            }
+        }
+    }
+}
+
+void recorder_start_run(uint8_t profile, const recorder_sample_t * start)
+{
+    recorder_stop_run();
+
+    // The run being read may be overwritten
+    read_done = true;
+
+    run_number = next_run++;
+    run_first_block = next_block;
+    write_block = next_block;
+    row = write_block * (uint16_t)NVM_ROWS_PER_ERASE_BLOCK;
+    row_fill = 0;
+
+    nvm_erase_block(NVM_REGION_RECORD, write_block);
+
+    block_type[write_block] = BLOCK_RUN_START;
+    block_run[write_block] = run_number;
+
+    last_temp = start->temp;
+    last_target = start->target;
+
+    add_to_row(run_number, BLOCK_RUN_START);
+    add_to_row(start->temp, profile);
+    add_to_row(start->target, 0x00);
+
+    recording = true;
+}
+
+void recorder_add_sample(const recorder_sample_t * sample)
+{
+    uint16_t duty;
+    uint16_t servo;
+    uint16_t low;
+    uint8_t high;
+
+    // A full row is programmed by the following recorder_service()
+    if (!recording || (NVM_INSTRUCTIONS_PER_ROW == row_fill))
+    {
+        return;
+    }
+
+    duty = (sample->duty + RECORDER_DUTY_SCALE / 2) / RECORDER_DUTY_SCALE;
+    duty = (duty > DUTY_MAX) ? DUTY_MAX : duty;
+
+    servo = (sample->servo + RECORDER_SERVO_SCALE / 2) / RECORDER_SERVO_SCALE;
+    servo = (servo > SERVO_MAX) ? SERVO_MAX : servo;
+
+    low  = (uint16_t)(uint8_t)encode_change(sample->temp, &last_temp,
+                                            INT8_MIN, INT8_MAX) << 8;
+    low |= (servo & SERVO_LOW_MASK) << SERVO_LOW_SHIFT;
+    low |= (uint8_t)encode_change(sample->target, &last_target,
+                                  TARGET_CHANGE_MIN, TARGET_CHANGE_MAX) &
+           TARGET_CHANGE_MASK;
+
+    high = (uint8_t)(((servo >> SERVO_LOW_BITS) << SERVO_HIGH_SHIFT) | duty);
+
+    add_to_row(low, high);
+}
+
+void recorder_service(void)
+{
+    if (!recording)
+    {
+        return;
+    }
+
+    if (erase_pending)
+    {
+        nvm_erase_block(NVM_REGION_RECORD, write_block);
+        erase_pending = false;
+    }
+    else if (NVM_INSTRUCTIONS_PER_ROW == row_fill)
+    {
+        program_row();
+
+        if (0 == row % NVM_ROWS_PER_ERASE_BLOCK)
+        {
+            continue_in_next_block();
+        }
+    }
+}
+
+void recorder_stop_run(void)
+{
+    if (!recording)
+    {
+        return;
+    }
+
+    if (erase_pending)
+    {
+        nvm_erase_block(NVM_REGION_RECORD, write_block);
+        erase_pending = false;
+    }
+
+    if (0 != row_fill)
+    {
+        program_row();
+    }
+
+    next_block = next_in_ring(write_block);
+    recording = false;
+}
+
+bool recorder_is_recording(void)
+{
+    return recording;
+}
+
+uint8_t recorder_get_runs(recorder_run_t * runs, uint8_t max_runs)
+{
+    uint8_t nbr_of_runs = 0;
+    uint8_t block = next_block;
+    uint8_t i;
+
+    // The oldest run is the first one after where the next run starts
+    for (i = 0; (i != NVM_RECORD_BLOCKS) && (nbr_of_runs != max_runs); ++i)
+    {
+        if ((BLOCK_RUN_START == block_type[block]) &&
+            !(recording && (run_number == block_run[block])))
+        {
+            recorder_run_t * run = &runs[nbr_of_runs++];
+            uint8_t run_block = block;
+            uint8_t j;
+
+            run->number = block_run[block];
+            run->profile = nvm_read_high(NVM_REGION_RECORD,
+                    block * (uint16_t)INSTRUCTIONS_PER_BLOCK + 1);
+            run->nbr_of_samples = count_samples(block);
+
+            for (j = 1; j != NVM_RECORD_BLOCKS; ++j)
+            {
+                run_block = next_in_ring(run_block);
+
+                if (!is_continued(run_block, run->number))
+                {
+                    break;
+                }
+
+                run->nbr_of_samples += count_samples(run_block);
+            }
+        }
+
+        block = next_in_ring(block);
+    }
+
+    return nbr_of_runs;
+}
+
+bool recorder_open_run(uint16_t number)
+{
+    uint8_t block;
+
+    read_done = true;
+
+    if (recording)
+    {
+        return false;
+    }
+
+    for (block = 0; block != NVM_RECORD_BLOCKS; ++block)
+    {
+        if ((BLOCK_RUN_START == block_type[block]) &&
+            (number == block_run[block]))
+        {
+            uint16_t instr = block * (uint16_t)INSTRUCTIONS_PER_BLOCK;
+
+            read_run = number;
+            read_block = block;
+            read_instr = START_HEADER_SIZE;
+            read_blocks_left = NVM_RECORD_BLOCKS - 1;
+            read_temp = nvm_read_low(NVM_REGION_RECORD, instr + 1);
+            read_target = nvm_read_low(NVM_REGION_RECORD, instr + 2);
+            read_done = false;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool recorder_read_sample(recorder_sample_t * sample)
+{
+    uint16_t instr;
+    uint16_t low;
+    uint8_t high;
+    int8_t target_change;
+
+    if (read_done)
+    {
+        return false;
+    }
+
+    if (INSTRUCTIONS_PER_BLOCK == read_instr)
+    {
+        uint8_t block = next_in_ring(read_block);
+
+        if ((0 == read_blocks_left) || !is_continued(block, read_run))
+        {
+            read_done = true;
+            return false;
+        }
+
+        --read_blocks_left;
+        read_block = block;
+        read_instr = CONTINUED_HEADER_SIZE;
+    }
+
+    instr = read_block * (uint16_t)INSTRUCTIONS_PER_BLOCK + read_instr;
+    high = nvm_read_high(NVM_REGION_RECORD, instr);
+
+    if (ERASED_HIGH == high)
+    {
+        read_done = true;
+        return false;
+    }
+
+    low = nvm_read_low(NVM_REGION_RECORD, instr);
+
+    read_temp += (int8_t)(low >> 8);
+
+    target_change = (int8_t)(low & TARGET_CHANGE_MASK);
+
+    if (target_change > TARGET_CHANGE_MAX)
+    {
+        target_change -= TARGET_CHANGE_MASK + 1;
+    }
+
+    read_target += target_change;
+
+    sample->temp = read_temp;
+    sample->target = read_target;
+    sample->duty = (high & DUTY_MASK) * RECORDER_DUTY_SCALE;
+    sample->servo = (((high >> SERVO_HIGH_SHIFT) << SERVO_LOW_BITS) |
+                     ((low >> SERVO_LOW_SHIFT) & SERVO_LOW_MASK)) *
+                    RECORDER_SERVO_SCALE;
+
+    ++read_instr;
+
+    return true;
+}
+
+// =============================================================================
+// Private function definitions
+// =============================================================================
+
+static void add_to_row(uint16_t low, uint8_t high)
+{
+    row_low[row_fill] = low;
+    row_high[row_fill] = high;
+    ++row_fill;
+}
+
+static void program_row(void)
+{
+    while (NVM_INSTRUCTIONS_PER_ROW != row_fill)
+    {
+        add_to_row(ERASED_LOW, ERASED_HIGH);
+    }
+
+    nvm_program_row(NVM_REGION_RECORD, row, row_low, row_high);
+
+    row_fill = 0;
+
+    if (ROWS_PER_REGION == ++row)
+    {
+        row = 0;
+    }
+}
+
+static void continue_in_next_block(void)
+{
+    uint8_t block = next_in_ring(write_block);
+
+    if (block == run_first_block)
+    {
+        // The ring is full, keep the start of the run
+        next_block = block;
+        recording = false;
+        return;
+    }
+
+    write_block = block;
+    erase_pending = true;
+
+    block_type[block] = BLOCK_RUN_CONTINUED;
+    block_run[block] = run_number;
+
+    add_to_row(run_number, BLOCK_RUN_CONTINUED);
+}
+
+static int8_t encode_change(uint16_t value, uint16_t * last, int8_t min,
+                            int8_t max)
+{
+    int16_t change = (int16_t)(value - *last);
+
+    if (change > max)
+    {
+        change = max;
+    }
+    else if (change < min)
+    {
+        change = min;
+    }
+
+    *last += change;
+
+    return (int8_t)change;
+}
+
+static bool is_continued(uint8_t block, uint16_t number)
+{
+    return (BLOCK_RUN_CONTINUED == block_type[block]) &&
+           (number == block_run[block]);
+}
+
+static uint16_t count_samples(uint8_t block)
+{
+    uint16_t first = block * (uint16_t)INSTRUCTIONS_PER_BLOCK;
+    uint16_t header_size;
+    uint16_t low;
+    uint16_t high;
+
+    header_size = (BLOCK_RUN_START == block_type[block]) ?
+                  START_HEADER_SIZE : CONTINUED_HEADER_SIZE;
+    low = header_size;
+    high = INSTRUCTIONS_PER_BLOCK;
+
+    // Samples are programmed in order, search for the first erased one
+    while (low != high)
+    {
+        uint16_t mid = low + (high - low) / 2;
+
+        if (ERASED_HIGH == nvm_read_high(NVM_REGION_RECORD, first + mid))
+        {
+            high = mid;
+        }
+        else
+        {
+            low = mid + 1;
+        }
+    }
+
+    return low - header_size;
+}
+
+static uint8_t next_in_ring(uint8_t block)
+{
+    return (NVM_RECORD_BLOCKS - 1 == block) ? 0 : block + 1;
+}
@@ -0,0 +1,163 @@
+/*
+ * This file records reflow runs at 10 Hz into a ring of NVM_RECORD_BLOCKS
+ * program memory erase blocks, see nvm.h.
+ *
+ * Each run starts at the beginning of an erase block and continues in the
+ * following blocks. The first instruction of every block is a block header:
+ *
+ *    -------------------------------------------------------------
+ *   |             Run number                 |     Block type     |
+ *    -------------------------------------------------------------
+ *             BIT0    -    BIT15                  BIT16 -  BIT23
+ *
+ * The first block of a run also holds the start temperature, with the
+ * profile index in BIT16 - BIT23, and the start target temperature. Each
+ * sample then takes one instruction:
+ *
+ *    ---------------------------------------------------------------------
+ *   | Servo high | Duty | Temperature change | Servo low | Target change |
+ *    ---------------------------------------------------------------------
+ *    BIT20-BIT23  BIT16   BIT8  -  BIT15      BIT5-BIT7     BIT0-BIT4
+ *                -BIT19
+ *
+ * The temperature change is an int8 and the target change an int5, both in
+ * 0.25 C since the previous sample. Larger changes are spread over the
+ * following samples, the target ramps far slower than that. The duty is the
+ * heater duty / RECORDER_DUTY_SCALE, at most 0xD, so a sample can never read
+ * as erased. The servo position / RECORDER_SERVO_SCALE is split in a high
+ * nibble and three low bits. An erased instruction ends the run.
+ *
+ * Samples are collected in RAM one row at a time, and recorder_service()
+ * does at most one erase or row program per call, so the CPU stall fits
+ * between two control ticks. When the ring is full the oldest runs are
+ * overwritten, a run which would overwrite its own start is truncated.
+ */
+
+#ifndef RECORDER_H
+#define	RECORDER_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+// =============================================================================
+// Include statements
+// =============================================================================
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nvm.h"
+
+// =============================================================================
+// Public type definitions
+// =============================================================================
+
+typedef struct recorder_sample_t
+{
+    uint16_t temp;      // Temperature in 0.25 C
+    uint16_t target;    // Target temperature in 0.25 C
+    uint8_t duty;       // Heater duty
+    uint16_t servo;     // Servo position
+} recorder_sample_t;
+
+typedef struct recorder_run_t
+{
+    uint16_t number;            // Run number, increases for each run
+    uint8_t profile;            // Index of the profile
+    uint16_t nbr_of_samples;    // Number of samples, at 10 Hz
+} recorder_run_t;
+
+// =============================================================================
+// Global variable declarations
+// =============================================================================
+
+// =============================================================================
+// Global constatants
+// =============================================================================
+
+// Samples per second
+#define RECORDER_SAMPLE_RATE    10
+
+// Resolution of the recorded heater duty and servo position
+#define RECORDER_DUTY_SCALE     4
+#define RECORDER_SERVO_SCALE    10
+
+// Each run starts in its own block
+#define RECORDER_MAX_RUNS       NVM_RECORD_BLOCKS
+
+// Samples which fit in the ring, less the block headers. A reflow run is
+// usually longer than half of it, and then overwrites all older runs.
+#define RECORDER_MAX_SAMPLES    (NVM_RECORD_BLOCKS * \
+                                 (NVM_INSTRUCTIONS_PER_ERASE_BLOCK - 1) - 2)
+
+// =============================================================================
+// Public function declarations
+// =============================================================================
+
+/**
+ * @brief Finds the recorded runs and where to record the next one.
+ */
+void recorder_init(void);
+
+/**
+ * @brief Starts recording a new run, the run in progress is stopped.
+ * @details Erases the first block of the run, which stalls the CPU.
+ * @param profile - Index of the profile.
+ * @param start - Values at the start of the run.
+ */
+void recorder_start_run(uint8_t profile, const recorder_sample_t * start);
+
+/**
+ * @brief Adds one sample to the run in progress, if any.
+ * @param sample - The sample.
+ */
+void recorder_add_sample(const recorder_sample_t * sample);
+
+/**
+ * @brief Writes recorded samples to flash.
+ * @details Call after each recorder_add_sample(). Does at most one block
+ * erase or row program, which stalls the CPU.
+ */
+void recorder_service(void);
+
+/**
+ * @brief Writes the last samples of the run in progress to flash and stops
+ * recording.
+ */
+void recorder_stop_run(void);
+
+/**
+ * @brief Checks if a run is being recorded.
+ * @return True if a run is being recorded.
+ */
+bool recorder_is_recording(void);
+
+/**
+ * @brief Gets the finished runs, oldest first.
+ * @param runs - Where to store the runs.
+ * @param max_runs - Size of runs, at most RECORDER_MAX_RUNS runs are found.
+ * @return Number of runs.
+ */
+uint8_t recorder_get_runs(recorder_run_t * runs, uint8_t max_runs);
+
+/**
+ * @brief Starts reading the samples of a finished run.
+ * @param number - Number of the run.
+ * @return False if there is no such finished run.
+ */
+bool recorder_open_run(uint16_t number);
+
+/**
+ * @brief Reads the next sample of the run opened by recorder_open_run().
+ * @param sample - Where to store the sample.
+ * @return False if there are no more samples.
+ */
+bool recorder_read_sample(recorder_sample_t * sample);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* RECORDER_H */
+
@@ -0,0 +1,151 @@
+// =============================================================================
+// Include statements
+// =============================================================================
+
+#include "telemetry.h"
+
+#include <stdint.h>
+
+#include "crc.h"
+#include "uart.h"
+
+// =============================================================================
+// Private type definitions
+// =============================================================================
+
+// =============================================================================
+// Global variables
+// =============================================================================
+
+// =============================================================================
+// Private constants
+// =============================================================================
+
+// COBS adds one byte per started 254 bytes, plus a zero byte on each side
+#define FRAME_SIZE (1 + 1 + TELEMETRY_RECORD_SIZE + 1)
+
+#define FRAME_DELIMITER 0x00
+
+// =============================================================================
+// Private variables
+// =============================================================================
+
+static telemetry_mode_t mode = TELEMETRY_MODE_ASCII;
+
+static uint8_t sequence = 0;
+
+// =============================================================================
+// Private function declarations
+// =============================================================================
+
+/**
+ * @brief Stores a value little endian.
+ * @param p - Where to store the value.
+ * @param value - The value.
+ * @param size - Number of bytes to store.
+ * @return Pointer to the byte after the value.
+ */
+static uint8_t * put_le(uint8_t * p, uint32_t value, uint8_t size);
+
+/**
+ * @brief COBS encodes a block of bytes.
+ * @param data - The bytes.
+ * @param len - Number of bytes.
+ * @param out - Where to store the encoded bytes, len + 1 + len / 254 bytes.
+ * @return Number of encoded bytes.
+ */
+static uint16_t cobs_encode(const uint8_t * data, uint16_t len, uint8_t * out);
+
+// =============================================================================
+// Public function definitions
+// =============================================================================
+
+void telemetry_set_mode(telemetry_mode_t new_mode)
+{
+    mode = new_mode;
+}
+
+telemetry_mode_t telemetry_get_mode(void)
+{
+    return mode;
+}
+
+void telemetry_send(const telemetry_record_t * record)
+{
+    uint8_t data[TELEMETRY_RECORD_SIZE];
+    uint8_t frame[FRAME_SIZE];
+    uint8_t * p = data;
+    uint16_t len;
+
+    p = put_le(p, TELEMETRY_RECORD_CONTROL, 1);
+    p = put_le(p, sequence++, 1);
+    p = put_le(p, record->time, 4);
+    p = put_le(p, record->raw_temp, 2);
+    p = put_le(p, record->temp, 2);
+    p = put_le(p, (uint32_t)record->target, 4);
+    p = put_le(p, (uint32_t)record->p, 4);
+    p = put_le(p, (uint32_t)record->i, 4);
+    p = put_le(p, (uint32_t)record->d, 4);
+    p = put_le(p, record->duty, 1);
+    p = put_le(p, record->servo, 2);
+    p = put_le(p, record->phase, 1);
+    put_le(p, crc16_block(CRC16_INIT, data, (uint16_t)(p - data)), 2);
+
+    frame[0] = FRAME_DELIMITER;
+    len = 1 + cobs_encode(data, TELEMETRY_RECORD_SIZE, &frame[1]);
+    frame[len++] = FRAME_DELIMITER;
+
+    // A partial frame would be lost anyway
+    if (uart_get_write_buffer_space() >= len)
+    {
+        uart_write_array(len, frame);
+    }
+}
+
+// =============================================================================
+// Private function definitions
+// =============================================================================
+
+static uint8_t * put_le(uint8_t * p, uint32_t value, uint8_t size)
+{
+    while (size--)
+    {
+        *(p++) = (uint8_t)value;
+        value >>= 8;
+    }
+
+    return p;
+}
+
+static uint16_t cobs_encode(const uint8_t * data, uint16_t len, uint8_t * out)
+{
+    uint16_t code_index = 0;    // Where the length of the current block goes
+    uint16_t out_index = 1;
+    uint8_t code = 1;
+    uint16_t i;
+
+    for (i = 0; i != len; ++i)
+    {
+        if (0 == data[i])
+        {
+            out[code_index] = code;
+            code_index = out_index++;
+            code = 1;
+        }
+        else
+        {
+            out[out_index++] = data[i];
+
+            if (0xFF == ++code)
+            {
+                out[code_index] = code;
+                code_index = out_index++;
+                code = 1;
+            }
+        }
+    }
+
+    out[code_index] = code;
+
+    return out_index;
+}
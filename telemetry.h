@@ -0,0 +1,109 @@
+/*
+ * This file sends binary telemetry records, one per control tick, as an
+ * alternative to the once per second ASCII log line.
+ *
+ * Each record is a little endian payload followed by its CRC-16, see crc.h:
+ *
+ *   Byte    Size   Contents
+ *    0       1     Record type, TELEMETRY_RECORD_CONTROL
+ *    1       1     Sequence number, increases by one for each record
+ *    2       4     Time in ms, see timers_get_millis()
+ *    6       2     Unfiltered temperature in 0.25 C
+ *    8       2     Filtered temperature in 0.25 C
+ *   10       4     Target temperature, q16_16_t in C
+ *   14       4     P term, q16_16_t
+ *   18       4     I term, q16_16_t
+ *   22       4     D term, q16_16_t
+ *   26       1     Heater duty
+ *   27       2     Servo position
+ *   29       1     Reflow phase, see status_reflow_state_t
+ *   30       2     CRC-16 of byte 0 - 29
+ *
+ * The record is COBS encoded, so it holds no zero bytes, and sent between two
+ * zero bytes. Terminal answers sent between two records then end up in a
+ * frame of their own, which fails the CRC check. Records which do not fit in
+ * the uart write buffer are dropped whole, which shows as a gap in the
+ * sequence numbers.
+ */
+
+#ifndef TELEMETRY_H
+#define	TELEMETRY_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+// =============================================================================
+// Include statements
+// =============================================================================
+
+#include <stdint.h>
+
+#include "fixed_point.h"
+
+// =============================================================================
+// Public type definitions
+// =============================================================================
+
+typedef enum
+{
+    TELEMETRY_MODE_ASCII = 0,   // Once per second log line
+    TELEMETRY_MODE_BINARY       // Binary records at the control rate
+} telemetry_mode_t;
+
+typedef struct telemetry_record_t
+{
+    uint32_t time;          // Time in ms
+    uint16_t raw_temp;      // Unfiltered temperature in 0.25 C
+    uint16_t temp;          // Filtered temperature in 0.25 C
+    q16_16_t target;        // Target temperature in C
+    q16_16_t p;             // PID terms
+    q16_16_t i;
+    q16_16_t d;
+    uint8_t duty;           // Heater duty
+    uint16_t servo;         // Servo position
+    uint8_t phase;          // Reflow phase
+} telemetry_record_t;
+
+// =============================================================================
+// Global variable declarations
+// =============================================================================
+
+// =============================================================================
+// Global constatants
+// =============================================================================
+
+#define TELEMETRY_RECORD_CONTROL    0x01
+
+// Size of the record, including the CRC
+#define TELEMETRY_RECORD_SIZE       32
+
+// =============================================================================
+// Public function declarations
+// =============================================================================
+
+/**
+ * @brief Selects how the reflow is logged on the uart.
+ * @param mode - The mode.
+ */
+void telemetry_set_mode(telemetry_mode_t mode);
+
+/**
+ * @brief Gets how the reflow is logged on the uart.
+ * @return The mode.
+ */
+telemetry_mode_t telemetry_get_mode(void);
+
+/**
+ * @brief Sends one record as a COBS frame, if it fits in the uart write
+ * buffer.
+ * @param record - The record.
+ */
+void telemetry_send(const telemetry_record_t * record);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* TELEMETRY_H */
+
@@ -34,6 +34,8 @@
 
 #include "fixed_point.h"
 #include "flash.h"
+#include "profile.h"
+#include "status.h"
 
 // =============================================================================
 // Private type definitions
@@ -47,73 +49,321 @@
 // Private constants
 // =============================================================================
 
-#define LOOKUP_TABLE_LENGHT ((FLASH_INDEX_LEAD_FREE_TEMP_CURVE_END -           \
-                              FLASH_INDEX_LEAD_FREE_TEMP_CURVE_START)          \
-                             / sizeof(temp_curve_calib_point_t))
+// The start point and the delta encoded points of a profile
+#define LOOKUP_TABLE_LENGHT (PROFILE_MAX_POINTS + 1)
+
 // =============================================================================
 // Private variables
 // =============================================================================
 
 static temp_curve_calib_point_t lookup_table[LOOKUP_TABLE_LENGHT];
 static uint8_t nbr_of_calib_points = 0;
+static uint8_t loaded_profile = 0;
+static char profile_name[PROFILE_NAME_LEN + 1];
+
+//
+// Phase table of the loaded profile. reflow_state is the state at
+// reflow_state_time, and next_phase_start is when the next state starts, or
+// UINT16_MAX while cooling. See temp_curve_get_reflow_state().
+//
+static uint16_t phase_start[TEMP_CURVE_NBR_OF_PHASES];
+static status_reflow_state_t reflow_state = STATUS_REFLOW_STATE_PREHEAT;
+static uint16_t reflow_state_time = 0;
+static uint16_t next_phase_start = 0;
+
+// segment_slope[i] is the slope in degrees per second of the segment between
+// lookup_table[i - 1] and lookup_table[i].
+static q16_16_t segment_slope[LOOKUP_TABLE_LENGHT];
+
+// Index of the first calibration point with a time >= the time of the last
+// call to temp_curve_eval(). Since the reflow time only increases, this is
+// almost always already the right segment.
+static uint8_t cursor = 0;
+
+//
+// State of the reference generator, see temp_curve_reference_step().
+// reference_segment is the index of the first calibration point with a time
+// >= reference_time.
+//
+static q16_16_t reference_time = 0;
+static q16_16_t reference_temp = 0;
+static uint8_t reference_segment = 0;
 
 // =============================================================================
 // Private function declarations
 // =============================================================================
 
+/**
+ * @brief Finds the first calibration point with a time >= time by binary
+ * search.
+ * @param time - Time in seconds.
+ * @return Index of the calibration point, or nbr_of_calib_points if all
+ * calibration points are before time.
+ */
+static uint8_t find_segment(uint16_t time);
+
+/**
+ * @brief Evaluates the temperature curve on a given segment.
+ * @param i - Index of the first calibration point with a time >= time.
+ * @param time - Time in seconds.
+ * @return Calculated temperature.
+ */
+static q16_16_t eval_segment(uint8_t i, uint16_t time);
+
+/**
+ * @brief Evaluates the temperature curve on a given segment at a fractional
+ * time.
+ * @param i - Index of the first calibration point with a time >= time.
+ * @param time - Time in seconds.
+ * @return Calculated temperature.
+ */
+static q16_16_t eval_segment_fractional(uint8_t i, q16_16_t time);
+
+/**
+ * @brief Moves a segment index forward to a later time.
+ * @param i - Index of the first calibration point with a time >= some
+ * earlier time.
+ * @param time - The new time in seconds.
+ * @return Index of the first calibration point with a time >= time.
+ */
+static uint8_t advance_segment(uint8_t i, q16_16_t time);
+
+/**
+ * @brief Calculates how much the temperature changes on a segment during dt.
+ * @param i - Index of the first calibration point after the segment.
+ * @param dt - Time step in seconds.
+ * @return The temperature change, 0 before the first and after the last
+ * calibration point.
+ */
+static q16_16_t segment_step(uint8_t i, q16_16_t dt);
+
+/**
+ * @brief Restarts the phase table at the preheat state.
+ */
+static void reset_reflow_state(void);
+
 // =============================================================================
 // Public function definitions
 // =============================================================================
 
 void temp_curve_init(temp_curve_variant_t variant)
 {
-    uint16_t flash_index;
     uint8_t i;
 
-    switch (variant)
+    loaded_profile = profile_get_selected(variant);
+    nbr_of_calib_points = profile_load(loaded_profile,
+                                       lookup_table,
+                                       LOOKUP_TABLE_LENGHT,
+                                       phase_start);
+    profile_get_name(loaded_profile, profile_name);
+
+    for (i = 1; i < nbr_of_calib_points; ++i)
     {
-        case TEMP_CURVE_LEAD_FREE:
-            nbr_of_calib_points =
-                    flash_read_word(FLASH_INDEX_LEAD_FREE_TEMP_CURVE_SIZE);
-            flash_index = FLASH_INDEX_LEAD_FREE_TEMP_CURVE_START;
-            break;
+        uint16_t segment_len = lookup_table[i].time - lookup_table[i - 1].time;
 
-        case TEMP_CURVE_LEAD:
-            nbr_of_calib_points =
-                    flash_read_word(FLASH_INDEX_LEAD_TEMP_CURVE_SIZE);
-            flash_index = FLASH_INDEX_LEAD_TEMP_CURVE_START;
-            break;
+        if (0 == segment_len)
+        {
+            // Never interpolated on, see eval_segment()
+            segment_slope[i] = 0;
+        }
+        else
+        {
+            segment_slope[i] = q16_16_divide(
+                lookup_table[i].temp - lookup_table[i - 1].temp,
+                int_to_q16_16(segment_len));
+        }
+    }
+
+    cursor = 0;
+    reset_reflow_state();
+}
 
-        default:
-            break;
+q16_16_t temp_curve_eval(uint16_t time)
+{
+    if ((0 != cursor) && (lookup_table[cursor - 1].time >= time))
+    {
+        // Time has moved backwards
+        cursor = find_segment(time);
     }
 
-    for (i = 0; i != nbr_of_calib_points; ++i)
+    while ((cursor != nbr_of_calib_points) &&
+           (lookup_table[cursor].time < time))
     {
-        lookup_table[i].temp = (q16_16_t)flash_read_dword(flash_index);
-        lookup_table[i].time = flash_read_word(flash_index + sizeof(q16_16_t));
-        
-        flash_index += sizeof(temp_curve_calib_point_t);
+        ++cursor;
     }
+
+    return eval_segment(cursor, time);
 }
 
-q16_16_t temp_curve_eval(uint16_t time)
+q16_16_t temp_curve_eval_at(uint16_t time)
 {
-    q16_16_t ret_val;
+    return eval_segment(find_segment(time), time);
+}
+
+void temp_curve_reference_reset(uint16_t time)
+{
+    reference_time = int_to_q16_16(time);
+    reference_segment = find_segment(time);
+    reference_temp = eval_segment(reference_segment, time);
+}
+
+q16_16_t temp_curve_reference_step(q16_16_t dt)
+{
+    reference_time += dt;
+
+    if ((reference_segment != nbr_of_calib_points) &&
+        (reference_time > int_to_q16_16(lookup_table[reference_segment].time)))
+    {
+        //
+        // Entered a new segment, evaluate the curve exactly so that no error
+        // is carried over from the previous segment.
+        //
+        reference_segment = advance_segment(reference_segment, reference_time);
+        reference_temp = eval_segment_fractional(reference_segment,
+                                                 reference_time);
+    }
+    else
+    {
+        reference_temp += segment_step(reference_segment, dt);
+    }
+
+    return reference_temp;
+}
+
+bool temp_curve_eval_window(q16_16_t t0,
+                            q16_16_t dt,
+                            uint16_t n,
+                            matrix_t * out)
+{
+    q16_16_t * p = out->m;
+    q16_16_t time = t0;
+    q16_16_t temp;
+    q16_16_t step;
     uint8_t i;
+    uint16_t k;
 
-    i = 0;
+    if ((0 == n) || ((out->rows != 1) && (out->cols != 1)) ||
+        (out->rows * out->cols < n))
+    {
+        return false;
+    }
+
+    i = (t0 <= 0) ? 0 : find_segment((uint16_t)(q16_16_ceil(t0) >> 16));
+    temp = eval_segment_fractional(i, time);
+    step = segment_step(i, dt);
 
-    while ((i != nbr_of_calib_points) && (lookup_table[i].time < time))
+    *p++ = temp;
+
+    for (k = 1; k != n; ++k)
     {
-        ++i;
+        time += dt;
+
+        if ((i != nbr_of_calib_points) &&
+            (time > int_to_q16_16(lookup_table[i].time)))
+        {
+            i = advance_segment(i, time);
+            temp = eval_segment_fractional(i, time);
+            step = segment_step(i, dt);
+        }
+        else
+        {
+            temp += step;
+        }
+
+        *p++ = temp;
+    }
+
+    return true;
+}
+
+uint8_t temp_curve_get_profile(void)
+{
+    return loaded_profile;
+}
+
+const char * temp_curve_get_profile_name(void)
+{
+    return profile_name;
+}
+
+uint16_t temp_curve_get_phase_start(temp_curve_phase_t phase)
+{
+    return phase_start[phase];
+}
+
+status_reflow_state_t temp_curve_get_reflow_state(uint16_t time)
+{
+    if (time < reflow_state_time)
+    {
+        // Time has moved backwards, the reflow program has been restarted
+        reset_reflow_state();
+    }
+
+    reflow_state_time = time;
+
+    //
+    // Loop to also skip states which are empty, or which start before the
+    // previous state since the boundaries can be set independently.
+    //
+    while ((time >= next_phase_start) &&
+           (STATUS_REFLOW_STATE_COOL != reflow_state))
+    {
+        ++reflow_state;
+
+        if (STATUS_REFLOW_STATE_COOL == reflow_state)
+        {
+            next_phase_start = UINT16_MAX;
+        }
+        else
+        {
+            // State n + 1 starts at phase_start[n], see status_reflow_state_t
+            next_phase_start = phase_start[reflow_state];
+        }
     }
 
+    return reflow_state;
+}
+
+uint16_t temp_curve_get_time_of_last_val(void)
+{
+    return lookup_table[nbr_of_calib_points - 1].time;
+}
+
+// =============================================================================
+// Private function definitions
+// =============================================================================
+
+static uint8_t find_segment(uint16_t time)
+{
+    uint8_t low = 0;
+    uint8_t high = nbr_of_calib_points;
+
+    while (low != high)
+    {
+        uint8_t mid = (low + high) >> 1;
+
+        if (lookup_table[mid].time < time)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+static q16_16_t eval_segment(uint8_t i, uint16_t time)
+{
+    q16_16_t ret_val;
+
     if (0 == i)
     {
-        ret_val = lookup_table[i].temp;
+        ret_val = lookup_table[0].temp;
     }
-    else if ((nbr_of_calib_points == i) && lookup_table[i - 1].time < time)
+    else if (nbr_of_calib_points == i)
     {
         ret_val = lookup_table[nbr_of_calib_points - 1].temp;
     }
@@ -133,44 +383,65 @@ q16_16_t temp_curve_eval(uint16_t time)
          *                 ||
          *             find temp
          *             at this point
+         *
+         * The time difference is an integer, so the product with the slope
+         * is a plain 32x16 bit multiplication.
          */
-        q16_16_t x1;
-        q16_16_t x2;
-        q16_16_t y1;
-        q16_16_t y2;
-
-        q16_16_t derivate;
-
-        x1 = int_to_q16_16(lookup_table[i - 1].time);
-        x2 = int_to_q16_16(lookup_table[i    ].time);
-        y1 = lookup_table[i - 1].temp;
-        y2 = lookup_table[i    ].temp;
+        ret_val = lookup_table[i - 1].temp +
+                  segment_slope[i] * (int32_t)(time - lookup_table[i - 1].time);
+    }
 
-        if (y2 >= y1)
-        {
-            derivate = q16_16_divide((y2 - y1), (x2 - x1));
+    return ret_val;
+}
 
-            ret_val = y1 + q16_16_multiply(derivate, int_to_q16_16(time) - x1);
-        }
-        else
-        {
-            derivate = q16_16_divide((y2 - y1), (x1 - x2));
+static q16_16_t eval_segment_fractional(uint8_t i, q16_16_t time)
+{
+    q16_16_t ret_val;
 
-            ret_val = y1 - q16_16_multiply(derivate, int_to_q16_16(time) - x1);
-        }
+    if (0 == i)
+    {
+        ret_val = lookup_table[0].temp;
+    }
+    else if (nbr_of_calib_points == i)
+    {
+        ret_val = lookup_table[nbr_of_calib_points - 1].temp;
+    }
+    else
+    {
+        ret_val = lookup_table[i - 1].temp +
+                  q16_16_multiply(segment_slope[i],
+                          time - int_to_q16_16(lookup_table[i - 1].time));
     }
 
     return ret_val;
 }
 
-uint16_t temp_curve_get_time_of_last_val(void)
+static uint8_t advance_segment(uint8_t i, q16_16_t time)
 {
-    return lookup_table[nbr_of_calib_points - 1].time;
-}
-
-// =============================================================================
-// Private function definitions
-// =============================================================================
+    while ((i != nbr_of_calib_points) &&
+           (time > int_to_q16_16(lookup_table[i].time)))
+    {
+        ++i;
+    }
 
+    return i;
+}
 
+static q16_16_t segment_step(uint8_t i, q16_16_t dt)
+{
+    if ((0 == i) || (nbr_of_calib_points == i))
+    {
+        return 0;
+    }
+    else
+    {
+        return q16_16_multiply(segment_slope[i], dt);
+    }
+}
 
+static void reset_reflow_state(void)
+{
+    reflow_state = STATUS_REFLOW_STATE_PREHEAT;
+    reflow_state_time = 0;
+    next_phase_start = phase_start[TEMP_CURVE_PHASE_SOAK];
+}
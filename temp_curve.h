@@ -13,6 +13,8 @@ extern "C" {
 #include <stdint.h>
 
 #include "fixed_point.h"
+#include "matrix.h"
+#include "status.h"
 
 // =============================================================================
 // Public type definitions
@@ -24,6 +26,13 @@ typedef enum
     TEMP_CURVE_LEAD_FREE
 } temp_curve_variant_t;
 
+typedef enum
+{
+    TEMP_CURVE_PHASE_SOAK,
+    TEMP_CURVE_PHASE_REFLOW,
+    TEMP_CURVE_PHASE_COOL
+} temp_curve_phase_t;
+
 typedef struct temp_curve_calib_point_t
 {
     q16_16_t temp;
@@ -38,23 +47,102 @@ typedef struct temp_curve_calib_point_t
 // Global constatants
 // =============================================================================
 
+#define TEMP_CURVE_NBR_OF_PHASES 3
+
 // =============================================================================
 // Public function declarations
 // =============================================================================
 
 /**
  * @brief Loads the temperature curve data from flash memory.
- * @param variant - temperature curve to load from flash memory.
+ * @details Segment programs are expanded to points, so evaluation costs the
+ * same for both kinds of profiles.
+ * @param variant - Position of the profile switch, the profile selected for
+ * this position is loaded.
  */
 void temp_curve_init(temp_curve_variant_t variant);
 
 /**
  * @brief Evaluates the temperature value at a specified time.
+ * @details Optimized for calls with increasing time, where it runs in
+ * constant time. Use temp_curve_eval_at() for random access.
  * @param time - Time at to get the temperature for in seconds.
  * @return Calculated temperature.
  */
 q16_16_t temp_curve_eval(uint16_t time);
 
+/**
+ * @brief Evaluates the temperature value at a specified time, without
+ * affecting the state used by temp_curve_eval().
+ * @param time - Time at to get the temperature for in seconds.
+ * @return Calculated temperature.
+ */
+q16_16_t temp_curve_eval_at(uint16_t time);
+
+/**
+ * @brief Restarts the reference generator at a given time.
+ * @details Also used to resynchronize the reference generator with the
+ * reflow time.
+ * @param time - Time in seconds.
+ */
+void temp_curve_reference_reset(uint16_t time);
+
+/**
+ * @brief Advances the reference generator.
+ * @details The reference is advanced by slope * dt, and evaluated from the
+ * temperature curve only when a new segment is entered. This gives a smooth
+ * reference between the whole seconds handled by temp_curve_eval().
+ * @param dt - Time since the last step in seconds.
+ * @return The reference temperature at the new time.
+ */
+q16_16_t temp_curve_reference_step(q16_16_t dt);
+
+/**
+ * @brief Evaluates the temperature curve at n equally spaced times, for
+ * example the reference values over a prediction horizon.
+ * @details Walks the segments once and accumulates by slope * dt, which is
+ * much cheaper than n calls to temp_curve_eval_at(). Does not affect the
+ * state used by temp_curve_eval().
+ * @param t0 - Time of the first value in seconds.
+ * @param dt - Time between two values in seconds, must be >= 0.
+ * @param n - Number of values to evaluate.
+ * @param out - Row or column vector with at least n elements.
+ * @return False if out is not a large enough vector.
+ */
+bool temp_curve_eval_window(q16_16_t t0,
+                            q16_16_t dt,
+                            uint16_t n,
+                            matrix_t * out);
+
+/**
+ * @brief Gets the index of the profile loaded by temp_curve_init().
+ * @return Profile index, see profile.h.
+ */
+uint8_t temp_curve_get_profile(void);
+
+/**
+ * @brief Gets when a phase of the loaded profile starts.
+ * @param phase - The phase.
+ * @return Start of the phase in seconds since the start of the reflow program.
+ */
+uint16_t temp_curve_get_phase_start(temp_curve_phase_t phase);
+
+/**
+ * @brief Gets the name of the profile loaded by temp_curve_init().
+ * @return The name, cached when the profile was loaded.
+ */
+const char * temp_curve_get_profile_name(void);
+
+/**
+ * @brief Gets the reflow state of the loaded profile at a given time.
+ * @details Uses the phase table built by temp_curve_init(). For increasing
+ * times this is a single compare against the start of the next phase, a
+ * lower time than in the last call restarts the table.
+ * @param time - Time in seconds since the start of the reflow program.
+ * @return The reflow state.
+ */
+status_reflow_state_t temp_curve_get_reflow_state(uint16_t time);
+
 /**
  * @brief Gets the time of the last data point in the temperature curve.
  * @return Time of last data point in seconds.
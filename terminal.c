@@ -16,14 +16,44 @@
 #include "gpio.h"
 #include "servo.h"
 #include "flash.h"
-#include "control.h"
+#include "params.h"
+#include "recorder.h"
 #include "timers.h"
 #include "buttons.h"
+#include "fixed_point.h"
+#include "profile.h"
+#include "temp_curve.h"
+#include "status.h"
+#include "telemetry.h"
 
 // =============================================================================
 // Private type definitions
 // =============================================================================
 
+// One word of a received line, not null terminated
+typedef struct token_t
+{
+    const char * str;
+    uint16_t len;
+} token_t;
+
+typedef struct command_t
+{
+    const char * cmd;
+    void (*handler)(const token_t * args, uint8_t nbr_of_args);
+    uint8_t min_args;
+    uint8_t max_args;
+} command_t;
+
+// Output written a few lines at a time by terminal_handle_dump_event()
+typedef enum
+{
+    DUMP_NONE,
+    DUMP_RUN,           // Samples of a recorded run, see "dump run"
+    DUMP_PROFILES,      // See "list profiles"
+    DUMP_RUNS           // See "list runs"
+} dump_t;
+
 // =============================================================================
 // Global variables
 // =============================================================================
@@ -32,20 +62,39 @@
 // Private constants
 // =============================================================================
 
-#define HEX_BYTE_STR_LEN  (2 + 1)
-#define HEX_WORD_STR_LEN  (4 + 1)
-#define HEX_DWORD_STR_LEN (8 + 1)
-
 static const char NEWLINE[]         = "\r\n";
 
 static const char CMD_TYPE_HELP[]   = "help";
-static const char CMD_TYPE_SET[]    = "set ";
-static const char CMD_TYPE_GET[]    = "get ";
 
 static const char SYNTAX_ERROR[]    = "[Syntax error]";
 static const char ARGUMENT_ERROR[]  = "[Invalid argument]";
+static const char FLASH_COMMIT_DEFERRED[] = "[Deferred until the reflow ends]";
+
+// Longest line, without the null character
+#define MAX_LINE_LEN 256
+
+// Room for a full command and the lines received after it
+#define LINE_BUFFER_SIZE (2 * (MAX_LINE_LEN + 1))
 
-#define CMD_BUFFER_SIZE 257
+// Enough for "write program" with PROFILE_MAX_SEGMENTS segments and phases
+#define MAX_TOKENS (2 + 3 + 4 * PROFILE_MAX_SEGMENTS)
+
+// Received bytes handled at a time by terminal_handle_uart_event()
+#define RX_CHUNK_SIZE 32
+
+#define COMMAND_TERMINATION_CHAR '\n'
+#define CARRIAGE_RETURN_CHAR '\r'
+#define BACKSPACE_CHAR 0x08
+
+// Ramp rates which can be stored in a segment program, see profile.h
+#define MIN_PROGRAM_RATE DOUBLE_TO_Q16_16(0.05)
+#define MAX_PROGRAM_RATE DOUBLE_TO_Q16_16(25.5)
+
+// Lines written by each terminal_handle_dump_event(), fits in the tx buffer
+#define DUMP_LINES_PER_EVENT 6
+
+// Time to send a command at a new baud rate before it is reverted
+#define BAUD_CONFIRM_TIMEOUT_MS 10000
 
 //
 // Commands
@@ -71,6 +120,7 @@ static const char CMD_TEMP_CURVE_EVAL[] = "temp curve eval";
 
 /*
  Initiates the flash write buffer with the contents of theflash data memory.
+ Writes which are not yet committed are discarded.
  */
 static const char CMD_INIT_WRITE_BUFFER[] = "init flash bufffer";
 
@@ -81,10 +131,46 @@ static const char CMD_INIT_WRITE_BUFFER[] = "init flash bufffer";
 static const char CMD_BUFFERED_WRITE[] = "buffered write";
 
 /*
- Write the contents of the flash buffer to the flash memory.
+ Write the changes in the flash buffer to the flash memory.
+ This is deferred until the reflow program has ended if it is running.
  */
 static const char CMD_FLUSH_BUFFER[]    = "flush flash buffer";
 
+/*
+ Lists the profiles in the profile library.
+ Returns: <index> <name> <number of points> for each profile
+ */
+static const char CMD_LIST_PROFILES[] = "list profiles";
+
+/*
+ Stores a profile described as ramp, target and hold segments.
+ Each segment ramps at <rate> C/s to <target> C and then holds the target
+ for <hold> s. The words soak, reflow and cool can be put before the
+ segment which starts that phase. An index equal to the number of profiles
+ adds a new profile.
+ Parameters: <index> <name> <start temp> <rate> <target> <hold> ...
+ Example: write program 2 Fast 25 1.5 150 0 soak 0.5 180 0 reflow 3 245 10
+ cool 3 50 0
+ */
+static const char CMD_WRITE_PROGRAM[] = "write program";
+
+/*
+ Lists the recorded reflow runs, oldest first. The recorder only holds about
+ 400 s of samples, so a full reflow overwrites all older runs.
+ Returns: A line with the number of seconds the recorder holds, then
+ <run number> <profile index> <number of samples> for each run
+ */
+static const char CMD_LIST_RUNS[] = "list runs";
+
+/*
+ Writes all samples of a recorded reflow run, at 10 samples per second.
+ Not available while a run is recorded. Ends with an empty line.
+ Parameter: <run number, see list runs>
+ Returns: <temperature>;<time>;<heater duty>;<servo pos>;<target temp> for
+ each sample
+ */
+static const char CMD_DUMP_RUN[] = "dump run";
+
 /*
  Gets one byte from the flash data memory.
  Parameter: <index in hex format>
@@ -152,6 +238,38 @@ static const char GET_START_OF_REFLOW[] = "get start of reflow";
  */
 static const char GET_START_OF_COOL[] = "get start of cool";
 
+/*
+ Gets the profile selected by the reflow profile switch.
+ Returns: <profile index> <profile name>
+ */
+static const char GET_PROFILE[] = "get profile";
+
+/*
+ Gets the number of words in the flash buffer which are not yet written to
+ the flash memory. Changes are written when no reflow program is running.
+ Returns: <number of words>
+ */
+static const char GET_PENDING_WRITES[] = "get pending writes";
+
+/*
+ Gets the baud rate of the terminal.
+ Returns: <baud rate>
+ */
+static const char GET_BAUD[] = "get baud";
+
+/*
+ Gets how the reflow is logged.
+ Returns: <'ascii' or 'binary'>
+ */
+static const char GET_TELEMETRY[] = "get telemetry";
+
+/*
+ Gets the number of bytes dropped since startup because the uart buffers
+ were full.
+ Returns: <normal priority tx> <high priority tx> <rx>
+ */
+static const char GET_UART_DROPS[] = "get uart drops";
+
 /*
  Sets the heater on or off.
  Parameter: <'on' or 'off'>
@@ -172,31 +290,31 @@ static const char SET_FLASH[]       = "set flash";
 
 /*
  Sets the K constant in the PID regulator.
- Parameter: <Value in the range [-65535.0, 65535.0]>
+ Parameter: <Decimal value in the range [-32768.0, 32767.9999]>
  */
 static const char SET_PID_KP[]      = "set K";
 
 /*
  Sets the Ti constant in the PID regulator.
- Parameter: <Value in the range [-65535.0, 65535.0]>
+ Parameter: <Decimal value in the range [-32768.0, 32767.9999]>
  */
 static const char SET_PID_KI[]      = "set Ti";
 
 /*
  Sets the Td constant in the PID regulator.
- Parameter: <Value in the range [-65535.0, 65535.0]>
+ Parameter: <Decimal value in the range [-32768.0, 32767.9999]>
  */
 static const char SET_PID_KD[]      = "set Td";
 
 /*
  Sets the integrator tracking time constant in the PID regulator.
- Parameter: <Value in the range [0.0, 65535.0]>
+ Parameter: <Decimal value in the range [0.0, 32767.9999]>
  */
 static const char SET_PID_TTR[]     = "set Ttr";
 
 /*
  Sets the max gain of the PID derivative term.
-Parameter: <Value in the range [0.0, 65535.0]>
+Parameter: <Decimal value in the range [0.0, 32767.9999]>
  */
 static const char SET_PID_D_MAX_GAIN[] = "set d max gain";
 
@@ -208,7 +326,7 @@ static const char SET_PID_SERVO_FACTOR[] = "set pid servo factor";
 
 /*
  Sets the length of the moving average temperature filter.
- Return: <lenght of filter>
+ Parameter: <length of filter>
  */
 static const char SET_TEMP_FILTER_LEN[] = "set temp filter len";
 
@@ -239,69 +357,252 @@ static const char SET_START_OF_REFLOW[] = "set start of reflow";
  */
 static const char SET_START_OF_COOL[] = "set start of cool";
 
+/*
+ Selects which profile to use for the current position of the reflow
+ profile switch, and loads it.
+ Parameter: <profile index, see list profiles>
+ */
+static const char SET_PROFILE[] = "set profile";
+
+/*
+ Changes the baud rate of the terminal. The answer is sent at the old baud
+ rate, then the new one is used. Unless a valid command is received at the
+ new baud rate within 10 s, the old one is restored.
+ Parameter: <9600, 19200, 38400, 57600, 115200, 250000, 500000 or 1000000>
+ Returns: [Switching to <baud rate> baud]
+ */
+static const char SET_BAUD[] = "set baud";
+
+/*
+ Selects how the reflow is logged. ascii writes one line per second, binary
+ sends one COBS framed record per control tick, see telemetry.h.
+ Parameter: <'ascii' or 'binary'>
+ */
+static const char SET_TELEMETRY[] = "set telemetry";
+
 // =============================================================================
 // Private variables
 // =============================================================================
 
-static char cmd_buffer[CMD_BUFFER_SIZE] = {0};
 static bool arg_error = false;
 
+//
+// Completed lines, each ended by a null character, followed by the line
+// being received. Lines are executed oldest first by
+// terminal_handle_command_event().
+//
+static char line_buffer[LINE_BUFFER_SIZE];
+static uint16_t line_buffer_len = 0;    // Used bytes
+static uint16_t line_start = 0;         // Start of the line being received
+static uint16_t nbr_of_lines = 0;       // Completed lines
+
+// Words of the line being executed, pointing into line_buffer
+static token_t tokens[MAX_TOKENS];
+static uint8_t nbr_of_tokens = 0;
+
+// Output being written, see terminal_handle_dump_event(). dump_index is the
+// next sample, profile or run.
+static dump_t dump = DUMP_NONE;
+static uint16_t dump_index = 0;
+
+// The runs listed by "list runs", found when the command is executed
+static recorder_run_t dump_runs[RECORDER_MAX_RUNS];
+static uint8_t dump_nbr_of_runs = 0;
+
+// Baud rate requested by "set baud" or by a revert, switched to by
+// terminal_handle_baud_switch() when everything queued has been sent
+static uint32_t next_baud = 0;
+static bool next_baud_is_revert = false;
+
+// Set until a valid command is received at the new baud rate
+static bool baud_change_pending = false;
+static uint32_t baud_change_time = 0;
+static uint32_t previous_baud = UART_DEFAULT_BAUD;
+
 // =============================================================================
 // Private function declarations
 // =============================================================================
 
 /**
- * @brief Copies the uart rx buffer to the cmd_buffer.
+ * @brief Writes the next line of the output being dumped.
+ * @return False if there are no more lines.
+ */
+static bool write_dump_line(void);
+
+/**
+ * @brief Reloads the parameter cache after a raw write to the flash buffer,
+ * so the running controller uses what is stored.
+ * @param address - Index of the written byte, only writes to the parameter
+ * area reload the cache.
+ */
+static void reload_params(uint16_t address);
+
+/**
+ * @brief Adds one received character to the line being received.
+ * @param c - The character.
+ * @return True if the character should be echoed.
+ */
+static bool add_to_line(char c);
+
+/**
+ * @brief Removes the oldest completed line from the line buffer.
+ */
+static void remove_first_line(void);
+
+/**
+ * @brief Splits a line into tokens at spaces.
+ * @param line - The null terminated line.
+ * @return False if the line has more than MAX_TOKENS words.
+ */
+static bool tokenize(const char * line);
+
+/**
+ * @brief Compares a command with the first tokens, word by word.
+ * @param cmd - The command, words separated by one space.
+ * @param nbr_of_words - Where to store the number of words in the command if
+ * the tokens start with it, the arguments follow them.
+ * @return Zero if the tokens start with the command, less than zero if the
+ * command sorts before the tokens, otherwise greater than zero.
+ */
+static int16_t compare_command(const char * cmd, uint8_t * nbr_of_words);
+
+/**
+ * @brief Finds the command which the tokens start with.
+ * @param nbr_of_words - Where to store the number of words in the command.
+ * @return The command, or NULL if there is no such command.
+ */
+static const command_t * find_command(uint8_t * nbr_of_words);
+
+/**
+ * @brief Parses and executes a command.
+ * @param line - The null terminated line holding the command.
+ */
+static void execute_command(char * line);
+
+//
+// Command handlers, called with the tokens following the command
+//
+static void cmd_hello(const token_t * args, uint8_t nbr_of_args);
+static void cmd_test_temp(const token_t * args, uint8_t nbr_of_args);
+static void cmd_temp_curve_eval(const token_t * args, uint8_t nbr_of_args);
+
+static void cmd_init_write_buffer(const token_t * args, uint8_t nbr_of_args);
+static void cmd_buffered_write(const token_t * args, uint8_t nbr_of_args);
+static void cmd_flush_buffer(const token_t * args, uint8_t nbr_of_args);
+static void cmd_list_profiles(const token_t * args, uint8_t nbr_of_args);
+static void cmd_write_program(const token_t * args, uint8_t nbr_of_args);
+static void cmd_list_runs(const token_t * args, uint8_t nbr_of_args);
+static void cmd_dump_run(const token_t * args, uint8_t nbr_of_args);
+
+static void get_flash(const token_t * args, uint8_t nbr_of_args);
+
+static void get_pid_kp(const token_t * args, uint8_t nbr_of_args);
+static void get_pid_ki(const token_t * args, uint8_t nbr_of_args);
+static void get_pid_kd(const token_t * args, uint8_t nbr_of_args);
+static void get_pid_ttr(const token_t * args, uint8_t nbr_of_args);
+static void get_pid_d_max_gain(const token_t * args, uint8_t nbr_of_args);
+static void get_pid_servo_factor(const token_t * args, uint8_t nbr_of_args);
+static void get_temp_filter_len(const token_t * args, uint8_t nbr_of_args);
+
+static void get_start_of_soak(const token_t * args, uint8_t nbr_of_args);
+static void get_start_of_reflow(const token_t * args, uint8_t nbr_of_args);
+static void get_start_of_cool(const token_t * args, uint8_t nbr_of_args);
+static void get_profile(const token_t * args, uint8_t nbr_of_args);
+static void get_pending_writes(const token_t * args, uint8_t nbr_of_args);
+static void get_baud(const token_t * args, uint8_t nbr_of_args);
+static void get_telemetry(const token_t * args, uint8_t nbr_of_args);
+static void get_uart_drops(const token_t * args, uint8_t nbr_of_args);
+
+static void set_heater(const token_t * args, uint8_t nbr_of_args);
+static void set_servo_pos(const token_t * args, uint8_t nbr_of_args);
+static void set_flash(const token_t * args, uint8_t nbr_of_args);
+
+static void set_pid_kp(const token_t * args, uint8_t nbr_of_args);
+static void set_pid_ki(const token_t * args, uint8_t nbr_of_args);
+static void set_pid_kd(const token_t * args, uint8_t nbr_of_args);
+static void set_pid_ttr(const token_t * args, uint8_t nbr_of_args);
+static void set_pid_d_max_gain(const token_t * args, uint8_t nbr_of_args);
+static void set_pid_servo_factor(const token_t * args, uint8_t nbr_of_args);
+static void set_temp_filter_len(const token_t * args, uint8_t nbr_of_args);
+
+static void set_start_of_soak(const token_t * args, uint8_t nbr_of_args);
+static void set_start_of_reflow(const token_t * args, uint8_t nbr_of_args);
+static void set_start_of_cool(const token_t * args, uint8_t nbr_of_args);
+static void set_profile(const token_t * args, uint8_t nbr_of_args);
+static void set_baud(const token_t * args, uint8_t nbr_of_args);
+static void set_telemetry(const token_t * args, uint8_t nbr_of_args);
+
+static void set_heat_pwm(const token_t * args, uint8_t nbr_of_args);
+
+
+/**
+ * @brief Checks if a token is a given word.
+ * @param token - The token.
+ * @param str - The word.
+ * @param len - Length of the word.
+ * @return True if the token is the word.
+ */
+static bool token_equals(const token_t * token, const char * str, uint16_t len);
+
+/**
+ * @brief Parses an unsigned integer argument.
+ * @param arg - The token holding the argument.
+ * @param base - 10 or 16.
+ * @param max - Largest valid value.
+ * @param value - Where to store the parsed value.
+ * @return True if the whole token is a number not larger than max.
+ */
+static bool parse_uint_arg(const token_t * arg,
+                           uint8_t base,
+                           uint32_t max,
+                           uint32_t * value);
+
+/**
+ * @brief Parses a q16_16_t argument.
+ * @param arg - The token holding the argument.
+ * @param value - Where to store the parsed value.
+ * @return True if the whole token is a valid number.
+ */
+static bool parse_q16_16_arg(const token_t * arg, q16_16_t * value);
+
+/**
+ * @brief Writes a q16_16_t value followed by a newline to the UART.
+ * @param value - The value to write.
+ */
+static void write_q16_16_answer(q16_16_t value);
+
+/**
+ * @brief Writes when a phase of the loaded profile starts to the UART.
+ * @param phase - The phase.
+ */
+static void get_phase_start(temp_curve_phase_t phase);
+
+/**
+ * @brief Sets when a phase of the loaded profile starts.
+ * @param arg - The token holding the time.
+ * @param phase - The phase.
  */
-static void copy_to_cmd_buffer(void);
+static void set_phase_start(const token_t * arg, temp_curve_phase_t phase);
 
 /**
- * @brief Parses and executes the command in the command buffer.
+ * @brief Reloads the profile the same way as when the profile switch is
+ * moved.
  */
-static void execute_command(void);
+static void reload_profile(void);
+
+/**
+ * @brief Writes a temperature in 0.25 C as ddd.dd.
+ * @param buf - Where to write, not '\0' terminated.
+ * @param temp - The temperature in 0.25 C.
+ * @return Number of written chars.
+ */
+static uint8_t quarter_degrees_to_str(char * buf, uint16_t temp);
 
 //
-// Command help functions
+// The command table, generated from the command documentation by
+// terminal_doc_gen.py
 //
-static void cmd_hello(void);
-static void cmd_test_temp(void);
-static void cmd_temp_curve_eval(void);
-
-static void cmd_init_flash_buffer(void);
-static void cmd_buffered_write(void);
-static void cmd_flush_buffer(void);
-
-static void get_flash(void);
-
-static void get_pid_kp(void);
-static void get_pid_ki(void);
-static void get_pid_kd(void);
-static void get_pid_ttr(void);
-static void get_pid_d_max_gain(void);
-static void get_pid_servo_factor(void);
-static void get_temp_filter_len(void);
-
-static void get_start_of_soak(void);
-static void get_start_of_reflow(void);
-static void get_start_of_cool(void);
-
-static void set_heater(void);
-static void set_servo_pos(void);
-static void set_flash(void);
-
-static void set_pid_kp(void);
-static void set_pid_ki(void);
-static void set_pid_kd(void);
-static void set_pid_ttr(void);
-static void set_pid_max_d_gain(void);
-static void set_pid_servo_factor(void);
-static void set_temp_filter_len(void);
-
-static void set_start_of_soak(void);
-static void set_start_of_reflow(void);
-static void set_start_of_cool(void);
-
-static void set_heat_pwm(void);
+#include "terminal_commands.h"
 
 // =============================================================================
 // Public function definitions
@@ -309,183 +610,380 @@ static void set_heat_pwm(void);
 
 void terminal_handle_uart_event(void)
 {
-    copy_to_cmd_buffer();
-    execute_command();
+    uint8_t received[RX_CHUNK_SIZE];
+    uint8_t echo[RX_CHUNK_SIZE];
+    uint16_t nbr_of_bytes;
+    uint16_t nbr_to_echo;
+    uint16_t i;
+
+    do
+    {
+        nbr_of_bytes = uart_read(received, RX_CHUNK_SIZE);
+        nbr_to_echo = 0;
+
+        for (i = 0; i != nbr_of_bytes; ++i)
+        {
+            if (add_to_line((char)received[i]))
+            {
+                echo[nbr_to_echo++] = received[i];
+            }
+        }
+
+        uart_write_array(nbr_to_echo, echo);
+    } while (0 != nbr_of_bytes);
 }
 
-// =============================================================================
-// Private function definitions
-// =============================================================================
+bool terminal_is_command_pending(void)
+{
+    return 0 != nbr_of_lines;
+}
 
-static void copy_to_cmd_buffer(void)
+void terminal_handle_command_event(void)
 {
-    uint16_t nbr_of_bytes;
-    uint16_t current_index = 0;
+    // Executed in place, the line buffer only changes in the main loop
+    execute_command(line_buffer);
+    remove_first_line();
+}
 
-    nbr_of_bytes = uart_get_receive_buffer_size();
+bool terminal_is_baud_change_expired(void)
+{
+    return baud_change_pending && (0 == next_baud) &&
+           (timers_get_millis() - baud_change_time > BAUD_CONFIRM_TIMEOUT_MS);
+}
 
-    for (current_index = 0; current_index != nbr_of_bytes; ++current_index)
-    {
-        cmd_buffer[current_index] = (char)uart_get(current_index);
-    }
+void terminal_handle_baud_timeout(void)
+{
+    baud_change_pending = false;
 
-    cmd_buffer[current_index] = NULL;
+    next_baud = previous_baud;
+    next_baud_is_revert = true;
+}
 
-    uart_clear_receive_buffer();
+bool terminal_is_baud_switch_ready(void)
+{
+    return (0 != next_baud) && uart_is_idle();
 }
 
-static void execute_command(void)
+void terminal_handle_baud_switch(void)
 {
-    bool syntax_error = false;
-    arg_error = false;
+    uint32_t baud = uart_get_baud();
 
-    if (NULL != strstr(cmd_buffer, CMD_TYPE_HELP))
-    {
-        terminal_help(cmd_buffer);
-    }
-    else if (NULL != strstr(cmd_buffer, CMD_TYPE_GET))
+    if (uart_set_baud(next_baud))
     {
-        if (NULL != strstr(cmd_buffer, GET_FLASH))
-        {
-            get_flash();
-        }
-        else if (NULL != strstr(cmd_buffer, GET_PID_KP))
-        {
-            get_pid_kp();
-        }
-        else if (NULL != strstr(cmd_buffer, GET_PID_KI))
-        {
-            get_pid_ki();
-        }
-        else if (NULL != strstr(cmd_buffer, GET_PID_KD))
-        {
-            get_pid_kd();
-        }
-        else if (NULL != strstr(cmd_buffer, GET_PID_TTR))
-        {
-            get_pid_ttr();
-        }
-        else if (NULL != strstr(cmd_buffer, GET_PID_D_MAX_GAIN))
-        {
-            get_pid_d_max_gain();
-        }
-        else if (NULL != strstr(cmd_buffer, GET_PID_SERVO_FACTOR))
-        {
-            get_pid_servo_factor();
-        }
-        else if (NULL != strstr(cmd_buffer, GET_TEMP_FILTER_LEN))
+        // Lines received at the old baud rate must not confirm the new one
+        line_buffer_len = 0;
+        line_start = 0;
+        nbr_of_lines = 0;
+
+        if (next_baud_is_revert)
         {
-            get_temp_filter_len();
+            char ans[32];
+
+            sprintf(ans, "[Reverted to %lu baud]%s", next_baud, NEWLINE);
+            uart_write_string_priority(UART_PRIORITY_HIGH, ans);
         }
-        else if (NULL != strstr(cmd_buffer, GET_START_OF_SOAK))
+        else
         {
-            get_start_of_soak();
+            // The old baud rate is restored by terminal_handle_baud_timeout()
+            // unless a command is received at the new one
+            previous_baud = baud;
+            baud_change_pending = true;
+            baud_change_time = timers_get_millis();
         }
-        else if (NULL != strstr(cmd_buffer, GET_START_OF_REFLOW))
+    }
+
+    next_baud = 0;
+    next_baud_is_revert = false;
+}
+
+bool terminal_is_dump_active(void)
+{
+    return DUMP_NONE != dump;
+}
+
+void terminal_handle_dump_event(void)
+{
+    uint8_t line;
+
+    for (line = 0; line != DUMP_LINES_PER_EVENT; ++line)
+    {
+        if (!write_dump_line())
         {
-            get_start_of_reflow();
+            dump = DUMP_NONE;
+            return;
         }
-        else if (NULL != strstr(cmd_buffer, GET_START_OF_COOL))
+
+        ++dump_index;
+    }
+}
+
+// =============================================================================
+// Private function definitions
+// =============================================================================
+
+static bool write_dump_line(void)
+{
+    char print[40];
+
+    if (DUMP_PROFILES == dump)
+    {
+        char name[PROFILE_NAME_LEN + 1];
+
+        if (dump_index >= profile_get_count())
         {
-            get_start_of_cool();
+            return false;
         }
-        else
+
+        profile_get_name((uint8_t)dump_index, name);
+        sprintf(print, "%u %s %u%s", dump_index, name,
+                profile_get_nbr_of_points((uint8_t)dump_index), NEWLINE);
+    }
+    else if (DUMP_RUNS == dump)
+    {
+        if (dump_index >= dump_nbr_of_runs)
         {
-            syntax_error = true;
+            return false;
         }
+
+        sprintf(print, "%u %u %u%s", dump_runs[dump_index].number,
+                dump_runs[dump_index].profile,
+                dump_runs[dump_index].nbr_of_samples, NEWLINE);
     }
-    else if (NULL != strstr(cmd_buffer, CMD_TYPE_SET))
+    else
     {
-        if (NULL != strstr(cmd_buffer, SET_HEATER))
+        recorder_sample_t sample;
+        uint8_t len;
+
+        if (!recorder_read_sample(&sample))
         {
-            set_heater();
+            uart_write_string(NEWLINE);
+            return false;
         }
-        else if (NULL != strstr(cmd_buffer, SET_SERVO_POS))
+
+        len = quarter_degrees_to_str(print, sample.temp);
+        print[len++] = ';';
+        len += uint16_to_str(print + len,
+                             dump_index / RECORDER_SAMPLE_RATE, 4);
+        print[len++] = '.';
+        len += uint16_to_str(print + len,
+                             dump_index % RECORDER_SAMPLE_RATE, 1);
+        print[len++] = ';';
+        len += uint16_to_str(print + len, sample.duty, 2);
+        print[len++] = ';';
+        len += uint16_to_str(print + len, sample.servo, 3);
+        print[len++] = ';';
+        len += quarter_degrees_to_str(print + len, sample.target);
+        print[len++] = '\r';
+        print[len++] = '\n';
+        print[len] = '\0';
+    }
+
+    uart_write_string(print);
+
+    return true;
+}
+
+static void reload_params(uint16_t address)
+{
+    if (address < FLASH_LOG_AREA_SIZE)
+    {
+        params_init();
+    }
+}
+
+static bool add_to_line(char c)
+{
+    if (COMMAND_TERMINATION_CHAR == c)
+    {
+        // Space is left for the null character of the line being received,
+        // but not for the empty lines which may follow it
+        if (LINE_BUFFER_SIZE == line_buffer_len)
         {
-            set_servo_pos();
+            return false;
         }
-        else if (NULL != strstr(cmd_buffer, SET_FLASH))
+
+        line_buffer[line_buffer_len++] = NULL;
+        line_start = line_buffer_len;
+        ++nbr_of_lines;
+    }
+    else if (BACKSPACE_CHAR == c)
+    {
+        // Only erases within the line being received
+        if (line_buffer_len == line_start)
         {
-            set_flash();
+            return false;
         }
-        else if (NULL != strstr(cmd_buffer, SET_PID_KP))
+
+        --line_buffer_len;
+    }
+    else if (CARRIAGE_RETURN_CHAR != c)
+    {
+        // Characters which do not fit are dropped
+        if ((line_buffer_len >= LINE_BUFFER_SIZE - 1) ||
+            (MAX_LINE_LEN == line_buffer_len - line_start))
         {
-            set_pid_kp();
+            return false;
         }
-        else if (NULL != strstr(cmd_buffer, SET_PID_KI))
+
+        line_buffer[line_buffer_len++] = c;
+    }
+
+    return true;
+}
+
+static void remove_first_line(void)
+{
+    uint16_t len = strlen(line_buffer) + 1;
+
+    // Move the following lines to the start
+    memmove(line_buffer, line_buffer + len, line_buffer_len - len);
+    line_buffer_len -= len;
+    line_start -= len;
+    --nbr_of_lines;
+}
+
+static bool tokenize(const char * line)
+{
+    nbr_of_tokens = 0;
+
+    while (true)
+    {
+        while (isspace(*line))
         {
-            set_pid_ki();
+            ++line;
         }
-        else if (NULL != strstr(cmd_buffer, SET_PID_KD))
+
+        if ('\0' == *line)
         {
-            set_pid_kd();
+            return true;
         }
-        else if (NULL != strstr(cmd_buffer, SET_PID_TTR))
+
+        if (MAX_TOKENS == nbr_of_tokens)
         {
-            set_pid_ttr();
+            return false;
         }
-        else if (NULL != strstr(cmd_buffer, SET_PID_D_MAX_GAIN))
+
+        tokens[nbr_of_tokens].str = line;
+
+        while (('\0' != *line) && !isspace(*line))
         {
-            set_pid_max_d_gain();
+            ++line;
         }
-        else if (NULL != strstr(cmd_buffer, SET_PID_SERVO_FACTOR))
+
+        tokens[nbr_of_tokens].len = line - tokens[nbr_of_tokens].str;
+        ++nbr_of_tokens;
+    }
+}
+
+static int16_t compare_command(const char * cmd, uint8_t * nbr_of_words)
+{
+    uint8_t i;
+
+    for (i = 0; '\0' != *cmd; ++i)
+    {
+        uint16_t len = strcspn(cmd, " ");
+        int16_t result;
+
+        // The line is the start of the command
+        if (i == nbr_of_tokens)
         {
-            set_pid_servo_factor();
+            return 1;
         }
-        else if (NULL != strstr(cmd_buffer, SET_TEMP_FILTER_LEN))
+
+        result = memcmp(cmd,
+                        tokens[i].str,
+                        (len < tokens[i].len) ? len : tokens[i].len);
+
+        if (0 == result)
         {
-            set_temp_filter_len();
+            result = (int16_t)len - (int16_t)tokens[i].len;
         }
-        else if (NULL != strstr(cmd_buffer, SET_HEAT_PWM))
+
+        if (0 != result)
         {
-            set_heat_pwm();
+            return result;
         }
-        else if (NULL != strstr(cmd_buffer, SET_START_OF_SOAK))
+
+        cmd += len;
+
+        if (' ' == *cmd)
         {
-            set_start_of_soak();
+            ++cmd;
         }
-        else if (NULL != strstr(cmd_buffer, SET_START_OF_REFLOW))
+    }
+
+    *nbr_of_words = i;
+
+    return 0;
+}
+
+static const command_t * find_command(uint8_t * nbr_of_words)
+{
+    uint8_t low = 0;
+    uint8_t high = NBR_OF_COMMANDS;
+
+    // No command is the start of another one, so at most one matches
+    while (low != high)
+    {
+        uint8_t middle = (low + high) / 2;
+        int16_t result = compare_command(COMMANDS[middle].cmd, nbr_of_words);
+
+        if (0 == result)
         {
-            set_start_of_reflow();
+            return &COMMANDS[middle];
         }
-        else if (NULL != strstr(cmd_buffer, SET_START_OF_COOL))
+        else if (result < 0)
         {
-            set_start_of_cool();
+            low = middle + 1;
         }
         else
         {
-            syntax_error = true;
+            high = middle;
         }
     }
+
+    return NULL;
+}
+
+static void execute_command(char * line)
+{
+    bool syntax_error = false;
+    const command_t * command;
+    uint8_t nbr_of_words;
+    uint8_t nbr_of_args;
+
+    arg_error = false;
+
+    if (!tokenize(line))
+    {
+        arg_error = true;
+    }
+    else if ((0 != nbr_of_tokens) &&
+             token_equals(&tokens[0], CMD_TYPE_HELP, strlen(CMD_TYPE_HELP)))
+    {
+        terminal_help(line);
+    }
     else
     {
-        if (NULL != strstr(cmd_buffer, CMD_HELLO))
-        {
-            cmd_hello();
-        }
-        else if (NULL != strstr(cmd_buffer, CMD_TEST_TEMP))
-        {
-            cmd_test_temp();
-        }
-        else if (NULL != strstr(cmd_buffer, CMD_TEMP_CURVE_EVAL))
-        {
-            cmd_temp_curve_eval();
-        }
-        else if (NULL != strstr(cmd_buffer, CMD_INIT_WRITE_BUFFER))
-        {
-            cmd_init_flash_buffer();
-        }
-        else if (NULL != strstr(cmd_buffer, CMD_BUFFERED_WRITE))
-        {
-            cmd_buffered_write();
-        }
-        else if (NULL != strstr(cmd_buffer, CMD_FLUSH_BUFFER))
+        command = find_command(&nbr_of_words);
+
+        if (NULL == command)
         {
-            cmd_flush_buffer();
+            syntax_error = true;
         }
         else
         {
-            syntax_error = true;
+            nbr_of_args = nbr_of_tokens - nbr_of_words;
+
+            if ((nbr_of_args < command->min_args) ||
+                (nbr_of_args > command->max_args))
+            {
+                arg_error = true;
+            }
+            else
+            {
+                command->handler(&tokens[nbr_of_words], nbr_of_args);
+            }
         }
     }
 
@@ -499,15 +997,21 @@ static void execute_command(void)
         uart_write_string(ARGUMENT_ERROR);
         uart_write_string(NEWLINE);
     }
+    else
+    {
+        // The command was received after the last switch, see
+        // terminal_handle_baud_switch(), so the baud rate works
+        baud_change_pending = false;
+    }
 }
 
-static void cmd_hello(void)
+static void cmd_hello(const token_t * args, uint8_t nbr_of_args)
 {
     uart_write_string("Hello!");
     uart_write_string(NEWLINE);
 }
 
-static void cmd_test_temp(void)
+static void cmd_test_temp(const token_t * args, uint8_t nbr_of_args)
 {
     char ans[32] = {0};
     uint16_t reading = max6675_read_blocking();
@@ -515,294 +1019,313 @@ static void cmd_test_temp(void)
     uart_write_string(ans);
 }
 
-static void cmd_temp_curve_eval(void)
+static void cmd_temp_curve_eval(const token_t * args, uint8_t nbr_of_args)
 {
-    char ans[32] = {0};
-    uint8_t * p;
-    char arg[16] = {0};
+    uint32_t time;
 
-    p = (uint8_t*)strstr(cmd_buffer, CMD_TEMP_CURVE_EVAL);
-    p += strlen(CMD_TEMP_CURVE_EVAL);
-    p += 1;     // +1 for space
+    arg_error = !parse_uint_arg(&args[0], 10, UINT16_MAX, &time);
 
-    if (!isdigit(*p))
+    if (!arg_error)
     {
-        arg_error = true;
+        write_q16_16_answer(temp_curve_eval_at((uint16_t)time));
     }
-    else
-    {
-        uint8_t i = 0;
-        uint16_t time;
-        q16_16_t temp;
+}
 
-        while ((i != 15) && isdigit(*p))
-        {
-            arg[i++] = *(p++);
-        }
+static void cmd_init_write_buffer(const token_t * args, uint8_t nbr_of_args)
+{
+    flash_init_write_buffer();
 
-        arg[i] = NULL;
+    // Discarded parameter writes must not stay in the cache
+    params_init();
+}
 
-        time = (uint16_t)atoi(arg);
+static void cmd_buffered_write(const token_t * args, uint8_t nbr_of_args)
+{
+    uint32_t address;
+    uint32_t value;
 
-        temp = temp_curve_eval(time);
+    arg_error = !parse_uint_arg(&args[0], 16, FLASH_MEM_SIZE - 1, &address) ||
+                !parse_uint_arg(&args[1], 16, UINT8_MAX, &value);
 
-        sprintf(ans, "%lf%s", q16_16_to_double(temp), NEWLINE);
-        uart_write_string(ans);
+    if (!arg_error)
+    {
+        flash_write_byte_to_buffer((flash_index_t)address, (uint8_t)value);
+        reload_params((uint16_t)address);
     }
 }
 
-static void cmd_init_flash_buffer(void)
+static void cmd_flush_buffer(const token_t * args, uint8_t nbr_of_args)
 {
-    flash_init_write_buffer();
+    if (status_check(STATUS_REFLOW_PROGRAM_ACTIVE))
+    {
+        // Never stall the control loop, the main loop commits when idle
+        flash_request_commit();
+        uart_write_string(FLASH_COMMIT_DEFERRED);
+        uart_write_string(NEWLINE);
+    }
+    else
+    {
+        flash_write_buffer_to_flash();
+    }
 }
 
-static void cmd_buffered_write(void)
+static void cmd_list_profiles(const token_t * args, uint8_t nbr_of_args)
 {
-    uint8_t * p;
-    char address_arg[HEX_WORD_STR_LEN] = {0};
-    char value_arg[HEX_BYTE_STR_LEN] = {0};
+    // Written by the main loop, never wait for the uart here
+    dump_index = 0;
+    dump = DUMP_PROFILES;
+}
 
-    p = (uint8_t*)strstr(cmd_buffer, SET_FLASH);
-    p += strlen(SET_FLASH);
-    p += 1;     // +1 for space
+static void cmd_write_program(const token_t * args, uint8_t nbr_of_args)
+{
+    static const char * const PHASE_NAMES[TEMP_CURVE_NBR_OF_PHASES] =
+    {
+        "soak", "reflow", "cool"
+    };
+    profile_segment_t segments[PROFILE_MAX_SEGMENTS];
+    char name[PROFILE_NAME_LEN + 1] = {0};
+    uint8_t nbr_of_segments = 0;
+    uint8_t phase = PROFILE_NO_PHASE;
+    uint32_t index;
+    uint32_t start_temp;
+    uint8_t a;
+    uint8_t i;
+
+    arg_error = !parse_uint_arg(&args[0], 10, PROFILE_MAX_COUNT - 1, &index) ||
+                (args[1].len > PROFILE_NAME_LEN) ||
+                !parse_uint_arg(&args[2], 10, PROFILE_MAX_TARGET, &start_temp);
 
-    if (!isxdigit(*p))
+    if (!arg_error)
     {
-        arg_error = true;
+        memcpy(name, args[1].str, args[1].len);
     }
-    else
-    {
-        uint8_t i = 0;
-        uint16_t address;
-        uint8_t value;
-
-        //
-        // Parse address argument
-        //
-        while ((i != HEX_WORD_STR_LEN) && isxdigit(*p))
-        {
-            address_arg[i++] = *(p++);
-        }
 
-        address_arg[i] = NULL;
-        arg_error = arg_error || (i == 0);
-        address = (uint16_t)strtol(address_arg, NULL, 16);
+    a = 3;
 
-        //
-        // Parse value argument
-        //
-        p += 1; // +1 for space
-        i = 0;
+    while (!arg_error && (a != nbr_of_args))
+    {
+        profile_segment_t * segment = &segments[nbr_of_segments];
+        q16_16_t rate;
+        uint32_t target;
+        uint32_t hold;
 
-        while ((i != HEX_BYTE_STR_LEN) && isxdigit(*p))
+        for (i = 0; i != TEMP_CURVE_NBR_OF_PHASES; ++i)
         {
-            value_arg[i++] = *(p++);
+            if (token_equals(&args[a], PHASE_NAMES[i], strlen(PHASE_NAMES[i])))
+            {
+                break;
+            }
         }
 
-        value_arg[i] = NULL;
-        arg_error = arg_error || (i == 0);
-        value = (uint8_t)strtol(value_arg, NULL, 16);
+        if (i != TEMP_CURVE_NBR_OF_PHASES)
+        {
+            phase = i;
+            ++a;
+            continue;
+        }
 
-        //
-        // Perform flash write
-        //
-        if (!arg_error && (address < FLASH_MEM_SIZE))
+        if ((nbr_of_segments == PROFILE_MAX_SEGMENTS) || (nbr_of_args - a < 3))
         {
-            flash_write_byte_to_buffer((flash_index_t)address, value);
+            arg_error = true;
+            break;
         }
-        else
+
+        // Rate in C/s, stored in 0.1 C/s
+        if (!parse_q16_16_arg(&args[a], &rate) ||
+            (rate < MIN_PROGRAM_RATE) || (rate > MAX_PROGRAM_RATE))
         {
             arg_error = true;
+            break;
         }
+
+        rate = (rate * 10 + 0x8000) >> 16;
+
+        arg_error =
+            !parse_uint_arg(&args[a + 1], 10, PROFILE_MAX_TARGET, &target) ||
+            !parse_uint_arg(&args[a + 2], 10, UINT8_MAX, &hold);
+
+        segment->target = (uint16_t)target;
+        segment->rate = (uint8_t)rate;
+        segment->hold = (uint8_t)hold;
+        segment->phase = phase;
+
+        phase = PROFILE_NO_PHASE;
+        ++nbr_of_segments;
+
+        a += 3;
+    }
+
+    if (arg_error || (0 == nbr_of_segments) ||
+        !profile_write_program((uint8_t)index, name, (int16_t)start_temp,
+                               segments, nbr_of_segments))
+    {
+        arg_error = true;
+    }
+    else if ((uint8_t)index == temp_curve_get_profile())
+    {
+        reload_profile();
     }
 }
 
-static void cmd_flush_buffer(void)
+static void cmd_list_runs(const token_t * args, uint8_t nbr_of_args)
 {
-    flash_write_buffer_to_flash();
+    char print[48];
+
+    sprintf(print, "Holds %u s, older runs are overwritten%s",
+            RECORDER_MAX_SAMPLES / RECORDER_SAMPLE_RATE, NEWLINE);
+    uart_write_string(print);
+
+    // Written by the main loop, never wait for the uart here
+    dump_nbr_of_runs = recorder_get_runs(dump_runs, RECORDER_MAX_RUNS);
+    dump_index = 0;
+    dump = DUMP_RUNS;
 }
 
-static void get_flash(void)
+static void cmd_dump_run(const token_t * args, uint8_t nbr_of_args)
 {
-    uint8_t * p;
-    char address_arg[HEX_WORD_STR_LEN] = {0};
+    uint32_t number;
 
-    p = (uint8_t*)strstr(cmd_buffer, GET_FLASH);
-    p += strlen(GET_FLASH);
-    p += 1;     // +1 for space
+    arg_error = !parse_uint_arg(&args[0], 10, UINT16_MAX, &number) ||
+                !recorder_open_run((uint16_t)number);
 
-    if (!isxdigit(*p))
+    if (!arg_error)
     {
-        arg_error = true;
+        uart_write_string("temperature;time;heater duty;servo pos;target temp");
+        uart_write_string(NEWLINE);
+
+        dump_index = 0;
+        dump = DUMP_RUN;
     }
-    else
-    {
-        uint8_t i = 0;
-        uint16_t address;
+}
 
-        //
-        // Parse address argument
-        //
-        while ((i != HEX_WORD_STR_LEN) && isxdigit(*p))
-        {
-            address_arg[i++] = *(p++);
-        }
+static void get_flash(const token_t * args, uint8_t nbr_of_args)
+{
+    uint32_t address;
 
-        address_arg[i] = NULL;
-        address = (uint16_t)strtol(address_arg, NULL, 16);
+    arg_error = !parse_uint_arg(&args[0], 16, FLASH_MEM_SIZE - 1, &address);
 
-        //
-        // Perform flash read
-        //
-        if (address < FLASH_MEM_SIZE)
-        {
-            uint8_t value;
-            char ans[32];
-            
-            value = flash_read_byte((flash_index_t)address);
-            sprintf(ans, "%02X%s", value, NEWLINE);
-            uart_write_string(ans);
-        }
-        else
-        {
-            arg_error = true;
-        }
+    if (!arg_error)
+    {
+        char ans[32];
+
+        sprintf(ans, "%02X%s",
+                flash_read_byte((flash_index_t)address), NEWLINE);
+        uart_write_string(ans);
     }
 }
 
-static void get_pid_kp(void)
+static void get_pid_kp(const token_t * args, uint8_t nbr_of_args)
 {
-    char ans[32];
-
-    sprintf(ans, "%lf%s", q16_16_to_double(control_get_k()), NEWLINE);
-    uart_write_string(ans);
+    write_q16_16_answer(params_get()->k);
 }
 
-static void get_pid_ki(void)
+static void get_pid_ki(const token_t * args, uint8_t nbr_of_args)
 {
-    char ans[32];
+    write_q16_16_answer(params_get()->ti);
+}
+static void get_pid_kd(const token_t * args, uint8_t nbr_of_args)
+{
+    write_q16_16_answer(params_get()->td);
+}
 
-    sprintf(ans, "%lf%s", q16_16_to_double(control_get_ti()), NEWLINE);
-    uart_write_string(ans);
+static void get_pid_ttr(const token_t * args, uint8_t nbr_of_args)
+{
+    write_q16_16_answer(params_get()->ttr);
 }
-static void get_pid_kd(void)
+
+static void get_pid_d_max_gain(const token_t * args, uint8_t nbr_of_args)
 {
-    char ans[32];
+    write_q16_16_answer(params_get()->d_max_gain);
+}
 
-    sprintf(ans, "%lf%s", q16_16_to_double(control_get_td()), NEWLINE);
-    uart_write_string(ans);
+static void get_pid_servo_factor(const token_t * args, uint8_t nbr_of_args)
+{
+    write_q16_16_answer(params_get()->servo_factor);
 }
 
-static void get_pid_ttr(void)
+static void get_temp_filter_len(const token_t * args, uint8_t nbr_of_args)
 {
     char ans[32];
 
-    q16_16_t t_tr = (q16_16_t)flash_read_dword(FLASH_INDEX_TTR);
-
-    sprintf(ans, "%lf%s", q16_16_to_double(t_tr), NEWLINE);
+    sprintf(ans, "%u%s", params_get()->filter_len, NEWLINE);
     uart_write_string(ans);
 }
 
-static void get_pid_d_max_gain(void)
+static void get_start_of_soak(const token_t * args, uint8_t nbr_of_args)
 {
-    char ans[32];
+    get_phase_start(TEMP_CURVE_PHASE_SOAK);
+}
 
-    q16_16_t d_max_gain = (q16_16_t)flash_read_dword(FLASH_INDEX_D_MAX_GAIN);
+static void get_start_of_reflow(const token_t * args, uint8_t nbr_of_args)
+{
+    get_phase_start(TEMP_CURVE_PHASE_REFLOW);
+}
 
-    sprintf(ans, "%lf%s", q16_16_to_double(d_max_gain), NEWLINE);
-    uart_write_string(ans);
+static void get_start_of_cool(const token_t * args, uint8_t nbr_of_args)
+{
+    get_phase_start(TEMP_CURVE_PHASE_COOL);
 }
 
-static void get_pid_servo_factor(void)
+static void get_profile(const token_t * args, uint8_t nbr_of_args)
 {
     char ans[32];
+    char name[PROFILE_NAME_LEN + 1];
+    uint8_t index = temp_curve_get_profile();
 
-    sprintf(ans, "%lf%s", q16_16_to_double(
-            (q16_16_t)flash_read_dword(FLASH_INDEX_SERVO_FACTOR)),
-            NEWLINE);
+    profile_get_name(index, name);
+    sprintf(ans, "%u %s%s", index, name, NEWLINE);
     uart_write_string(ans);
 }
 
-static void get_temp_filter_len(void)
+static void get_pending_writes(const token_t * args, uint8_t nbr_of_args)
 {
     char ans[32];
 
-    sprintf(ans, "%lu%s", flash_read_dword(FLASH_INDEX_FILTER_LEN), NEWLINE);
+    sprintf(ans, "%u%s", flash_get_nbr_of_pending_writes(), NEWLINE);
     uart_write_string(ans);
 }
 
-static void get_start_of_soak(void)
+static void get_baud(const token_t * args, uint8_t nbr_of_args)
 {
     char ans[32];
 
-    if (buttons_is_profile_switch_lead())
-    {
-        sprintf(ans, "%us%s",
-            flash_read_word(FLASH_INDEX_LEAD_SOAK_START_SEC),
-            NEWLINE);
-    }
-    else
-    {
-        sprintf(ans, "%us%s",
-            flash_read_word(FLASH_INDEX_LEAD_FREE_SOAK_START_SEC),
-            NEWLINE);
-    }
-
+    sprintf(ans, "%lu%s", uart_get_baud(), NEWLINE);
     uart_write_string(ans);
 }
 
-static void get_start_of_reflow(void)
+static void get_telemetry(const token_t * args, uint8_t nbr_of_args)
 {
-    char ans[32];
-
-    if (buttons_is_profile_switch_lead())
+    if (TELEMETRY_MODE_BINARY == telemetry_get_mode())
     {
-        sprintf(ans, "%us%s",
-            flash_read_word(FLASH_INDEX_LEAD_REFLOW_START_SEC),
-            NEWLINE);
+        uart_write_string("binary");
     }
     else
     {
-        sprintf(ans, "%us%s",
-            flash_read_word(FLASH_INDEX_LEAD_FREE_REFLOW_START_SEC),
-            NEWLINE);
+        uart_write_string("ascii");
     }
 
-    uart_write_string(ans);
+    uart_write_string(NEWLINE);
 }
 
-static void get_start_of_cool(void)
+static void get_uart_drops(const token_t * args, uint8_t nbr_of_args)
 {
-    char ans[32];
+    char ans[40];
 
-    if (buttons_is_profile_switch_lead())
-    {
-        sprintf(ans, "%us%s",
-            flash_read_word(FLASH_INDEX_LEAD_COOL_START_SEC),
-            NEWLINE);
-    }
-    else
-    {
-        sprintf(ans, "%us%s",
-            flash_read_word(FLASH_INDEX_LEAD_FREE_COOL_START_SEC),
+    sprintf(ans, "%lu %lu %lu%s",
+            uart_get_tx_dropped(UART_PRIORITY_NORMAL),
+            uart_get_tx_dropped(UART_PRIORITY_HIGH),
+            uart_get_rx_dropped(),
             NEWLINE);
-    }
-
     uart_write_string(ans);
 }
 
-static void set_heater(void)
+static void set_heater(const token_t * args, uint8_t nbr_of_args)
 {
-    uint8_t * p;
-
-    p = (uint8_t*)strstr(cmd_buffer, SET_HEATER);
-    p += strlen(SET_HEATER);
-    p += 1;     // +1 for space
-
-    if (('o' == *p) && ('n' == *(p + 1)))
+    if (token_equals(&args[0], "on", 2))
     {
         HEATER_ON;
-    } else if (('o' == *p) && ('f' == *(p + 1)) && ('f' == *(p + 2)))
+    }
+    else if (token_equals(&args[0], "off", 3))
     {
         HEATER_OFF;
     }
@@ -812,488 +1335,286 @@ static void set_heater(void)
     }
 }
 
-static void set_servo_pos(void)
+static void set_servo_pos(const token_t * args, uint8_t nbr_of_args)
 {
-    uint8_t * p;
-    char arg[5] = {0};
+    uint32_t pos;
 
-    p = (uint8_t*)strstr(cmd_buffer, SET_SERVO_POS);
-    p += strlen(SET_SERVO_POS);
-    p += 1;     // +1 for space
+    arg_error = !parse_uint_arg(&args[0], 10, 1200, &pos) ||
+                (0 == pos);
 
-    if (!isdigit(*p))
-    {
-        arg_error = true;
-    }
-    else
+    if (!arg_error)
     {
-        uint8_t i = 0;
-        uint16_t pos;
-
-        while ((i != 5) && isdigit(*p))
-        {
-            arg[i++] = *(p++);
-        }
-
-        arg[i] = NULL;
-
-        pos = (uint16_t)atoi(arg);
-
-        if ((pos > 0) && (pos <= 1200))
-        {
-            servo_set_pos(pos);
-        }
-        else
-        {
-            arg_error = true;
-        }
+        servo_set_pos((uint16_t)pos);
     }
 }
 
-static void set_flash(void)
+static void set_flash(const token_t * args, uint8_t nbr_of_args)
 {
-    uint8_t * p;
-    char address_arg[HEX_WORD_STR_LEN] = {0};
-    char value_arg[HEX_BYTE_STR_LEN] = {0};
+    uint32_t address;
+    uint32_t value;
 
-    p = (uint8_t*)strstr(cmd_buffer, SET_FLASH);
-    p += strlen(SET_FLASH);
-    p += 1;     // +1 for space
+    arg_error = !parse_uint_arg(&args[0], 16, FLASH_MEM_SIZE - 1, &address) ||
+                !parse_uint_arg(&args[1], 16, UINT8_MAX, &value);
 
-    if (!isxdigit(*p))
-    {
-        arg_error = true;
-    }
-    else
+    if (!arg_error)
     {
-        uint8_t i = 0;
-        uint16_t address;
-        uint8_t value;
-
-        //
-        // Parse address argument
-        //
-        while ((i != HEX_WORD_STR_LEN) && isxdigit(*p))
-        {
-            address_arg[i++] = *(p++);
-        }
-
-        address_arg[i] = NULL;
-        arg_error = arg_error || (i == 0);
-        address = (uint16_t)strtol(address_arg, NULL, 16);
-
-        //
-        // Parse value argument
-        //
-        p += 1; // +1 for space
-        i = 0;
-        
-        while ((i != HEX_BYTE_STR_LEN) && isxdigit(*p))
-        {
-            value_arg[i++] = *(p++);
-        }
-
-        value_arg[i] = NULL;
-        arg_error = arg_error || (i == 0);
-        value = (uint8_t)strtol(value_arg, NULL, 16);
-        
-        //
-        // Perform flash write
-        //
-        if (!arg_error && (address < FLASH_MEM_SIZE))
-        {
-            flash_init_write_buffer();
-            flash_write_byte_to_buffer((flash_index_t)address, value);
-            flash_write_buffer_to_flash();
-        }
-        else
-        {
-            arg_error = true;
-        }
+        flash_write_byte((flash_index_t)address, (uint8_t)value);
+        reload_params((uint16_t)address);
     }
 }
 
-static void set_pid_kp(void)
+static void set_pid_kp(const token_t * args, uint8_t nbr_of_args)
 {
-    uint8_t * p;
-    char arg[16] = {0};
-    uint8_t i = 0;
-
-    p = (uint8_t*)strstr(cmd_buffer, SET_PID_KP);
-    p += strlen(SET_PID_KP);
-    p += 1;     // +1 for space
-
-    while (isdigit(*p) || ('-' == *p))
-    {
-        arg[i++] = *(p++);
-    }
+    q16_16_t kp;
 
-    arg[i] = NULL;
-
-    arg_error = (0 == i);
+    arg_error = !parse_q16_16_arg(&args[0], &kp);
 
     if (!arg_error)
     {
-        double kp_as_double = atoi(arg);
-        q16_16_t kp = double_to_q16_16(kp_as_double);
-
-        control_set_k(kp);
-        
-        flash_init_write_buffer();
-        flash_write_dword_to_buffer(FLASH_INDEX_K, (uint32_t)kp);
-        flash_write_buffer_to_flash();
+        params_set_k(kp);
     }
 }
 
-static void set_pid_ki(void)
+static void set_pid_ki(const token_t * args, uint8_t nbr_of_args)
 {
-    uint8_t * p;
-    char arg[16] = {0};
-    uint8_t i = 0;
+    q16_16_t ki;
 
-    p = (uint8_t*)strstr(cmd_buffer, SET_PID_KI);
-    p += strlen(SET_PID_KI);
-    p += 1;     // +1 for space
-
-    while (isdigit(*p) || ('-' == *p))
-    {
-        arg[i++] = *(p++);
-    }
-
-    arg[i] = NULL;
-
-    arg_error = (0 == i);
+    arg_error = !parse_q16_16_arg(&args[0], &ki);
 
     if (!arg_error)
     {
-        double ki_as_double = atoi(arg);
-        q16_16_t ki = double_to_q16_16(ki_as_double);
-
-        control_set_ti(ki);
-
-        flash_init_write_buffer();
-        flash_write_dword_to_buffer(FLASH_INDEX_TI, (uint32_t)ki);
-        flash_write_buffer_to_flash();
+        params_set_ti(ki);
     }
 }
 
-static void set_pid_kd(void)
+static void set_pid_kd(const token_t * args, uint8_t nbr_of_args)
 {
-    uint8_t * p;
-    char arg[16] = {0};
-    uint8_t i = 0;
+    q16_16_t kd;
 
-    p = (uint8_t*)strstr(cmd_buffer, SET_PID_KD);
-    p += strlen(SET_PID_KD);
-    p += 1;     // +1 for space
+    arg_error = !parse_q16_16_arg(&args[0], &kd);
 
-    while (isdigit(*p) || ('-' == *p))
+    if (!arg_error)
     {
-        arg[i++] = *(p++);
+        params_set_td(kd);
     }
+}
 
-    arg[i] = NULL;
+static void set_pid_ttr(const token_t * args, uint8_t nbr_of_args)
+{
+    q16_16_t factor;
 
-    arg_error = (0 == i);
+    arg_error = !parse_q16_16_arg(&args[0], &factor);
 
     if (!arg_error)
     {
-        double kd_as_double = atoi(arg);
-        q16_16_t kd = double_to_q16_16(kd_as_double);
-
-        control_set_td(kd);
-
-        flash_init_write_buffer();
-        flash_write_dword_to_buffer(FLASH_INDEX_TD , (uint32_t)kd);
-        flash_write_buffer_to_flash();
+        params_set_ttr(factor);
     }
 }
 
-static void set_pid_ttr(void)
+static void set_pid_d_max_gain(const token_t * args, uint8_t nbr_of_args)
 {
-    uint8_t * p;
-    char arg[16] = {0};
-    uint8_t i = 0;
+    q16_16_t factor;
 
-    p = (uint8_t*)strstr(cmd_buffer, SET_PID_TTR);
-    p += strlen(SET_PID_TTR);
-    p += 1;     // +1 for space
+    arg_error = !parse_q16_16_arg(&args[0], &factor);
 
-    while (isdigit(*p) || ('.' == *p))
+    if (!arg_error)
     {
-        arg[i++] = *(p++);
+        params_set_d_max_gain(factor);
     }
+}
 
-    arg[i] = NULL;
+static void set_pid_servo_factor(const token_t * args, uint8_t nbr_of_args)
+{
+    q16_16_t factor;
 
-    arg_error = (0 == i);
+    arg_error = !parse_q16_16_arg(&args[0], &factor);
 
     if (!arg_error)
     {
-        double ttr_as_double = atoi(arg);
-        q16_16_t factor = double_to_q16_16(ttr_as_double);
+        // The servo factor is stored with the opposite sign
+        factor = -factor;
 
-        flash_init_write_buffer();
-        flash_write_dword_to_buffer(FLASH_INDEX_TTR, (uint32_t)factor);
-        flash_write_buffer_to_flash();
-
-        control_set_ttr(factor);
+        params_set_servo_factor(factor);
     }
 }
 
-static void set_pid_max_d_gain(void)
+static void set_temp_filter_len(const token_t * args, uint8_t nbr_of_args)
 {
-    uint8_t * p;
-    char arg[16] = {0};
-    uint8_t i = 0;
+    uint32_t len;
 
-    p = (uint8_t*)strstr(cmd_buffer, SET_PID_D_MAX_GAIN);
-    p += strlen(SET_PID_D_MAX_GAIN);
-    p += 1;     // +1 for space
+    arg_error = !parse_uint_arg(&args[0], 10, UINT16_MAX, &len);
 
-    while (isdigit(*p) || ('.' == *p))
+    if (!arg_error)
     {
-        arg[i++] = *(p++);
+        params_set_filter_len((uint16_t)len);
     }
+}
 
-    arg[i] = NULL;
+static void set_heat_pwm(const token_t * args, uint8_t nbr_of_args)
+{
+    uint32_t pwm;
 
-    arg_error = (0 == i);
+    arg_error = !parse_uint_arg(&args[0], 10, 50, &pwm);
 
     if (!arg_error)
     {
-        double factor_as_double = atoi(arg);
-        q16_16_t factor = double_to_q16_16(factor_as_double);
-
-        flash_init_write_buffer();
-        flash_write_dword_to_buffer(FLASH_INDEX_D_MAX_GAIN, (uint32_t)factor);
-        flash_write_buffer_to_flash();
+        timers_activate_heater_control();
+        timers_set_heater_duty((uint16_t)pwm);
     }
 }
 
-static void set_pid_servo_factor(void)
+static void set_start_of_soak(const token_t * args, uint8_t nbr_of_args)
 {
-    uint8_t * p;
-    char arg[16] = {0};
-    uint8_t i = 0;
+    set_phase_start(&args[0], TEMP_CURVE_PHASE_SOAK);
+}
 
-    p = (uint8_t*)strstr(cmd_buffer, SET_PID_SERVO_FACTOR);
-    p += strlen(SET_PID_SERVO_FACTOR);
-    p += 1;     // +1 for space
+static void set_start_of_reflow(const token_t * args, uint8_t nbr_of_args)
+{
+    set_phase_start(&args[0], TEMP_CURVE_PHASE_REFLOW);
+}
 
-    while (isdigit(*p) || ('.' == *p))
-    {
-        arg[i++] = *(p++);
-    }
+static void set_start_of_cool(const token_t * args, uint8_t nbr_of_args)
+{
+    set_phase_start(&args[0], TEMP_CURVE_PHASE_COOL);
+}
+
+static void set_profile(const token_t * args, uint8_t nbr_of_args)
+{
+    temp_curve_variant_t variant;
+    uint32_t index;
 
-    arg[i] = NULL;
+    variant = buttons_is_profile_switch_lead() ?
+            TEMP_CURVE_LEAD : TEMP_CURVE_LEAD_FREE;
 
-    arg_error = (0 == i);
+    arg_error = !parse_uint_arg(&args[0], 10, UINT8_MAX, &index) ||
+                !profile_select(variant, (uint8_t)index);
 
     if (!arg_error)
     {
-        double factor_as_double = -1.0 * atoi(arg);
-        q16_16_t factor = double_to_q16_16(factor_as_double);
-
-        flash_init_write_buffer();
-        flash_write_dword_to_buffer(FLASH_INDEX_SERVO_FACTOR, (uint32_t)factor);
-        flash_write_buffer_to_flash();
+        reload_profile();
     }
 }
 
-static void set_temp_filter_len(void)
+static void set_baud(const token_t * args, uint8_t nbr_of_args)
 {
-    uint8_t * p;
-    char arg[16] = {0};
-    uint8_t i = 0;
-
-    p = (uint8_t*)strstr(cmd_buffer, SET_TEMP_FILTER_LEN);
-    p += strlen(SET_TEMP_FILTER_LEN);
-    p += 1;     // +1 for space
-
-    while (isdigit(*p))
-    {
-        arg[i++] = *(p++);
-    }
-
-    arg[i] = NULL;
+    char ans[32];
+    uint32_t baud;
 
-    arg_error = (0 == i);
+    // Switched to after the answer is sent, see terminal_handle_baud_switch()
+    arg_error = !parse_uint_arg(&args[0], 10, UINT32_MAX, &baud) ||
+                !uart_is_baud_supported(baud);
 
     if (!arg_error)
     {
-        uint32_t filter_len = atoi(arg);
+        sprintf(ans, "[Switching to %lu baud]%s", baud, NEWLINE);
+        uart_write_string(ans);
 
-        flash_init_write_buffer();
-        flash_write_dword_to_buffer(FLASH_INDEX_FILTER_LEN, filter_len);
-        flash_write_buffer_to_flash();
+        next_baud = baud;
+        next_baud_is_revert = false;
     }
 }
 
-static void set_heat_pwm(void)
+static void set_telemetry(const token_t * args, uint8_t nbr_of_args)
 {
-    uint8_t * p;
-    char arg[5] = {0};
-
-    p = (uint8_t*)strstr(cmd_buffer, SET_HEAT_PWM);
-    p += strlen(SET_HEAT_PWM);
-    p += 1;     // +1 for space
-
-    if (!isdigit(*p))
+    if (token_equals(&args[0], "ascii", 5))
     {
-        arg_error = true;
+        telemetry_set_mode(TELEMETRY_MODE_ASCII);
+    }
+    else if (token_equals(&args[0], "binary", 6))
+    {
+        telemetry_set_mode(TELEMETRY_MODE_BINARY);
     }
     else
     {
-        uint8_t i = 0;
-        uint16_t pwm;
-
-        while ((i != 5) && isdigit(*p))
-        {
-            arg[i++] = *(p++);
-        }
-
-        arg[i] = NULL;
-
-        pwm = (uint16_t)atoi(arg);
-
-        if ((pwm >= 0) && (pwm <= 50))
-        {
-            timers_activate_heater_control();
-            timers_set_heater_duty(pwm);
-        }
-        else
-        {
-            arg_error = true;
-        }
+        arg_error = true;
     }
 }
 
-static void set_start_of_soak(void)
+static bool token_equals(const token_t * token, const char * str, uint16_t len)
 {
-    uint8_t * p;
-    char arg[8] = {0};
+    return (token->len == len) && (0 == strncmp(token->str, str, len));
+}
 
-    p = (uint8_t*)strstr(cmd_buffer, SET_START_OF_SOAK);
-    p += strlen(SET_START_OF_SOAK);
-    p += 1;     // +1 for space
+static bool parse_uint_arg(const token_t * arg,
+                           uint8_t base,
+                           uint32_t max,
+                           uint32_t * value)
+{
+    char * end;
 
-    if (!isdigit(*p))
+    // strtoul() would also accept signs
+    if ((16 == base) ? !isxdigit(*arg->str) : !isdigit(*arg->str))
     {
-        arg_error = true;
+        return false;
     }
-    else
-    {
-        uint8_t i = 0;
-        uint16_t time;
-
-        while ((i != 7) && isdigit(*p))
-        {
-            arg[i++] = *(p++);
-        }
 
-        arg[i] = NULL;
+    *value = strtoul(arg->str, &end, base);
 
-        time = (uint16_t)atoi(arg);
-
-        flash_init_write_buffer();
-        
-        if (buttons_is_profile_switch_lead())
-        {
-            flash_write_word_to_buffer(FLASH_INDEX_LEAD_SOAK_START_SEC, time);
-        }
-        else
-        {
-            flash_write_word_to_buffer(
-                    FLASH_INDEX_LEAD_FREE_SOAK_START_SEC, time);
-        }
-
-        flash_write_buffer_to_flash();
-    }
+    return (end == arg->str + arg->len) && (*value <= max);
 }
 
-static void set_start_of_reflow(void)
+static bool parse_q16_16_arg(const token_t * arg, q16_16_t * value)
 {
-    uint8_t * p;
-    char arg[8] = {0};
+    const char * end;
 
-    p = (uint8_t*)strstr(cmd_buffer, SET_START_OF_REFLOW);
-    p += strlen(SET_START_OF_REFLOW);
-    p += 1;     // +1 for space
+    return str_to_q16_16(arg->str, value, &end) &&
+           (end == arg->str + arg->len);
+}
 
-    if (!isdigit(*p))
-    {
-        arg_error = true;
-    }
-    else
-    {
-        uint8_t i = 0;
-        uint16_t time;
+static void write_q16_16_answer(q16_16_t value)
+{
+    char ans[Q16_16_STR_MAX_LEN + sizeof(NEWLINE)];
+    uint8_t len;
 
-        while ((i != 7) && isdigit(*p))
-        {
-            arg[i++] = *(p++);
-        }
+    len = q16_16_to_str(ans, value, Q16_16_STR_DECIMALS);
+    strcpy(ans + len, NEWLINE);
+    uart_write_string(ans);
+}
 
-        arg[i] = NULL;
+static void get_phase_start(temp_curve_phase_t phase)
+{
+    char ans[32];
 
-        time = (uint16_t)atoi(arg);
+    sprintf(ans, "%us%s",
+            temp_curve_get_phase_start(phase),
+            NEWLINE);
+    uart_write_string(ans);
+}
 
-        flash_init_write_buffer();
+static void set_phase_start(const token_t * arg, temp_curve_phase_t phase)
+{
+    uint32_t time;
 
-        if (buttons_is_profile_switch_lead())
-        {
-            flash_write_word_to_buffer(FLASH_INDEX_LEAD_REFLOW_START_SEC, time);
-        }
-        else
-        {
-            flash_write_word_to_buffer(
-                    FLASH_INDEX_LEAD_FREE_REFLOW_START_SEC, time);
-        }
+    arg_error = !parse_uint_arg(arg, 10, UINT16_MAX, &time);
 
-        flash_write_buffer_to_flash();
+    if (!arg_error)
+    {
+        profile_set_phase_start(temp_curve_get_profile(),
+                                phase,
+                                (uint16_t)time);
+        reload_profile();
     }
 }
 
-static void set_start_of_cool(void)
+static void reload_profile(void)
 {
-    uint8_t * p;
-    char arg[8] = {0};
-
-    p = (uint8_t*)strstr(cmd_buffer, SET_START_OF_COOL);
-    p += strlen(SET_START_OF_COOL);
-    p += 1;     // +1 for space
-
-    if (!isdigit(*p))
+    if (buttons_is_profile_switch_lead())
     {
-        arg_error = true;
+        status_set(STATUS_SWITCH_TO_LEAD_FLAG, true);
     }
     else
     {
-        uint8_t i = 0;
-        uint16_t time;
-
-        while ((i != 7) && isdigit(*p))
-        {
-            arg[i++] = *(p++);
-        }
-
-        arg[i] = NULL;
-
-        time = (uint16_t)atoi(arg);
+        status_set(STATUS_SWITCH_TO_LEAD_FREE_FLAG, true);
+    }
+}
 
-        flash_init_write_buffer();
+static uint8_t quarter_degrees_to_str(char * buf, uint16_t temp)
+{
+    uint8_t len;
 
-        if (buttons_is_profile_switch_lead())
-        {
-            flash_write_word_to_buffer(FLASH_INDEX_LEAD_COOL_START_SEC, time);
-        }
-        else
-        {
-            flash_write_word_to_buffer(
-                    FLASH_INDEX_LEAD_FREE_COOL_START_SEC, time);
-        }
+    len = uint16_to_str(buf, temp >> 2, 3);
+    buf[len++] = '.';
+    len += uint16_to_str(buf + len, (temp & 0x0003) * 25, 2);
 
-        flash_write_buffer_to_flash();
-    }
-}
\ No newline at end of file
+    return len;
+}
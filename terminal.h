@@ -29,10 +29,59 @@ extern "C" {
 // =============================================================================
 
 /**
- * @brief Handles any received characters.
+ * @brief Handles any received characters: echoes them, handles backspace
+ * and queues completed lines.
  */
 void terminal_handle_uart_event(void);
 
+/**
+ * @brief Checks if a received line is waiting to be executed.
+ * @return True if terminal_handle_command_event() should be called.
+ */
+bool terminal_is_command_pending(void);
+
+/**
+ * @brief Executes the oldest received line.
+ */
+void terminal_handle_command_event(void);
+
+/**
+ * @brief Checks if a baud rate set by "set baud" has not been confirmed by a
+ * valid command in time.
+ * @return True if terminal_handle_baud_timeout() should be called.
+ */
+bool terminal_is_baud_change_expired(void);
+
+/**
+ * @brief Requests that the baud rate used before "set baud" is restored.
+ */
+void terminal_handle_baud_timeout(void);
+
+/**
+ * @brief Checks if a baud rate switch is requested and the uart is idle, so
+ * that everything queued before it has been sent at the old baud rate.
+ * @return True if terminal_handle_baud_switch() should be called.
+ */
+bool terminal_is_baud_switch_ready(void);
+
+/**
+ * @brief Switches to the requested baud rate.
+ */
+void terminal_handle_baud_switch(void);
+
+/**
+ * @brief Checks if a recorded run or a list is being written, see "dump
+ * run", "list profiles" and "list runs".
+ * @return True if terminal_handle_dump_event() should be called when the
+ * uart write buffer is empty.
+ */
+bool terminal_is_dump_active(void);
+
+/**
+ * @brief Writes the next lines of the recorded run or the list.
+ */
+void terminal_handle_dump_event(void);
+
 #ifdef	__cplusplus
 }
 #endif
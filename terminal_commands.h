@@ -0,0 +1,52 @@
+/*
+This file is an auto generated file.
+Do not modify its contents manually!
+*/
+static const command_t COMMANDS[] =
+{
+    {CMD_BUFFERED_WRITE, cmd_buffered_write, 2, 2},
+    {CMD_DUMP_RUN, cmd_dump_run, 1, 1},
+    {CMD_FLUSH_BUFFER, cmd_flush_buffer, 0, 0},
+    {GET_PID_KP, get_pid_kp, 0, 0},
+    {GET_PID_KD, get_pid_kd, 0, 0},
+    {GET_PID_KI, get_pid_ki, 0, 0},
+    {GET_PID_TTR, get_pid_ttr, 0, 0},
+    {GET_BAUD, get_baud, 0, 0},
+    {GET_PID_D_MAX_GAIN, get_pid_d_max_gain, 0, 0},
+    {GET_FLASH, get_flash, 1, 1},
+    {GET_PENDING_WRITES, get_pending_writes, 0, 0},
+    {GET_PID_SERVO_FACTOR, get_pid_servo_factor, 0, 0},
+    {GET_PROFILE, get_profile, 0, 0},
+    {GET_START_OF_COOL, get_start_of_cool, 0, 0},
+    {GET_START_OF_REFLOW, get_start_of_reflow, 0, 0},
+    {GET_START_OF_SOAK, get_start_of_soak, 0, 0},
+    {GET_TELEMETRY, get_telemetry, 0, 0},
+    {GET_TEMP_FILTER_LEN, get_temp_filter_len, 0, 0},
+    {GET_UART_DROPS, get_uart_drops, 0, 0},
+    {CMD_HELLO, cmd_hello, 0, 0},
+    {CMD_INIT_WRITE_BUFFER, cmd_init_write_buffer, 0, 0},
+    {CMD_LIST_PROFILES, cmd_list_profiles, 0, 0},
+    {CMD_LIST_RUNS, cmd_list_runs, 0, 0},
+    {SET_PID_KP, set_pid_kp, 1, 1},
+    {SET_PID_KD, set_pid_kd, 1, 1},
+    {SET_PID_KI, set_pid_ki, 1, 1},
+    {SET_PID_TTR, set_pid_ttr, 1, 1},
+    {SET_BAUD, set_baud, 1, 1},
+    {SET_PID_D_MAX_GAIN, set_pid_d_max_gain, 1, 1},
+    {SET_FLASH, set_flash, 2, 2},
+    {SET_HEAT_PWM, set_heat_pwm, 1, 1},
+    {SET_HEATER, set_heater, 1, 1},
+    {SET_PID_SERVO_FACTOR, set_pid_servo_factor, 1, 1},
+    {SET_PROFILE, set_profile, 1, 1},
+    {SET_SERVO_POS, set_servo_pos, 1, 1},
+    {SET_START_OF_COOL, set_start_of_cool, 1, 1},
+    {SET_START_OF_REFLOW, set_start_of_reflow, 1, 1},
+    {SET_START_OF_SOAK, set_start_of_soak, 1, 1},
+    {SET_TELEMETRY, set_telemetry, 1, 1},
+    {SET_TEMP_FILTER_LEN, set_temp_filter_len, 1, 1},
+    {CMD_TEMP_CURVE_EVAL, cmd_temp_curve_eval, 1, 1},
+    {CMD_TEST_TEMP, cmd_test_temp, 0, 0},
+    {CMD_WRITE_PROGRAM, cmd_write_program, 6, 255},
+};
+
+#define NBR_OF_COMMANDS 43
@@ -1,18 +1,35 @@
-# This script generates documentation which can be seen in the dsp terminal.
+# This script generates documentation which can be seen in the dsp terminal,
+# and the table which execute_command() in terminal.c looks up commands in.
+#
+# The handler of a command is named as its C string constant in lower case.
+# The number of arguments it takes is the number of <...> on the Parameter
+# line of the documentation, a trailing ... allows more arguments.
+
+import re
+
+# Largest number of arguments, also used for commands ending with ...
+MAX_ARGS = 255
 
 class Command_doc:
     tag = ""
     cmd = ""
     doc = ""
+    min_args = 0
+    max_args = 0
 
     # @brief Creates a command documentation for one command
     # @param tag - The name of the C string constant
     # @param cmd - The command to create a Command_doc for
     # @param doc - The documentation text of the command
-    def __init__(self, command_tag = "", command = "", documentation = ""):
+    # @param min_args - Number of arguments the command needs
+    # @param max_args - Number of arguments the command accepts
+    def __init__(self, command_tag = "", command = "", documentation = "",
+                 min_args = 0, max_args = 0):
         self.tag = command_tag
         self.cmd = command
         self.doc = documentation
+        self.min_args = min_args
+        self.max_args = max_args
 
 class Cmd_parser:
     commands = []
@@ -29,6 +46,8 @@ class Cmd_parser:
         doc = ""
         tag = ""
         cmd = ""
+        min_args = 0
+        max_args = 0
         for line in lines:
             if parse_cmd:
                 parse_cmd = False
@@ -37,19 +56,57 @@ class Cmd_parser:
                 start_of_cmd = line.index('"') + 1
                 end_of_cmd = start_of_cmd + 1 + line[start_of_cmd + 1:].index('"')
                 cmd = line[start_of_cmd:end_of_cmd]
-                self.commands.append(Command_doc(tag, cmd, doc))
+                self.commands.append(Command_doc(tag, cmd, doc,
+                                                 min_args, max_args))
 
             if start_tag in line:
                 parsing_doc = True
                 doc = ""
                 tag = ""
                 cmd = ""
+                min_args = 0
+                max_args = 0
             elif parsing_doc and end_tag in line:
                 parsing_doc = False
                 parse_cmd = True
             elif parsing_doc:
                 doc += line.strip() + "\\n\\r\\t"
 
+                # Also matches the Paramter misspelling
+                if re.match(r"Param\w*:", line.strip()):
+                    min_args = len(re.findall(r"<[^>]*>", line))
+                    max_args = MAX_ARGS if "..." in line else min_args
+
+    # @brief Creates the command table included by terminal.c, sorted word
+    # by word so a command can be found by a binary search
+    def create_command_table(self):
+        commands = sorted(self.commands, key=lambda cmd: cmd.cmd.split(" "))
+
+        # The search stops at the first command matching the start of a line
+        for a in commands:
+            for b in commands:
+                words = a.cmd.split(" ")
+                if (a is not b) and (b.cmd.split(" ")[:len(words)] == words):
+                    raise ValueError("\"" + a.cmd + "\" is the start of \"" +
+                                     b.cmd + "\"")
+
+        with open("terminal_commands.h", 'w') as f:
+            print("/*", file=f)
+            print("This file is an auto generated file.", file=f)
+            print("Do not modify its contents manually!", file=f)
+            print("*/", file=f)
+            print("static const command_t COMMANDS[] =", file=f)
+            print("{", file=f)
+
+            for cmd in commands:
+                print("    {" + cmd.tag + ", " + cmd.tag.lower() + ", " +
+                      str(cmd.min_args) + ", " + str(cmd.max_args) + "},",
+                      file=f)
+
+            print("};", file=f)
+            print("", file=f)
+            print("#define NBR_OF_COMMANDS " + str(len(commands)), file=f)
+
     def create_help_function(self):
         with open("terminal_help.c", 'w') as f:
             print("/*", file=f)
@@ -113,5 +170,6 @@ if __name__ == "__main__":
     parser = Cmd_parser()
     parser.parse_command_doc()
     parser.create_help_function()
+    parser.create_command_table()
     print("Terminal doc gen complete")
     
@@ -24,7 +24,7 @@ void terminal_help(char* in)
     }
     else if (NULL != strstr(in, "init flash bufffer"))
     {
-        uart_write_string("\tInitiates the flash write buffer with the contents of theflash data memory.\n\r\t\n\r");
+        uart_write_string("\tInitiates the flash write buffer with the contents of theflash data memory.\n\r\tWrites which are not yet committed are discarded.\n\r\t\n\r");
         while (!uart_is_write_buffer_empty()){;}
     }
     else if (NULL != strstr(in, "buffered write"))
@@ -34,7 +34,27 @@ void terminal_help(char* in)
     }
     else if (NULL != strstr(in, "flush flash buffer"))
     {
-        uart_write_string("\tWrite the contents of the flash buffer to the flash memory.\n\r\t\n\r");
+        uart_write_string("\tWrite the changes in the flash buffer to the flash memory.\n\r\tThis is deferred until the reflow program has ended if it is running.\n\r\t\n\r");
+        while (!uart_is_write_buffer_empty()){;}
+    }
+    else if (NULL != strstr(in, "list profiles"))
+    {
+        uart_write_string("\tLists the profiles in the profile library.\n\r\tReturns: <index> <name> <number of points> for each profile\n\r\t\n\r");
+        while (!uart_is_write_buffer_empty()){;}
+    }
+    else if (NULL != strstr(in, "write program"))
+    {
+        uart_write_string("\tStores a profile described as ramp, target and hold segments.\n\r\tEach segment ramps at <rate> C/s to <target> C and then holds the target\n\r\tfor <hold> s. The words soak, reflow and cool can be put before the\n\r\tsegment which starts that phase. An index equal to the number of profiles\n\r\tadds a new profile.\n\r\tParameters: <index> <name> <start temp> <rate> <target> <hold> ...\n\r\tExample: write program 2 Fast 25 1.5 150 0 soak 0.5 180 0 reflow 3 245 10\n\r\tcool 3 50 0\n\r\t\n\r");
+        while (!uart_is_write_buffer_empty()){;}
+    }
+    else if (NULL != strstr(in, "list runs"))
+    {
+        uart_write_string("\tLists the recorded reflow runs, oldest first. The recorder only holds about\n\r\t400 s of samples, so a full reflow overwrites all older runs.\n\r\tReturns: A line with the number of seconds the recorder holds, then\n\r\t<run number> <profile index> <number of samples> for each run\n\r\t\n\r");
+        while (!uart_is_write_buffer_empty()){;}
+    }
+    else if (NULL != strstr(in, "dump run"))
+    {
+        uart_write_string("\tWrites all samples of a recorded reflow run, at 10 samples per second.\n\r\tNot available while a run is recorded. Ends with an empty line.\n\r\tParameter: <run number, see list runs>\n\r\tReturns: <temperature>;<time>;<heater duty>;<servo pos>;<target temp> for\n\r\teach sample\n\r\t\n\r");
         while (!uart_is_write_buffer_empty()){;}
     }
     else if (NULL != strstr(in, "get flash"))
@@ -92,6 +112,31 @@ void terminal_help(char* in)
         uart_write_string("\tGets the timestamp in [s] for when the cooling period starts.\n\r\tThis is done for the profile selected by the reflow profile switch.\n\r\t\n\r");
         while (!uart_is_write_buffer_empty()){;}
     }
+    else if (NULL != strstr(in, "get profile"))
+    {
+        uart_write_string("\tGets the profile selected by the reflow profile switch.\n\r\tReturns: <profile index> <profile name>\n\r\t\n\r");
+        while (!uart_is_write_buffer_empty()){;}
+    }
+    else if (NULL != strstr(in, "get pending writes"))
+    {
+        uart_write_string("\tGets the number of words in the flash buffer which are not yet written to\n\r\tthe flash memory. Changes are written when no reflow program is running.\n\r\tReturns: <number of words>\n\r\t\n\r");
+        while (!uart_is_write_buffer_empty()){;}
+    }
+    else if (NULL != strstr(in, "get baud"))
+    {
+        uart_write_string("\tGets the baud rate of the terminal.\n\r\tReturns: <baud rate>\n\r\t\n\r");
+        while (!uart_is_write_buffer_empty()){;}
+    }
+    else if (NULL != strstr(in, "get telemetry"))
+    {
+        uart_write_string("\tGets how the reflow is logged.\n\r\tReturns: <'ascii' or 'binary'>\n\r\t\n\r");
+        while (!uart_is_write_buffer_empty()){;}
+    }
+    else if (NULL != strstr(in, "get uart drops"))
+    {
+        uart_write_string("\tGets the number of bytes dropped since startup because the uart buffers\n\r\twere full.\n\r\tReturns: <normal priority tx> <high priority tx> <rx>\n\r\t\n\r");
+        while (!uart_is_write_buffer_empty()){;}
+    }
     else if (NULL != strstr(in, "set heater"))
     {
         uart_write_string("\tSets the heater on or off.\n\r\tParameter: <'on' or 'off'>\n\r\t\n\r");
@@ -109,27 +154,27 @@ void terminal_help(char* in)
     }
     else if (NULL != strstr(in, "set K"))
     {
-        uart_write_string("\tSets the K constant in the PID regulator.\n\r\tParameter: <Value in the range [-65535.0, 65535.0]>\n\r\t\n\r");
+        uart_write_string("\tSets the K constant in the PID regulator.\n\r\tParameter: <Decimal value in the range [-32768.0, 32767.9999]>\n\r\t\n\r");
         while (!uart_is_write_buffer_empty()){;}
     }
     else if (NULL != strstr(in, "set Ti"))
     {
-        uart_write_string("\tSets the Ti constant in the PID regulator.\n\r\tParameter: <Value in the range [-65535.0, 65535.0]>\n\r\t\n\r");
+        uart_write_string("\tSets the Ti constant in the PID regulator.\n\r\tParameter: <Decimal value in the range [-32768.0, 32767.9999]>\n\r\t\n\r");
         while (!uart_is_write_buffer_empty()){;}
     }
     else if (NULL != strstr(in, "set Td"))
     {
-        uart_write_string("\tSets the Td constant in the PID regulator.\n\r\tParameter: <Value in the range [-65535.0, 65535.0]>\n\r\t\n\r");
+        uart_write_string("\tSets the Td constant in the PID regulator.\n\r\tParameter: <Decimal value in the range [-32768.0, 32767.9999]>\n\r\t\n\r");
         while (!uart_is_write_buffer_empty()){;}
     }
     else if (NULL != strstr(in, "set Ttr"))
     {
-        uart_write_string("\tSets the integrator tracking time constant in the PID regulator.\n\r\tParameter: <Value in the range [0.0, 65535.0]>\n\r\t\n\r");
+        uart_write_string("\tSets the integrator tracking time constant in the PID regulator.\n\r\tParameter: <Decimal value in the range [0.0, 32767.9999]>\n\r\t\n\r");
         while (!uart_is_write_buffer_empty()){;}
     }
     else if (NULL != strstr(in, "set d max gain"))
     {
-        uart_write_string("\tSets the max gain of the PID derivative term.\n\r\tParameter: <Value in the range [0.0, 65535.0]>\n\r\t\n\r");
+        uart_write_string("\tSets the max gain of the PID derivative term.\n\r\tParameter: <Decimal value in the range [0.0, 32767.9999]>\n\r\t\n\r");
         while (!uart_is_write_buffer_empty()){;}
     }
     else if (NULL != strstr(in, "set pid servo factor"))
@@ -139,7 +184,7 @@ void terminal_help(char* in)
     }
     else if (NULL != strstr(in, "set temp filter len"))
     {
-        uart_write_string("\tSets the length of the moving average temperature filter.\n\r\tReturn: <lenght of filter>\n\r\t\n\r");
+        uart_write_string("\tSets the length of the moving average temperature filter.\n\r\tParameter: <length of filter>\n\r\t\n\r");
         while (!uart_is_write_buffer_empty()){;}
     }
     else if (NULL != strstr(in, "set heat pwm"))
@@ -162,6 +207,21 @@ void terminal_help(char* in)
         uart_write_string("\tSets the timestamp in [s] for when the cool period starts.\n\r\tThis is done for the profile selected by the reflow profile switch.\n\r\tParameter: <timestamp in seconds>\n\r\t\n\r");
         while (!uart_is_write_buffer_empty()){;}
     }
+    else if (NULL != strstr(in, "set profile"))
+    {
+        uart_write_string("\tSelects which profile to use for the current position of the reflow\n\r\tprofile switch, and loads it.\n\r\tParameter: <profile index, see list profiles>\n\r\t\n\r");
+        while (!uart_is_write_buffer_empty()){;}
+    }
+    else if (NULL != strstr(in, "set baud"))
+    {
+        uart_write_string("\tChanges the baud rate of the terminal. The answer is sent at the old baud\n\r\trate, then the new one is used. Unless a valid command is received at the\n\r\tnew baud rate within 10 s, the old one is restored.\n\r\tParameter: <9600, 19200, 38400, 57600, 115200, 250000, 500000 or 1000000>\n\r\tReturns: [Switching to <baud rate> baud]\n\r\t\n\r");
+        while (!uart_is_write_buffer_empty()){;}
+    }
+    else if (NULL != strstr(in, "set telemetry"))
+    {
+        uart_write_string("\tSelects how the reflow is logged. ascii writes one line per second, binary\n\r\tsends one COBS framed record per control tick, see telemetry.h.\n\r\tParameter: <'ascii' or 'binary'>\n\r\t\n\r");
+        while (!uart_is_write_buffer_empty()){;}
+    }
     else
     {
         uart_write_string("\tType \"help <command>\" for more info\n\r");
@@ -172,6 +232,8 @@ void terminal_help(char* in)
         while (!uart_is_write_buffer_empty()){;}
         uart_write_string("buffered write\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
+        uart_write_string("dump run\n\r\t");
+        while (!uart_is_write_buffer_empty()){;}
         uart_write_string("flush flash buffer\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
         uart_write_string("get K\n\r\t");
@@ -182,24 +244,38 @@ void terminal_help(char* in)
         while (!uart_is_write_buffer_empty()){;}
         uart_write_string("get Ttr\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
+        uart_write_string("get baud\n\r\t");
+        while (!uart_is_write_buffer_empty()){;}
         uart_write_string("get d max gain\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
         uart_write_string("get flash\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
+        uart_write_string("get pending writes\n\r\t");
+        while (!uart_is_write_buffer_empty()){;}
         uart_write_string("get pid servo factor\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
+        uart_write_string("get profile\n\r\t");
+        while (!uart_is_write_buffer_empty()){;}
         uart_write_string("get start of cool\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
         uart_write_string("get start of reflow\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
         uart_write_string("get start of soak\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
+        uart_write_string("get telemetry\n\r\t");
+        while (!uart_is_write_buffer_empty()){;}
         uart_write_string("get temp filter len\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
+        uart_write_string("get uart drops\n\r\t");
+        while (!uart_is_write_buffer_empty()){;}
         uart_write_string("hello\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
         uart_write_string("init flash bufffer\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
+        uart_write_string("list profiles\n\r\t");
+        while (!uart_is_write_buffer_empty()){;}
+        uart_write_string("list runs\n\r\t");
+        while (!uart_is_write_buffer_empty()){;}
         uart_write_string("set K\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
         uart_write_string("set Td\n\r\t");
@@ -208,6 +284,8 @@ void terminal_help(char* in)
         while (!uart_is_write_buffer_empty()){;}
         uart_write_string("set Ttr\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
+        uart_write_string("set baud\n\r\t");
+        while (!uart_is_write_buffer_empty()){;}
         uart_write_string("set d max gain\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
         uart_write_string("set flash\n\r\t");
@@ -218,6 +296,8 @@ void terminal_help(char* in)
         while (!uart_is_write_buffer_empty()){;}
         uart_write_string("set pid servo factor\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
+        uart_write_string("set profile\n\r\t");
+        while (!uart_is_write_buffer_empty()){;}
         uart_write_string("set servo pos\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
         uart_write_string("set start of cool\n\r\t");
@@ -226,12 +306,16 @@ void terminal_help(char* in)
         while (!uart_is_write_buffer_empty()){;}
         uart_write_string("set start of soak\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
+        uart_write_string("set telemetry\n\r\t");
+        while (!uart_is_write_buffer_empty()){;}
         uart_write_string("set temp filter len\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
         uart_write_string("temp curve eval\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
         uart_write_string("test temp\n\r\t");
         while (!uart_is_write_buffer_empty()){;}
+        uart_write_string("write program\n\r\t");
+        while (!uart_is_write_buffer_empty()){;}
         uart_write_string("\n\r");
     }
 }
@@ -1,6 +1,15 @@
 /*
  * This file handes the UART module.
  *
+ * The baud rate generator runs in high speed mode (BRGH = 1), where
+ * baud = PERIPHERAL_FREQ / (4 * (U2BRG + 1)). Only the rates in BAUD_RATES
+ * can be selected, their error is within +-1 %.
+ *
+ * Bytes are sent from two lanes, see uart_priority_t. The tx interrupt sends
+ * the high priority lane first, but only switches to it between lines of the
+ * normal lane, so lines are not mixed. Bytes which do not fit in their lane
+ * are dropped and counted.
+ *
  * References:
  * - PIC24FJ64GA006 datasheet, document number DS39747D, page 139
  */
@@ -23,6 +32,21 @@
 // Private type definitions
 // =============================================================================
 
+typedef struct baud_rate_t
+{
+    uint32_t baud;
+    uint16_t brg;       // U2BRG value with BRGH = 1
+} baud_rate_t;
+
+typedef struct tx_lane_t
+{
+    volatile uint8_t * buff;
+    uint16_t mask;                  // Size of buff - 1
+    volatile uint16_t head;         // Written by the main loop
+    volatile uint16_t tail;         // Written by the tx interrupt
+    uint32_t dropped;               // Bytes which did not fit
+} tx_lane_t;
+
 // =============================================================================
 // Global variables
 // =============================================================================
@@ -30,41 +54,102 @@
 // =============================================================================
 // Private constants
 // =============================================================================
-#define BUFFER_SIZE     ((uint16_t)256)
-#define BACKSPACE_CHAR  (0x08)
 
-static const uint32_t UART_BAUD = 9600;
+//
+// The buffers are single producer, single consumer rings. The sizes must be
+// powers of two, the head and tail indices run freely and are masked when
+// used. Each index is written by one side only, so no interrupts have to be
+// disabled.
+//
+#define RX_BUFFER_SIZE          ((uint16_t)256)
+#define TX_BUFFER_SIZE          ((uint16_t)256)
+#define TX_HIGH_BUFFER_SIZE     ((uint16_t)64)
+
+#define RX_MASK                 (RX_BUFFER_SIZE - 1)
+
 static const uint32_t PERIPHERAL_FREQ = STATUS_PERIPHERAL_FREQ;
 
-static const uint8_t COMMAND_TERMINATION_CHAR = '\n';
+//
+// Verified for the 16 MHz peripheral clock. 230400 baud is left out, the
+// closest rate is 235294 baud (+2.12 %).
+//
+static const baud_rate_t BAUD_RATES[] =
+{
+    //  Baud      U2BRG         Actual baud     Error
+    {    9600,      416 },  //     9592         -0.08 %
+    {   19200,      207 },  //    19231         +0.16 %
+    {   38400,      103 },  //    38462         +0.16 %
+    {   57600,       68 },  //    57971         +0.64 %
+    {  115200,       34 },  //   114286         -0.79 %
+    {  250000,       15 },  //   250000          0.00 %
+    {  500000,        7 },  //   500000          0.00 %
+    { 1000000,        3 },  //  1000000          0.00 %
+};
+
+#define NBR_OF_BAUD_RATES (sizeof(BAUD_RATES) / sizeof(BAUD_RATES[0]))
 
 // =============================================================================
 // Private variables
 // =============================================================================
 static bool uart_initialized = false;
 
-static volatile uint8_t rx_buff[BUFFER_SIZE];
-static volatile uint8_t tx_buff[BUFFER_SIZE];
+static uint32_t current_baud = UART_DEFAULT_BAUD;
 
-static volatile uint16_t rx_buff_first = 0;
-static volatile uint16_t rx_buff_last = 0;
-static volatile uint16_t tx_buff_first = 0;
-static volatile uint16_t tx_buff_last = 0;
+// Raw received bytes, written by the rx interrupt, read by the main loop
+static volatile uint8_t rx_buff[RX_BUFFER_SIZE];
+static volatile uint16_t rx_head = 0;   // Written by the rx interrupt
+static volatile uint16_t rx_tail = 0;   // Written by the main loop
+static volatile uint32_t rx_dropped = 0; // Written by the rx interrupt
 
-static volatile uint16_t rx_buff_size = 0;
-static volatile uint16_t tx_buff_size = 0;
+// Written by the main loop, read by the tx interrupt
+static volatile uint8_t tx_buff[TX_BUFFER_SIZE];
+static volatile uint8_t tx_high_buff[TX_HIGH_BUFFER_SIZE];
+
+static tx_lane_t tx_lanes[UART_NBR_OF_PRIORITIES] =
+{
+    [UART_PRIORITY_NORMAL] = { tx_buff, TX_BUFFER_SIZE - 1, 0, 0, 0 },
+    [UART_PRIORITY_HIGH] = { tx_high_buff, TX_HIGH_BUFFER_SIZE - 1, 0, 0, 0 },
+};
+
+// Set when the last byte sent from the normal lane ended a line or frame
+static bool tx_at_line_start = true;
+
+// Set between the opening and the closing zero byte of a telemetry frame sent
+// from the normal lane. Inside a frame 0x0A is an ordinary payload byte.
+static bool tx_in_frame = false;
 
 // =============================================================================
 // Private function declarations
 // =============================================================================
 
 /**
- * @brief Starts transmission of the tx buffer.
+ * @brief Starts transmission of the tx buffer by triggering the tx
+ * interrupt, which is the only reader of the tx buffer.
  * @param void
  * @return void
  */
 static void start_tx(void);
 
+/**
+ * @brief Finds a baud rate in BAUD_RATES.
+ * @param baud - The baud rate.
+ * @return The entry, or NULL if the baud rate is not supported.
+ */
+static const baud_rate_t * find_baud_rate(uint32_t baud);
+
+/**
+ * @brief Copies a contiguous span into the buffer of a tx lane.
+ * @param lane - The lane.
+ * @param index - Where in the buffer to start.
+ * @param data - The bytes to copy.
+ * @param nbr_of_bytes - Number of bytes, must fit before the end of the
+ * buffer.
+ */
+static void copy_to_tx_buff(tx_lane_t * lane,
+                            uint16_t index,
+                            const uint8_t* data,
+                            uint16_t nbr_of_bytes);
+
 // =============================================================================
 // Public function definitions
 // =============================================================================
@@ -78,13 +163,13 @@ void uart_init()
         //
         // Variables
         //
-        rx_buff_first = 0;
-        rx_buff_last = 0;
-        tx_buff_first = 0;
-        tx_buff_last = 0;
-
-        rx_buff_size = 0;
-        tx_buff_size = 0;
+        rx_head = 0;
+        rx_tail = 0;
+        tx_lanes[UART_PRIORITY_NORMAL].head = 0;
+        tx_lanes[UART_PRIORITY_NORMAL].tail = 0;
+        tx_lanes[UART_PRIORITY_HIGH].head = 0;
+        tx_lanes[UART_PRIORITY_HIGH].tail = 0;
+        tx_at_line_start = true;
 
         status_set(STATUS_UART_RECEIVE_FLAG, 0);
 
@@ -100,7 +185,9 @@ void uart_init()
         U2MODE = 0x0000;
         U2STA = 0x0000;
 
-        U2BRG = (PERIPHERAL_FREQ / UART_BAUD) / 16 - 1;
+        U2MODEbits.BRGH = 1;
+        U2BRG = find_baud_rate(UART_DEFAULT_BAUD)->brg;
+        current_baud = UART_DEFAULT_BAUD;
 
         U2MODEbits.PDSEL = 0; // 8 bit data, no parity
         U2MODEbits.STSEL = 0; // 1 Stop bit
@@ -122,7 +209,7 @@ void uart_init()
         U2MODEbits.UARTEN = 1;
         U2STAbits.UTXEN = 1;
 
-        for (wait_cnt = 0; wait_cnt != PERIPHERAL_FREQ / UART_BAUD; ++wait_cnt)
+        for (wait_cnt = 0; wait_cnt != PERIPHERAL_FREQ / UART_DEFAULT_BAUD; ++wait_cnt)
         {
             ;
         }
@@ -131,132 +218,194 @@ void uart_init()
     }
 }
 
-void uart_write(uint8_t data)
+bool uart_set_baud(uint32_t baud)
 {
-    if ((0 == tx_buff_size) && (0 == U2STAbits.UTXBF))
+    const baud_rate_t * rate = find_baud_rate(baud);
+
+    if (NULL == rate)
     {
-        // hw transmit buffer not full but tx buffer is.
-        U2TXREG = data;
+        return false;
     }
-    else if (tx_buff_size < BUFFER_SIZE)
-    {
-        if (0 != tx_buff_size)
-        {
-            ++tx_buff_last;
 
-            if (tx_buff_last >= BUFFER_SIZE)
-            {
-                tx_buff_last = 0;
-            }
-        }
+    U2BRG = rate->brg;
+    current_baud = baud;
 
-        tx_buff[tx_buff_last] = data;
+    // Anything received around the switch is garbage
+    uart_clear_receive_buffer();
 
-        ++tx_buff_size;
-    }
+    return true;
 }
 
-void uart_write_string(const char* data)
+bool uart_is_baud_supported(uint32_t baud)
 {
-    const uint8_t* p = (const uint8_t*)data;
+    return NULL != find_baud_rate(baud);
+}
 
-    // Update the tx buffer.
-    while (*p && (tx_buff_size < BUFFER_SIZE))
-    {
-        if (0 != tx_buff_size)
-        {
-            ++tx_buff_last;
+uint32_t uart_get_baud(void)
+{
+    return current_baud;
+}
 
-            if (tx_buff_last >= BUFFER_SIZE)
-            {
-                tx_buff_last = 0;
-            }
-        }
+uint16_t uart_write(uint8_t data)
+{
+    return uart_write_array(1, &data);
+}
+
+uint16_t uart_write_string(const char* data)
+{
+    return uart_write_array(strlen(data), (const uint8_t*)data);
+}
+
+uint16_t uart_write_array(uint16_t nbr_of_bytes, const uint8_t* data)
+{
+    return uart_write_array_priority(UART_PRIORITY_NORMAL, nbr_of_bytes, data);
+}
+
+uint16_t uart_write_string_priority(uart_priority_t priority,
+                                    const char* data)
+{
+    return uart_write_array_priority(priority,
+                                     strlen(data),
+                                     (const uint8_t*)data);
+}
 
-        tx_buff[tx_buff_last] = *(p++);
+uint16_t uart_write_array_priority(uart_priority_t priority,
+                                   uint16_t nbr_of_bytes,
+                                   const uint8_t* data)
+{
+    tx_lane_t * lane = &tx_lanes[priority];
+    uint16_t head = lane->head;
+    uint16_t space = lane->mask + 1 - (uint16_t)(head - lane->tail);
+    uint16_t span;
 
-        ++tx_buff_size;
+    // Bytes which do not fit are dropped
+    if (nbr_of_bytes > space)
+    {
+        lane->dropped += nbr_of_bytes - space;
+        nbr_of_bytes = space;
     }
 
+    // Copy up to the end of the buffer, then from the start
+    span = lane->mask + 1 - (head & lane->mask);
+
+    if (span > nbr_of_bytes)
+    {
+        span = nbr_of_bytes;
+    }
+
+    copy_to_tx_buff(lane, head & lane->mask, data, span);
+    copy_to_tx_buff(lane, 0, data + span, nbr_of_bytes - span);
+
+    // Publish the bytes to the tx interrupt
+    lane->head = head + nbr_of_bytes;
+
     start_tx();
+
+    return nbr_of_bytes;
 }
 
-void uart_write_array(uint16_t nbr_of_bytes, const uint8_t* data)
+uint16_t uart_get_write_buffer_space(void)
 {
-    uint16_t i;
+    const tx_lane_t * lane = &tx_lanes[UART_PRIORITY_NORMAL];
 
-    // Update the tx buffer.
-    for (i = 0; i != nbr_of_bytes; ++i)
-    {
-        if (tx_buff_size < BUFFER_SIZE)
-        {
-            if (0 != tx_buff_size)
-            {
-                ++tx_buff_last;
+    return lane->mask + 1 - (uint16_t)(lane->head - lane->tail);
+}
 
-                if (tx_buff_last >= BUFFER_SIZE)
-                {
-                    tx_buff_last = 0;
-                }
-            }
+bool uart_is_idle(void)
+{
+    return uart_is_write_buffer_empty() && (0 != U2STAbits.TRMT);
+}
 
-            tx_buff[tx_buff_last] = *(data++);
+bool uart_is_write_buffer_empty(void)
+{
+    uint8_t i;
 
-            if (tx_buff_size < BUFFER_SIZE)
-            {
-                ++tx_buff_size;
-            }
+    for (i = 0; i != UART_NBR_OF_PRIORITIES; ++i)
+    {
+        if (tx_lanes[i].head != tx_lanes[i].tail)
+        {
+            return false;
         }
     }
 
-    start_tx();
+    return true;
 }
 
-bool uart_is_write_buffer_empty(void)
+uint32_t uart_get_tx_dropped(uart_priority_t priority)
 {
-    return tx_buff_size == 0;
+    return tx_lanes[priority].dropped;
+}
+
+uint32_t uart_get_rx_dropped(void)
+{
+    volatile uint32_t d1;
+    volatile uint32_t d2;
+
+    // Avoid that _U2RXInterrupt preempts and changes rx_dropped during the
+    // assignment.
+    do
+    {
+        d1 = rx_dropped;
+        d2 = rx_dropped;
+    } while (d1 != d2);
+
+    return d1;
 }
 
 uint8_t uart_get(uint16_t index)
 {
+    return rx_buff[(rx_tail + index) & RX_MASK];
+}
+
+uint16_t uart_read(uint8_t* data, uint16_t max_bytes)
+{
+    uint16_t tail = rx_tail;
+    uint16_t nbr_of_bytes = rx_head - tail;
+    uint16_t span;
     uint16_t i;
-    uint8_t data;
 
-    uart_disable_rx_interrupt();
+    if (nbr_of_bytes > max_bytes)
+    {
+        nbr_of_bytes = max_bytes;
+    }
 
-    i = rx_buff_first + index;
+    // Copy up to the end of the buffer, then from the start
+    span = RX_BUFFER_SIZE - (tail & RX_MASK);
 
-    if (i >= BUFFER_SIZE)
+    if (span > nbr_of_bytes)
     {
-        i -= BUFFER_SIZE;
+        span = nbr_of_bytes;
     }
 
-    data = rx_buff[i];
+    for (i = 0; i != span; ++i)
+    {
+        data[i] = rx_buff[(tail & RX_MASK) + i];
+    }
+
+    for (; i != nbr_of_bytes; ++i)
+    {
+        data[i] = rx_buff[i - span];
+    }
 
-    uart_enable_rx_interrupt();
+    // Hand the space back to the rx interrupt
+    rx_tail = tail + nbr_of_bytes;
 
-    return data;
+    return nbr_of_bytes;
 }
 
 uint16_t uart_get_receive_buffer_size(void)
 {
-    return rx_buff_size;
+    return rx_head - rx_tail;
 }
 
 bool uart_is_receive_buffer_empty(void)
 {
-    return (0 == rx_buff_size);
+    return rx_head == rx_tail;
 }
 
 void uart_clear_receive_buffer(void)
 {
-    uart_disable_rx_interrupt();
-
-    rx_buff_size = 0;
-    rx_buff_first = 0;
-    rx_buff_last = 0;
-
-    uart_enable_rx_interrupt();
+    rx_tail = rx_head;
 }
 
 
@@ -266,116 +415,114 @@ void uart_clear_receive_buffer(void)
 
 void __attribute__((interrupt, no_auto_psv)) _U2TXInterrupt(void)
 {
-    while ((0 == U2STAbits.UTXBF) && (0 != tx_buff_size))
-    {
-        // TX fifo not full and there are more things to send
-        U2TXREG = tx_buff[tx_buff_first];
+    // Cleared first, so a start_tx() during the loop is not lost
+    IFS1bits.U2TXIF = 0;
 
-        if (1 != tx_buff_size)
+    tx_lane_t * normal = &tx_lanes[UART_PRIORITY_NORMAL];
+    tx_lane_t * high = &tx_lanes[UART_PRIORITY_HIGH];
+    uint8_t data;
+
+    // Fill the tx fifo
+    while (0 == U2STAbits.UTXBF)
+    {
+        if ((high->head != high->tail) &&
+            (tx_at_line_start || (normal->head == normal->tail)))
         {
-            ++tx_buff_first;
+            // Frames are written whole, so an empty normal lane is never
+            // inside one
+            if (normal->head == normal->tail)
+            {
+                tx_in_frame = false;
+            }
+
+            U2TXREG = high->buff[high->tail & high->mask];
+            ++high->tail;
         }
+        else if (normal->head != normal->tail)
+        {
+            data = normal->buff[normal->tail & normal->mask];
+            U2TXREG = data;
+            ++normal->tail;
+
+            // Telemetry frames start and end with a zero byte
+            if (0 == data)
+            {
+                tx_in_frame = !tx_in_frame;
+            }
 
-        if (tx_buff_first >= BUFFER_SIZE)
+            // Lines end with a newline, frames with their closing zero byte
+            tx_at_line_start = !tx_in_frame && (('\n' == data) || (0 == data));
+        }
+        else
         {
-            tx_buff_first = 0;
+            break;
         }
-
-        --tx_buff_size;
     }
-
-    IFS1bits.U2TXIF = 0;
 }
 
 void __attribute__((interrupt, no_auto_psv)) _U2RXInterrupt(void)
 {
     uint8_t received;
 
-    uart_disable_tx_interrupt();
-
     if (U2STAbits.OERR)
     {
         U2STAbits.OERR = 0;
     }
 
+    //
+    // Only queues the bytes, echo and line editing are done by the main
+    // loop, see terminal.c
+    //
     while (U2STAbits.URXDA)
     {
         received = U2RXREG;
 
-        if (COMMAND_TERMINATION_CHAR == received)
+        // Bytes which do not fit are dropped
+        if (RX_BUFFER_SIZE != (uint16_t)(rx_head - rx_tail))
         {
-            status_set(STATUS_UART_RECEIVE_FLAG, true);
-        }
-
-        if (BACKSPACE_CHAR != received)
-        {
-            if (0 != rx_buff_size)
-            {
-                ++rx_buff_last;
-
-                if (rx_buff_last >= BUFFER_SIZE)
-                {
-                    rx_buff_last = 0;
-                }
-            }
-
-            rx_buff[rx_buff_last] = received;
-
-            ++rx_buff_size;
+            rx_buff[rx_head & RX_MASK] = received;
+            ++rx_head;
         }
         else
         {
-            if (1 < rx_buff_size)
-            {
-
-                if (0 != rx_buff_last)
-                {
-                    --rx_buff_last;
-                }
-                else
-                {
-                    rx_buff_last = BUFFER_SIZE - 1;
-                }
-            }
-
-            if (0 != rx_buff_size)
-            {
-                --rx_buff_size;
-            }
+            ++rx_dropped;
         }
-
-
-        uart_write(received);
     }
 
-    uart_enable_tx_interrupt();
-
     IFS1bits.U2RXIF = 0;
+
+    status_set(STATUS_UART_RECEIVE_FLAG, true);
 }
 
 static void start_tx(void)
 {
-    uart_disable_tx_interrupt();
-    uart_disable_rx_interrupt();
-
-    while ((0 != tx_buff_size) && (0 == U2STAbits.UTXBF))
-    {
-        U2TXREG = tx_buff[tx_buff_first];
+    IFS1bits.U2TXIF = 1;
+}
 
-        if (1 != tx_buff_size)
-        {
-            ++tx_buff_first;
-        }
+static const baud_rate_t * find_baud_rate(uint32_t baud)
+{
+    uint8_t i;
 
-        if (tx_buff_first >= BUFFER_SIZE)
+    for (i = 0; i != NBR_OF_BAUD_RATES; ++i)
+    {
+        if (BAUD_RATES[i].baud == baud)
         {
-            tx_buff_first = 0;
+            return &BAUD_RATES[i];
         }
-
-        --tx_buff_size;
     }
 
-    uart_enable_tx_interrupt();
-    uart_enable_rx_interrupt();
+    return NULL;
 }
 
+static void copy_to_tx_buff(tx_lane_t * lane,
+                            uint16_t index,
+                            const uint8_t* data,
+                            uint16_t nbr_of_bytes)
+{
+    volatile uint8_t* p = &lane->buff[index];
+
+    while (nbr_of_bytes--)
+    {
+        *(p++) = *(data++);
+    }
+}
@@ -18,6 +18,13 @@ extern "C" {
 // Public type definitions
 // =============================================================================
 
+typedef enum
+{
+    UART_PRIORITY_NORMAL = 0,   // Answers, logs and other bulk output
+    UART_PRIORITY_HIGH,         // Errors and status lines, sent first
+    UART_NBR_OF_PRIORITIES
+} uart_priority_t;
+
 // =============================================================================
 // Global variable declarations
 // =============================================================================
@@ -26,6 +33,9 @@ extern "C" {
 // Global constatants
 // =============================================================================
 
+// Baud rate after uart_init()
+#define UART_DEFAULT_BAUD   9600
+
 // =============================================================================
 // Public function declarations
 // =============================================================================
@@ -37,40 +47,129 @@ extern "C" {
 void uart_init();
 
 /**
- * @brief Writes a byte over the uart interface.
+ * @brief Changes the baud rate.
+ * @details Switches at once and clears the receive buffer. Bytes which are
+ * still being sent are garbled, so switch only when uart_is_idle().
+ * @param baud - The new baud rate, one of 9600, 19200, 38400, 57600,
+ * 115200, 250000, 500000 and 1000000.
+ * @return False if the baud rate is not supported, it is then not changed.
+ */
+bool uart_set_baud(uint32_t baud);
+
+/**
+ * @brief Checks if a baud rate can be selected with uart_set_baud().
+ * @param baud - The baud rate.
+ * @return True if the baud rate is supported.
+ */
+bool uart_is_baud_supported(uint32_t baud);
+
+/**
+ * @brief Gets the baud rate.
+ * @return The baud rate.
+ */
+uint32_t uart_get_baud(void);
+
+/**
+ * @brief Writes a byte over the uart interface, at normal priority.
+ * @details Bytes which do not fit in the write buffer are dropped.
  * @param data - The data to send.
- * @return void
+ * @return Number of bytes accepted, 0 or 1.
  */
-void uart_write(uint8_t data);
+uint16_t uart_write(uint8_t data);
 
 /**
- * @brief Write a string over the uart interface.
+ * @brief Write a string over the uart interface, at normal priority.
  * @param data - The null terminated data to send.
- * @return void
+ * @return Number of bytes accepted.
  */
-void uart_write_string(const char* data);
+uint16_t uart_write_string(const char* data);
+
+/**
+ * @brief Write an array over the uart interface, at normal priority.
+ * @details See uart_write_array_priority().
+ * @param nbr_of_bytes - The number of bytes to send.
+ * @param data - The data to send.
+ * @return Number of bytes accepted.
+ */
+uint16_t uart_write_array(uint16_t nbr_of_bytes, const uint8_t* data);
 
 /**
  * @brief Write a string over the uart interface.
- * @brief nbr_of_bytes - The number of bytes to send.
+ * @param priority - The priority of the string, which should end with a
+ * newline.
  * @param data - The null terminated data to send.
- * @return void
+ * @return Number of bytes accepted.
  */
-void uart_write_array(uint16_t nbr_of_bytes, const uint8_t* data);
+uint16_t uart_write_string_priority(uart_priority_t priority,
+                                    const char* data);
 
 /**
- * @brief Checks if the write buffer is empty.
- * @return True if the write buffer is empty.
+ * @brief Write an array over the uart interface.
+ * @details The bytes are copied into the write buffer of the priority in at
+ * most two contiguous spans. Never blocks, bytes which do not fit are
+ * dropped and counted, see uart_get_tx_dropped(). High priority bytes are
+ * only sent between the lines and the telemetry frames of the normal
+ * priority, so a frame, which starts and ends with a zero byte, must be
+ * written whole in one call.
+ * @param priority - The priority of the bytes.
+ * @param nbr_of_bytes - The number of bytes to send.
+ * @param data - The data to send.
+ * @return Number of bytes accepted, the first ones of data.
+ */
+uint16_t uart_write_array_priority(uart_priority_t priority,
+                                   uint16_t nbr_of_bytes,
+                                   const uint8_t* data);
+
+/**
+ * @brief Gets the number of bytes dropped since startup because the write
+ * buffer was full.
+ * @param priority - The priority.
+ * @return Number of dropped bytes.
+ */
+uint32_t uart_get_tx_dropped(uart_priority_t priority);
+
+/**
+ * @brief Gets the number of bytes dropped since startup because the receive
+ * buffer was full.
+ * @return Number of dropped bytes.
+ */
+uint32_t uart_get_rx_dropped(void);
+
+/**
+ * @brief Gets the free space in the normal priority write buffer.
+ * @return Number of bytes which can be written without being dropped.
+ */
+uint16_t uart_get_write_buffer_space(void);
+
+/**
+ * @brief Checks if the write buffers of all priorities are empty.
+ * @return True if the write buffers are empty.
  */
 bool uart_is_write_buffer_empty(void);
 
 /**
- * @brief Gets a byte from the receive buffer.
+ * @brief Checks if the write buffers are empty and the last byte has been
+ * shifted out, so the baud rate can be changed.
+ * @return True if nothing is being sent.
+ */
+bool uart_is_idle(void);
+
+/**
+ * @brief Gets a byte from the receive buffer, without removing it.
  * @param index - The index of the byte to get.
  * @return The byte in the receive buffer at the specified index.
  */
 uint8_t uart_get(uint16_t index);
 
+/**
+ * @brief Moves bytes from the receive buffer.
+ * @details The bytes are copied in at most two contiguous spans.
+ * @param data - Where to store the bytes.
+ * @param max_bytes - Size of data.
+ * @return Number of bytes read.
+ */
+uint16_t uart_read(uint8_t* data, uint16_t max_bytes);
+
 /**
  * @brief Gets the size (in number of elements) of the receive buffer.
  * @param void